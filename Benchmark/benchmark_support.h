@@ -0,0 +1,16 @@
+#pragma once
+#ifndef BENCHMARK_SUPPORT_H
+#define BENCHMARK_SUPPORT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Number of commands in synthetic workloads, set with --workload=N
+// (default 4096).
+size_t workloadSize();
+
+// Heap allocations made by this process so far; operator new is replaced
+// in main.cpp to count them.
+uint64_t allocationCount();
+
+#endif // BENCHMARK_SUPPORT_H
@@ -0,0 +1,82 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../display_protocol/display_protocol.h"
+#include "../display_protocol/rasterizer.h"
+
+// The same drawing sent as one bulk datagram or as one fixed-size datagram
+// per shape, decoded and drawn into a 1280x720 surface. Reports the bytes
+// each form puts on the wire per shape.
+enum BulkShape { POLYLINE_SHAPE, PIXEL_RUN_SHAPE, RECTANGLES_SHAPE };
+
+static void makeDatagrams(BulkShape shape, size_t count, std::vector<uint8_t>& bulk, std::vector<std::vector<uint8_t>>& singles) {
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> x(0, 1279);
+    std::uniform_int_distribution<int> y(0, 719);
+    uint16_t color = 0x07E0;
+    if (shape == POLYLINE_SHAPE) {
+        // A chart trace: short steps to the right with a random rise or fall.
+        std::uniform_int_distribution<int> step(-8, 8);
+        std::vector<Point> points(count);
+        int height = 360;
+        for (size_t i = 0; i < count; ++i) {
+            height = std::min(719, std::max(0, height + step(random)));
+            points[i] = { static_cast<int16_t>(i * 2 % 1280), static_cast<int16_t>(height) };
+        }
+        encodeDrawPolyline(points, color, bulk);
+    }
+    else if (shape == PIXEL_RUN_SHAPE) {
+        std::vector<uint16_t> colors(count);
+        for (uint16_t& pixel : colors) {
+            pixel = static_cast<uint16_t>(random());
+        }
+        encodeDrawPixelSpan(0, 360, colors, bulk);
+    }
+    else {
+        std::vector<Box> boxes(count);
+        for (Box& box : boxes) {
+            box = { static_cast<int16_t>(x(random)), static_cast<int16_t>(y(random)), 16, 16 };
+        }
+        encodeFillRectangles(boxes, color, bulk);
+    }
+    DisplayProtocol protocol;
+    std::vector<CommandData> commands;
+    expandBulkCommand(protocol.parseBulkCommand(bulk.data(), bulk.size()), commands);
+    singles.resize(commands.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+        appendCommand(commands[i], singles[i]);
+    }
+}
+
+static void BM_BulkDatagram(benchmark::State& state, BulkShape shape, bool bulk) {
+    std::vector<uint8_t> datagram;
+    std::vector<std::vector<uint8_t>> singles;
+    makeDatagrams(shape, static_cast<size_t>(state.range(0)), datagram, singles);
+    Framebuffer framebuffer(1280, 720);
+    Rasterizer rasterizer(framebuffer);
+    DisplayProtocol protocol;
+    size_t bytes = 0;
+    for (auto _ : state) {
+        if (bulk) {
+            rasterizer.execute(protocol.parseBulkCommand(datagram.data(), datagram.size()));
+            bytes += datagram.size();
+        }
+        else {
+            for (const std::vector<uint8_t>& single : singles) {
+                rasterizer.execute(protocol.parseCommand(single.data(), single.size()));
+                bytes += single.size();
+            }
+        }
+        benchmark::DoNotOptimize(framebuffer.data());
+    }
+    state.SetItemsProcessed(state.iterations() * singles.size());
+    state.SetBytesProcessed(bytes);
+    state.counters["bytes/shape"] = static_cast<double>(bytes) / (state.iterations() * singles.size());
+}
+BENCHMARK_CAPTURE(BM_BulkDatagram, PolylineBulk, POLYLINE_SHAPE, true)->Arg(512);
+BENCHMARK_CAPTURE(BM_BulkDatagram, PolylineLines, POLYLINE_SHAPE, false)->Arg(512);
+BENCHMARK_CAPTURE(BM_BulkDatagram, PixelRunBulk, PIXEL_RUN_SHAPE, true)->Arg(640);
+BENCHMARK_CAPTURE(BM_BulkDatagram, PixelRunPixels, PIXEL_RUN_SHAPE, false)->Arg(640);
+BENCHMARK_CAPTURE(BM_BulkDatagram, RectanglesBulk, RECTANGLES_SHAPE, true)->Arg(128);
+BENCHMARK_CAPTURE(BM_BulkDatagram, RectanglesFills, RECTANGLES_SHAPE, false)->Arg(128);
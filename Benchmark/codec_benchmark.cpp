@@ -0,0 +1,208 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include "../display_protocol/display_protocol.h"
+
+// The per-opcode switch parseCommand used before the codec was generated from
+// COMMAND_DESCRIPTORS, kept as the baseline the generated decoder must match.
+static int16_t handInt16(const uint8_t* data, size_t offset) {
+    return static_cast<int16_t>((data[offset + 1] << 8) | data[offset]);
+}
+
+static uint16_t handColor(const uint8_t* data, size_t offset) {
+    return static_cast<uint16_t>((data[offset] << 8) | data[offset + 1]);
+}
+
+static CommandData parseHandWritten(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        throw std::invalid_argument("Empty byte array");
+    }
+    CommandData command;
+    switch (data[0]) {
+    case CLEAR_DISPLAY_OPCODE:
+        if (size != 3) {
+            throw std::invalid_argument("Invalid parameters for clear display");
+        }
+        command.opcode = CLEAR_DISPLAY_OPCODE;
+        command.clearDisplay = { handColor(data, 1) };
+        break;
+    case DRAW_PIXEL_OPCODE:
+        if (size != 7) {
+            throw std::invalid_argument("Invalid parameters for draw pixel");
+        }
+        command.opcode = DRAW_PIXEL_OPCODE;
+        command.drawPixel = { handInt16(data, 1), handInt16(data, 3), handColor(data, 5) };
+        break;
+    case DRAW_LINE_OPCODE:
+        if (size != 11) {
+            throw std::invalid_argument("Invalid parameters for draw line");
+        }
+        command.opcode = DRAW_LINE_OPCODE;
+        command.drawLine = { handInt16(data, 1), handInt16(data, 3), handInt16(data, 5), handInt16(data, 7), handColor(data, 9) };
+        break;
+    case DRAW_RECTANGLE_OPCODE:
+        if (size != 11) {
+            throw std::invalid_argument("Invalid parameters for draw rectangle");
+        }
+        command.opcode = DRAW_RECTANGLE_OPCODE;
+        command.drawRectangle = { handInt16(data, 1), handInt16(data, 3), handInt16(data, 5), handInt16(data, 7), handColor(data, 9) };
+        break;
+    case FILL_RECTANGLE_OPCODE:
+        if (size != 11) {
+            throw std::invalid_argument("Invalid parameters for fill rectangle");
+        }
+        command.opcode = FILL_RECTANGLE_OPCODE;
+        command.fillRectangle = { handInt16(data, 1), handInt16(data, 3), handInt16(data, 5), handInt16(data, 7), handColor(data, 9) };
+        break;
+    case DRAW_ELLIPSE_OPCODE:
+        if (size != 11) {
+            throw std::invalid_argument("Invalid parameters for draw ellipse");
+        }
+        command.opcode = DRAW_ELLIPSE_OPCODE;
+        command.drawEllipse = { handInt16(data, 1), handInt16(data, 3), handInt16(data, 5), handInt16(data, 7), handColor(data, 9) };
+        break;
+    case FILL_ELLIPSE_OPCODE:
+        if (size != 11) {
+            throw std::invalid_argument("Invalid parameters for fill ellipse");
+        }
+        command.opcode = FILL_ELLIPSE_OPCODE;
+        command.fillEllipse = { handInt16(data, 1), handInt16(data, 3), handInt16(data, 5), handInt16(data, 7), handColor(data, 9) };
+        break;
+    default:
+        throw std::invalid_argument("Unknown command opcode");
+    }
+    return command;
+}
+
+// Mixed stream of every opcode in random order, encoded back to back.
+struct EncodedStream {
+    std::vector<uint8_t> bytes;
+    std::vector<size_t> offsets;
+};
+
+static EncodedStream makeMixedStream(size_t count) {
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> opcode(CLEAR_DISPLAY_OPCODE, FILL_ELLIPSE_OPCODE);
+    std::uniform_int_distribution<int> value(0, 0xFFFF);
+    EncodedStream stream;
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t op = static_cast<uint8_t>(opcode(random));
+        stream.offsets.push_back(stream.bytes.size());
+        stream.bytes.push_back(op);
+        for (size_t b = 1; b < commandSize(op); ++b) {
+            stream.bytes.push_back(static_cast<uint8_t>(value(random)));
+        }
+    }
+    stream.offsets.push_back(stream.bytes.size());
+    return stream;
+}
+
+static void BM_DecodeHandWrittenSwitch(benchmark::State& state) {
+    EncodedStream stream = makeMixedStream(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        for (size_t i = 0; i + 1 < stream.offsets.size(); ++i) {
+            const uint8_t* data = stream.bytes.data() + stream.offsets[i];
+            CommandData command = parseHandWritten(data, stream.offsets[i + 1] - stream.offsets[i]);
+            benchmark::DoNotOptimize(command);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DecodeHandWrittenSwitch)->Arg(4096);
+
+static void BM_DecodeGenerated(benchmark::State& state) {
+    EncodedStream stream = makeMixedStream(static_cast<size_t>(state.range(0)));
+    DisplayProtocol protocol;
+    for (auto _ : state) {
+        for (size_t i = 0; i + 1 < stream.offsets.size(); ++i) {
+            const uint8_t* data = stream.bytes.data() + stream.offsets[i];
+            CommandData command = protocol.parseCommand(data, stream.offsets[i + 1] - stream.offsets[i]);
+            benchmark::DoNotOptimize(command);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DecodeGenerated)->Arg(4096);
+
+static void BM_EncodeGenerated(benchmark::State& state) {
+    EncodedStream stream = makeMixedStream(static_cast<size_t>(state.range(0)));
+    DisplayProtocol protocol;
+    std::vector<CommandData> commands;
+    for (size_t i = 0; i + 1 < stream.offsets.size(); ++i) {
+        commands.push_back(protocol.parseCommand(stream.bytes.data() + stream.offsets[i], stream.offsets[i + 1] - stream.offsets[i]));
+    }
+    std::vector<uint8_t> out(stream.bytes.size());
+    for (auto _ : state) {
+        uint8_t* data = out.data();
+        for (const CommandData& command : commands) {
+            data += encodeCommand(command, data);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EncodeGenerated)->Arg(4096);
+
+// state.range(0) FILL_RECTANGLE records back to back, as in a batch of one
+// opcode, decoded into CommandBuffer columns. Level -1 is the per-command
+// parser the batch decoder used for every record before.
+static void BM_DecodeRecords(benchmark::State& state, int level) {
+    if (level > detectRecordDecodeLevel()) {
+        state.SkipWithError("not supported by this CPU");
+        return;
+    }
+    size_t count = static_cast<size_t>(state.range(0));
+    std::mt19937 random(99);
+    std::vector<uint8_t> records(count * GEOMETRY_RECORD_SIZE);
+    for (size_t i = 0; i < records.size(); ++i) {
+        records[i] = i % GEOMETRY_RECORD_SIZE == 0 ? static_cast<uint8_t>(FILL_RECTANGLE_OPCODE) : static_cast<uint8_t>(random());
+    }
+    DisplayProtocol protocol;
+    CommandBuffer buffer;
+    buffer.reserve(count);
+    RecordDecodeFunction kernel = level < 0 ? nullptr : recordDecodeKernel(static_cast<RecordDecodeLevel>(level));
+    for (auto _ : state) {
+        buffer.clear();
+        if (kernel) {
+            buffer.truncate(count);
+            kernel(records.data(), count, { buffer.x0.data(), buffer.y0.data(), buffer.x1.data(), buffer.y1.data(), buffer.color.data() });
+        }
+        else {
+            for (size_t i = 0; i < count; ++i) {
+                buffer.push(protocol.parseCommand(records.data() + i * GEOMETRY_RECORD_SIZE, GEOMETRY_RECORD_SIZE));
+            }
+        }
+        benchmark::DoNotOptimize(buffer.color.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+    state.SetBytesProcessed(state.iterations() * records.size());
+}
+BENCHMARK_CAPTURE(BM_DecodeRecords, Parser, -1)->Arg(256)->Arg(4096);
+BENCHMARK_CAPTURE(BM_DecodeRecords, Scalar, SCALAR_RECORD_DECODE)->Arg(256)->Arg(4096);
+BENCHMARK_CAPTURE(BM_DecodeRecords, SSSE3, SSSE3_RECORD_DECODE)->Arg(256)->Arg(4096);
+BENCHMARK_CAPTURE(BM_DecodeRecords, AVX2, AVX2_RECORD_DECODE)->Arg(256)->Arg(4096);
+
+// One batch datagram of 256 records of one opcode through parseBatch, with
+// the runs decoded by the detected kernel.
+static void BM_DecodeHomogeneousBatch(benchmark::State& state) {
+    std::vector<CommandData> commands(256);
+    std::mt19937 random(5);
+    for (CommandData& command : commands) {
+        command.opcode = DRAW_LINE_OPCODE;
+        command.drawLine = { static_cast<int16_t>(random() % 1280), static_cast<int16_t>(random() % 720),
+            static_cast<int16_t>(random() % 1280), static_cast<int16_t>(random() % 720), static_cast<uint16_t>(random()) };
+    }
+    std::vector<uint8_t> batch;
+    encodeBatch(commands, batch);
+    DisplayProtocol protocol;
+    CommandBuffer buffer;
+    buffer.reserve(commands.size());
+    for (auto _ : state) {
+        buffer.clear();
+        protocol.parseBatch(batch, buffer);
+        benchmark::DoNotOptimize(buffer.color.data());
+    }
+    state.SetItemsProcessed(state.iterations() * commands.size());
+    state.SetLabel(recordDecodeLevelName(activeRecordDecodeLevel()));
+}
+BENCHMARK(BM_DecodeHomogeneousBatch);
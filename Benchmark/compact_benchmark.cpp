@@ -0,0 +1,154 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../display_protocol/display_protocol.h"
+#include "benchmark_support.h"
+
+const size_t TRACE_BATCH_COMMANDS = 256;
+
+// A redraw of a 1280x720 widget UI: each widget is a filled background, a
+// border, a few runs of glyph pixels and an occasional separator line,
+// drawn from a five-color palette. Consecutive commands stay close to each
+// other, which is what the compact encoding's deltas are for.
+static std::vector<CommandData> makeUiTrace() {
+    std::mt19937 random(1234);
+    const uint16_t palette[] = { 0xFFFF, 0x0000, 0x39E7, 0x041F, 0xF800 };
+    std::uniform_int_distribution<int> text(1, 4);
+    std::vector<CommandData> commands;
+    commands.reserve(workloadSize());
+    int16_t left = 0;
+    int16_t top = 0;
+    while (commands.size() < workloadSize()) {
+        CommandData command;
+        uint16_t background = palette[random() % 3];
+        command.opcode = FILL_RECTANGLE_OPCODE;
+        command.fillRectangle = { left, top, 120, 24, background };
+        commands.push_back(command);
+        command.opcode = DRAW_RECTANGLE_OPCODE;
+        command.drawRectangle = { left, top, 120, 24, palette[1] };
+        commands.push_back(command);
+        int16_t x = static_cast<int16_t>(left + 4);
+        for (int glyph = text(random) * 4; glyph > 0; --glyph) {
+            command.opcode = DRAW_PIXEL_OPCODE;
+            command.drawPixel = { x, static_cast<int16_t>(top + 8 + random() % 8), palette[3 + random() % 2] };
+            commands.push_back(command);
+            x = static_cast<int16_t>(x + 1 + random() % 3);
+        }
+        if (random() % 4 == 0) {
+            command.opcode = DRAW_LINE_OPCODE;
+            command.drawLine = { left, static_cast<int16_t>(top + 23), static_cast<int16_t>(left + 119), static_cast<int16_t>(top + 23), palette[2] };
+            commands.push_back(command);
+        }
+        left = static_cast<int16_t>(left + 128);
+        if (left + 120 > 1280) {
+            left = 0;
+            top = static_cast<int16_t>(top + 32 < 720 ? top + 32 : 0);
+        }
+    }
+    commands.resize(workloadSize());
+    return commands;
+}
+
+// Uniformly random shapes and colors: the compact encoding's worst
+// realistic case.
+static std::vector<CommandData> makeRandomTrace() {
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<int> opcodes(DRAW_PIXEL_OPCODE, FILL_ELLIPSE_OPCODE);
+    std::uniform_int_distribution<int> x(0, 1279);
+    std::uniform_int_distribution<int> y(0, 719);
+    std::uniform_int_distribution<int> extent(1, 32);
+    std::vector<CommandData> commands(workloadSize());
+    for (CommandData& command : commands) {
+        command.opcode = static_cast<CommandOpcode>(opcodes(random));
+        int16_t left = static_cast<int16_t>(x(random));
+        int16_t top = static_cast<int16_t>(y(random));
+        uint16_t color = static_cast<uint16_t>(random());
+        if (command.opcode == DRAW_PIXEL_OPCODE) {
+            command.drawPixel = { left, top, color };
+        }
+        else if (command.opcode == DRAW_LINE_OPCODE) {
+            command.drawLine = { left, top, static_cast<int16_t>(left + extent(random)), static_cast<int16_t>(top + extent(random)), color };
+        }
+        else {
+            command.fillRectangle = { left, top, static_cast<int16_t>(extent(random)), static_cast<int16_t>(extent(random)), color };
+        }
+    }
+    return commands;
+}
+
+enum TraceKind { UI_TRACE, RANDOM_TRACE };
+
+// Splits the trace into datagrams of TRACE_BATCH_COMMANDS commands in the
+// v1 batch format or the compact one.
+static std::vector<std::vector<uint8_t>> encodeTrace(TraceKind kind, bool compact, size_t& commandCount) {
+    std::vector<CommandData> commands = kind == UI_TRACE ? makeUiTrace() : makeRandomTrace();
+    commandCount = commands.size();
+    std::vector<std::vector<uint8_t>> datagrams;
+    for (size_t start = 0; start < commands.size(); start += TRACE_BATCH_COMMANDS) {
+        size_t end = std::min(commands.size(), start + TRACE_BATCH_COMMANDS);
+        std::vector<CommandData> batch(commands.begin() + start, commands.begin() + end);
+        datagrams.emplace_back();
+        if (compact) {
+            encodeCompactBatch(batch, static_cast<uint32_t>(datagrams.size()), datagrams.back());
+        }
+        else {
+            encodeBatch(batch, datagrams.back());
+        }
+    }
+    return datagrams;
+}
+
+static void BM_DecodeTrace(benchmark::State& state, TraceKind kind, bool compact) {
+    size_t commands = 0;
+    std::vector<std::vector<uint8_t>> datagrams = encodeTrace(kind, compact, commands);
+    size_t bytes = 0;
+    for (const std::vector<uint8_t>& datagram : datagrams) {
+        bytes += datagram.size();
+    }
+    DisplayProtocol protocol;
+    CommandBuffer buffer;
+    buffer.reserve(TRACE_BATCH_COMMANDS);
+    for (auto _ : state) {
+        for (const std::vector<uint8_t>& datagram : datagrams) {
+            buffer.clear();
+            if (compact) {
+                protocol.parseCompactBatch(datagram, buffer);
+            }
+            else {
+                protocol.parseBatch(datagram, buffer);
+            }
+            benchmark::DoNotOptimize(buffer.opcode.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * commands);
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.counters["bytes/cmd"] = commands ? static_cast<double>(bytes) / commands : 0.0;
+}
+BENCHMARK_CAPTURE(BM_DecodeTrace, UiV1, UI_TRACE, false);
+BENCHMARK_CAPTURE(BM_DecodeTrace, UiCompact, UI_TRACE, true);
+BENCHMARK_CAPTURE(BM_DecodeTrace, RandomV1, RANDOM_TRACE, false);
+BENCHMARK_CAPTURE(BM_DecodeTrace, RandomCompact, RANDOM_TRACE, true);
+
+// Sender side: how much the compact encoder costs over the v1 one.
+static void BM_EncodeTrace(benchmark::State& state, bool compact) {
+    std::vector<CommandData> commands = makeUiTrace();
+    std::vector<uint8_t> datagram;
+    datagram.reserve(TRACE_BATCH_COMMANDS * 11 + 16);
+    for (auto _ : state) {
+        for (size_t start = 0; start < commands.size(); start += TRACE_BATCH_COMMANDS) {
+            size_t end = std::min(commands.size(), start + TRACE_BATCH_COMMANDS);
+            std::vector<CommandData> batch(commands.begin() + start, commands.begin() + end);
+            if (compact) {
+                encodeCompactBatch(batch, 0, datagram);
+            }
+            else {
+                encodeBatch(batch, datagram);
+            }
+            benchmark::DoNotOptimize(datagram.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * commands.size());
+}
+BENCHMARK_CAPTURE(BM_EncodeTrace, UiV1, false);
+BENCHMARK_CAPTURE(BM_EncodeTrace, UiCompact, true);
@@ -0,0 +1,62 @@
+// Benchmark driver. Besides the Google Benchmark flags it accepts
+// --workload=N to size the synthetic command streams. For machine-readable
+// results use --benchmark_format=json or --benchmark_out=FILE.
+//
+// Headless Linux build: g++ -std=c++17 -O2 -pthread *.cpp -lbenchmark -o display_benchmark
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "benchmark_support.h"
+
+static size_t workload = 4096;
+static std::atomic<uint64_t> allocations{ 0 };
+
+size_t workloadSize() {
+    return workload;
+}
+
+uint64_t allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+int main(int argc, char** argv) {
+    int kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--workload=", 11) == 0) {
+            long value = std::strtol(argv[i] + 11, nullptr, 10);
+            if (value > 0) {
+                workload = static_cast<size_t>(value);
+            }
+        }
+        else {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../display_protocol/display_protocol.h"
+#include "../display_protocol/rasterizer.h"
+#include "benchmark_support.h"
+
+// workloadSize() random commands on a 1280x720 surface. A negative opcode
+// mixes every drawing opcode; full-screen clears would dominate a mixed
+// stream, so they are only measured on their own. Extents stay small so
+// execution cost does not dwarf decoding.
+static std::vector<CommandData> makeWorkload(int opcode) {
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<int> opcodes(DRAW_PIXEL_OPCODE, FILL_ELLIPSE_OPCODE);
+    std::uniform_int_distribution<int> x(0, 1279);
+    std::uniform_int_distribution<int> y(0, 719);
+    std::uniform_int_distribution<int> extent(1, 32);
+    std::vector<CommandData> commands(workloadSize());
+    for (CommandData& command : commands) {
+        command.opcode = static_cast<CommandOpcode>(opcode < 0 ? opcodes(random) : opcode);
+        int16_t left = static_cast<int16_t>(x(random));
+        int16_t top = static_cast<int16_t>(y(random));
+        uint16_t color = static_cast<uint16_t>(random());
+        switch (command.opcode) {
+        case CLEAR_DISPLAY_OPCODE:
+            command.clearDisplay = { color };
+            break;
+        case DRAW_PIXEL_OPCODE:
+            command.drawPixel = { left, top, color };
+            break;
+        case DRAW_LINE_OPCODE:
+            command.drawLine = { left, top, static_cast<int16_t>(left + extent(random)), static_cast<int16_t>(top + extent(random)), color };
+            break;
+        default:
+            command.fillRectangle = { left, top, static_cast<int16_t>(extent(random)), static_cast<int16_t>(extent(random)), color };
+            break;
+        }
+    }
+    return commands;
+}
+
+// One datagram per command, as UDP.cpp sends them.
+static std::vector<std::vector<uint8_t>> encodeDatagrams(const std::vector<CommandData>& commands) {
+    std::vector<std::vector<uint8_t>> datagrams(commands.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+        appendCommand(commands[i], datagrams[i]);
+    }
+    return datagrams;
+}
+
+// Times pass() over the workload, then runs it once more untimed to count
+// the heap allocations one pass makes.
+template <typename Pass>
+static void runWorkload(benchmark::State& state, size_t commands, Pass pass) {
+    for (auto _ : state) {
+        pass();
+    }
+    uint64_t before = allocationCount();
+    pass();
+    uint64_t allocations = allocationCount() - before;
+    state.SetItemsProcessed(state.iterations() * commands);
+    state.counters["allocs/cmd"] = commands ? static_cast<double>(allocations) / commands : 0.0;
+    state.counters["commands"] = static_cast<double>(commands);
+}
+
+// Value API: CommandData straight from the bytes, no heap.
+static void BM_DecodeOpcode(benchmark::State& state, int opcode) {
+    std::vector<std::vector<uint8_t>> datagrams = encodeDatagrams(makeWorkload(opcode));
+    DisplayProtocol protocol;
+    runWorkload(state, datagrams.size(), [&] {
+        for (const std::vector<uint8_t>& datagram : datagrams) {
+            CommandData command = protocol.parseCommand(datagram.data(), datagram.size());
+            benchmark::DoNotOptimize(command);
+        }
+    });
+}
+BENCHMARK_CAPTURE(BM_DecodeOpcode, ClearDisplay, CLEAR_DISPLAY_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeOpcode, DrawPixel, DRAW_PIXEL_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeOpcode, DrawLine, DRAW_LINE_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeOpcode, DrawRectangle, DRAW_RECTANGLE_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeOpcode, FillRectangle, FILL_RECTANGLE_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeOpcode, DrawEllipse, DRAW_ELLIPSE_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeOpcode, FillEllipse, FILL_ELLIPSE_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeOpcode, Mixed, -1);
+
+// The original Command* API: one heap object per command.
+static void BM_DecodeLegacyObjects(benchmark::State& state, int opcode) {
+    std::vector<std::vector<uint8_t>> datagrams = encodeDatagrams(makeWorkload(opcode));
+    DisplayProtocol protocol;
+    runWorkload(state, datagrams.size(), [&] {
+        for (const std::vector<uint8_t>& datagram : datagrams) {
+            Command* command = nullptr;
+            protocol.parseCommand(datagram, command);
+            benchmark::DoNotOptimize(command);
+            delete command;
+        }
+    });
+}
+BENCHMARK_CAPTURE(BM_DecodeLegacyObjects, DrawPixel, DRAW_PIXEL_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeLegacyObjects, Mixed, -1);
+
+// The Command* API with the commands made in an arena that is reset once
+// per pass, as a server would at frame end.
+static void BM_DecodeArenaObjects(benchmark::State& state, int opcode) {
+    std::vector<std::vector<uint8_t>> datagrams = encodeDatagrams(makeWorkload(opcode));
+    DisplayProtocol protocol;
+    CommandArena arena;
+    runWorkload(state, datagrams.size(), [&] {
+        arena.reset();
+        for (const std::vector<uint8_t>& datagram : datagrams) {
+            Command* command = nullptr;
+            protocol.parseCommand(datagram, command, arena);
+            benchmark::DoNotOptimize(command);
+        }
+    });
+}
+BENCHMARK_CAPTURE(BM_DecodeArenaObjects, DrawPixel, DRAW_PIXEL_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeArenaObjects, Mixed, -1);
+
+// A flood of garbage: empty, unknown-opcode and truncated datagrams in
+// turn. Throwing is the exception API every caller used to go through;
+// Status is tryParseCommand.
+static void BM_RejectInvalid(benchmark::State& state, bool throwing) {
+    std::vector<std::vector<uint8_t>> datagrams = encodeDatagrams(makeWorkload(-1));
+    for (size_t i = 0; i < datagrams.size(); ++i) {
+        switch (i % 3) {
+        case 0:
+            datagrams[i].clear();
+            break;
+        case 1:
+            datagrams[i][0] = 0x63;
+            break;
+        default:
+            datagrams[i].pop_back();
+            break;
+        }
+    }
+    DisplayProtocol protocol;
+    size_t rejected = 0;
+    runWorkload(state, datagrams.size(), [&] {
+        for (const std::vector<uint8_t>& datagram : datagrams) {
+            if (throwing) {
+                try {
+                    benchmark::DoNotOptimize(protocol.parseCommand(datagram.data(), datagram.size()));
+                }
+                catch (const std::invalid_argument&) {
+                    ++rejected;
+                }
+            }
+            else {
+                CommandData command;
+                rejected += protocol.tryParseCommand(datagram.data(), datagram.size(), command) != PARSE_OK;
+            }
+        }
+    });
+    benchmark::DoNotOptimize(rejected);
+}
+BENCHMARK_CAPTURE(BM_RejectInvalid, Throwing, true);
+BENCHMARK_CAPTURE(BM_RejectInvalid, Status, false);
+
+// The workload packed into batch datagrams of up to 256 commands each,
+// decoded into a reused CommandBuffer.
+static void BM_DecodeBatch(benchmark::State& state) {
+    const size_t BATCH_COMMANDS = 256;
+    std::vector<CommandData> commands = makeWorkload(-1);
+    std::vector<std::vector<uint8_t>> datagrams;
+    size_t bytes = 0;
+    for (size_t start = 0; start < commands.size(); start += BATCH_COMMANDS) {
+        size_t end = std::min(commands.size(), start + BATCH_COMMANDS);
+        datagrams.emplace_back();
+        encodeBatch(std::vector<CommandData>(commands.begin() + start, commands.begin() + end), datagrams.back());
+        bytes += datagrams.back().size();
+    }
+    DisplayProtocol protocol;
+    CommandBuffer buffer;
+    buffer.reserve(BATCH_COMMANDS);
+    runWorkload(state, commands.size(), [&] {
+        for (const std::vector<uint8_t>& datagram : datagrams) {
+            buffer.clear();
+            protocol.parseBatch(datagram, buffer);
+            benchmark::DoNotOptimize(buffer.size());
+        }
+    });
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_DecodeBatch);
+
+// Datagram bytes to pixels, the server's per-packet path.
+static void BM_DecodeExecute(benchmark::State& state, int opcode) {
+    std::vector<std::vector<uint8_t>> datagrams = encodeDatagrams(makeWorkload(opcode));
+    DisplayProtocol protocol;
+    Framebuffer framebuffer(1280, 720);
+    Rasterizer rasterizer(framebuffer);
+    runWorkload(state, datagrams.size(), [&] {
+        for (const std::vector<uint8_t>& datagram : datagrams) {
+            rasterizer.execute(protocol.parseCommand(datagram.data(), datagram.size()));
+        }
+        benchmark::DoNotOptimize(framebuffer.data());
+    });
+}
+BENCHMARK_CAPTURE(BM_DecodeExecute, DrawPixel, DRAW_PIXEL_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeExecute, FillRectangle, FILL_RECTANGLE_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeExecute, FillEllipse, FILL_ELLIPSE_OPCODE);
+BENCHMARK_CAPTURE(BM_DecodeExecute, Mixed, -1);
@@ -0,0 +1,162 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include "../display_protocol/rasterizer.h"
+#include "../display_protocol/frame_chain.h"
+
+// Random commands of one opcode with coordinates spread over a 1280x720
+// surface and extents up to maxExtent pixels.
+static std::vector<CommandData> makeCommands(CommandOpcode opcode, size_t count, int maxExtent) {
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> x(0, 1279);
+    std::uniform_int_distribution<int> y(0, 719);
+    std::uniform_int_distribution<int> extent(1, maxExtent);
+    std::vector<CommandData> commands(count);
+    for (CommandData& command : commands) {
+        command.opcode = opcode;
+        command.drawLine = { static_cast<int16_t>(x(random)), static_cast<int16_t>(y(random)),
+            static_cast<int16_t>(extent(random)), static_cast<int16_t>(extent(random)), static_cast<uint16_t>(random()) };
+        if (opcode == DRAW_LINE_OPCODE) {
+            command.drawLine.x1 = static_cast<int16_t>(x(random));
+            command.drawLine.y1 = static_cast<int16_t>(y(random));
+        }
+    }
+    return commands;
+}
+
+static void BM_Rasterize(benchmark::State& state, CommandOpcode opcode) {
+    const size_t count = 10000;
+    std::vector<CommandData> commands = makeCommands(opcode, count, static_cast<int>(state.range(0)));
+    Framebuffer framebuffer(1280, 720);
+    Rasterizer rasterizer(framebuffer);
+    for (auto _ : state) {
+        for (const CommandData& command : commands) {
+            rasterizer.execute(command);
+        }
+        benchmark::DoNotOptimize(framebuffer.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK_CAPTURE(BM_Rasterize, DrawPixel, DRAW_PIXEL_OPCODE)->Arg(1);
+BENCHMARK_CAPTURE(BM_Rasterize, DrawLine, DRAW_LINE_OPCODE)->Arg(1);
+BENCHMARK_CAPTURE(BM_Rasterize, DrawRectangle, DRAW_RECTANGLE_OPCODE)->Arg(16)->Arg(64);
+BENCHMARK_CAPTURE(BM_Rasterize, FillRectangle, FILL_RECTANGLE_OPCODE)->Arg(16)->Arg(64);
+BENCHMARK_CAPTURE(BM_Rasterize, DrawEllipse, DRAW_ELLIPSE_OPCODE)->Arg(16)->Arg(64);
+BENCHMARK_CAPTURE(BM_Rasterize, FillEllipse, FILL_ELLIPSE_OPCODE)->Arg(16)->Arg(64);
+
+static void BM_ClearDisplay(benchmark::State& state) {
+    Framebuffer framebuffer(1280, 720);
+    Rasterizer rasterizer(framebuffer);
+    for (auto _ : state) {
+        rasterizer.clearDisplay(0x1234);
+        benchmark::DoNotOptimize(framebuffer.data());
+    }
+    state.SetBytesProcessed(state.iterations() * 1280 * 720 * 2);
+}
+BENCHMARK(BM_ClearDisplay);
+
+// Frames of range(0) small fills, rendered straight into one framebuffer
+// (torn while drawing), presented through FrameChain, presented by copying
+// the whole finished frame to a second buffer, and presented through a
+// FrameChain exported to shared memory with a reader taking every frame in
+// place, as an external consumer would.
+static void BM_PresentFrame(benchmark::State& state, int mode) {
+    const size_t perFrame = static_cast<size_t>(state.range(0));
+    std::vector<CommandData> commands = makeCommands(FILL_RECTANGLE_OPCODE, perFrame * 64, 16);
+    Framebuffer framebuffer(1280, 720);
+    Framebuffer shown(1280, 720);
+    Rasterizer rasterizer(framebuffer);
+    std::vector<uint64_t> memory(frameExportSize(1280, 720) / sizeof(uint64_t));
+    FrameExportWriter writer(memory.data(), memory.size() * sizeof(uint64_t), 1280, 720);
+    FrameExportReader reader(memory.data(), memory.size() * sizeof(uint64_t));
+    FrameChain frames(1280, 720, mode == 3 ? &writer : nullptr);
+    size_t next = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < perFrame; ++i, next = (next + 1) % commands.size()) {
+            if (mode == 1 || mode == 3) {
+                frames.execute(commands[next]);
+            }
+            else {
+                rasterizer.execute(commands[next]);
+            }
+        }
+        if (mode == 1) {
+            frames.present();
+            frames.acquire();
+            benchmark::DoNotOptimize(frames.frontBuffer().data());
+        }
+        else if (mode == 3) {
+            frames.present();
+            reader.read([](const Framebuffer& frame, const Rect& damage) {
+                benchmark::DoNotOptimize(frame.row(damage.top));
+            });
+        }
+        else if (mode == 2) {
+            std::copy(framebuffer.data(), framebuffer.data() + 1280 * 720, shown.data());
+            benchmark::DoNotOptimize(shown.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * perFrame);
+}
+BENCHMARK_CAPTURE(BM_PresentFrame, Unbuffered, 0)->Arg(16)->Arg(256);
+BENCHMARK_CAPTURE(BM_PresentFrame, FrameChain, 1)->Arg(16)->Arg(256);
+BENCHMARK_CAPTURE(BM_PresentFrame, FullCopy, 2)->Arg(16)->Arg(256);
+BENCHMARK_CAPTURE(BM_PresentFrame, SharedExport, 3)->Arg(16)->Arg(256);
+
+// Ellipses cycling through range(0) radius pairs between 3 and 33 pixels,
+// the way status dots and gauges repeat, drawn with the default cache and
+// with caching disabled. With more pairs than the cache holds every lookup
+// misses, which shows what the bookkeeping costs.
+static void BM_EllipseCache(benchmark::State& state, CommandOpcode opcode, bool cached) {
+    std::vector<CommandData> commands = makeCommands(opcode, 10000, 24);
+    size_t radii = static_cast<size_t>(state.range(0));
+    for (size_t i = 0; i < commands.size(); ++i) {
+        size_t pair = i % radii;
+        commands[i].drawEllipse.rx = static_cast<int16_t>(3 + pair % 16 * 2);
+        commands[i].drawEllipse.ry = static_cast<int16_t>(3 + pair / 16 % 16 * 2);
+    }
+    Framebuffer framebuffer(1280, 720);
+    Rasterizer rasterizer(framebuffer);
+    EllipseSpanCache noCache(0);
+    if (!cached) {
+        rasterizer.setEllipseCache(&noCache);
+    }
+    for (auto _ : state) {
+        for (const CommandData& command : commands) {
+            rasterizer.execute(command);
+        }
+        benchmark::DoNotOptimize(framebuffer.data());
+    }
+    state.SetItemsProcessed(state.iterations() * commands.size());
+    state.counters["hit rate"] = rasterizer.ellipseCache().hitRate();
+}
+BENCHMARK_CAPTURE(BM_EllipseCache, DrawCached, DRAW_ELLIPSE_OPCODE, true)->Arg(4)->Arg(256);
+BENCHMARK_CAPTURE(BM_EllipseCache, DrawUncached, DRAW_ELLIPSE_OPCODE, false)->Arg(4)->Arg(256);
+BENCHMARK_CAPTURE(BM_EllipseCache, FillCached, FILL_ELLIPSE_OPCODE, true)->Arg(4)->Arg(256);
+BENCHMARK_CAPTURE(BM_EllipseCache, FillUncached, FILL_ELLIPSE_OPCODE, false)->Arg(4)->Arg(256);
+
+// Commands from a sender that does not clip: lines spanning the whole int16
+// range, shapes far off the surface, and fills with negative extents. The
+// clip stage rejects or trims them before any per-pixel work.
+static void BM_OffscreenCommands(benchmark::State& state, CommandOpcode opcode) {
+    std::mt19937 random(11);
+    std::uniform_int_distribution<int> coordinate(-20000, 20000);
+    std::vector<CommandData> commands(10000);
+    for (CommandData& command : commands) {
+        command.opcode = opcode;
+        command.drawLine = { static_cast<int16_t>(coordinate(random)), static_cast<int16_t>(coordinate(random)),
+            static_cast<int16_t>(coordinate(random)), static_cast<int16_t>(coordinate(random)), static_cast<uint16_t>(random()) };
+    }
+    Framebuffer framebuffer(1280, 720);
+    Rasterizer rasterizer(framebuffer);
+    for (auto _ : state) {
+        for (const CommandData& command : commands) {
+            rasterizer.execute(command);
+        }
+        benchmark::DoNotOptimize(framebuffer.data());
+    }
+    state.SetItemsProcessed(state.iterations() * commands.size());
+}
+BENCHMARK_CAPTURE(BM_OffscreenCommands, DrawLine, DRAW_LINE_OPCODE);
+BENCHMARK_CAPTURE(BM_OffscreenCommands, FillRectangle, FILL_RECTANGLE_OPCODE);
+BENCHMARK_CAPTURE(BM_OffscreenCommands, DrawEllipse, DRAW_ELLIPSE_OPCODE);
@@ -0,0 +1,98 @@
+#include <benchmark/benchmark.h>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include "../display_protocol/spsc_ring.h"
+#include "../display_protocol/command.h"
+
+// The straightforward alternative: std::queue behind a mutex and a condvar.
+class MutexQueue {
+public:
+    void push(const CommandData& command) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            items.push(command);
+        }
+        ready.notify_one();
+    }
+
+    size_t pop(CommandData* out, size_t count) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [&] { return !items.empty(); });
+        size_t popped = 0;
+        while (popped < count && !items.empty()) {
+            out[popped++] = items.front();
+            items.pop();
+        }
+        return popped;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::queue<CommandData> items;
+};
+
+static const size_t COMMANDS_PER_ITERATION = 1 << 16;
+
+template <typename Queue>
+static void transfer(Queue& queue, size_t batch) {
+    std::thread producer([&] {
+        CommandData command;
+        command.opcode = DRAW_PIXEL_OPCODE;
+        command.drawPixel = { 1, 2, 0xF800 };
+        for (size_t i = 0; i < COMMANDS_PER_ITERATION; ++i) {
+            queue.push(command);
+        }
+    });
+    std::vector<CommandData> out(batch);
+    size_t received = 0;
+    while (received < COMMANDS_PER_ITERATION) {
+        received += queue.pop(out.data(), batch);
+    }
+    producer.join();
+}
+
+static void BM_MutexQueueTransfer(benchmark::State& state) {
+    MutexQueue queue;
+    for (auto _ : state) {
+        transfer(queue, static_cast<size_t>(state.range(0)));
+    }
+    state.SetItemsProcessed(state.iterations() * COMMANDS_PER_ITERATION);
+}
+BENCHMARK(BM_MutexQueueTransfer)->Arg(1)->Arg(64)->UseRealTime();
+
+static void BM_SpscRingTransfer(benchmark::State& state) {
+    SpscRing<CommandData> ring(4096);
+    for (auto _ : state) {
+        transfer(ring, static_cast<size_t>(state.range(0)));
+    }
+    state.SetItemsProcessed(state.iterations() * COMMANDS_PER_ITERATION);
+}
+BENCHMARK(BM_SpscRingTransfer)->Arg(1)->Arg(64)->UseRealTime();
+
+// Round trip of a single command: the latency a render thread adds when
+// it is parked waiting for work.
+static void BM_SpscRingPingPong(benchmark::State& state) {
+    SpscRing<CommandData> request(64);
+    SpscRing<CommandData> reply(64);
+    std::atomic<bool> stop{ false };
+    std::thread echo([&] {
+        CommandData command;
+        while (request.popUntilWoken(&command, 1, stop) == 1) {
+            reply.push(command);
+        }
+    });
+    CommandData command;
+    command.opcode = CLEAR_DISPLAY_OPCODE;
+    command.clearDisplay = { 0 };
+    for (auto _ : state) {
+        request.push(command);
+        reply.pop(&command, 1);
+    }
+    stop = true;
+    request.wake();
+    echo.join();
+}
+BENCHMARK(BM_SpscRingPingPong)->UseRealTime();
@@ -0,0 +1,117 @@
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <vector>
+#include "../display_protocol/scene_encoder.h"
+
+// A scripted 800x480 dashboard: four round gauges (face, rim, twelve ticks,
+// needle, hub), eight bar graphs, sixteen status lights and a 60-segment
+// trend line. In update n the needles move, two bars change, a light
+// toggles every tenth update and the trend line scrolls every thirtieth.
+static const int DASHBOARD_WIDTH = 800;
+static const int DASHBOARD_HEIGHT = 480;
+
+static CommandData shape(CommandOpcode opcode, int a, int b, int c, int d, uint16_t color) {
+    CommandData command;
+    command.opcode = opcode;
+    command.drawLine = { static_cast<int16_t>(a), static_cast<int16_t>(b), static_cast<int16_t>(c), static_cast<int16_t>(d), color };
+    return command;
+}
+
+static std::vector<CommandData> dashboard(int update) {
+    std::vector<CommandData> scene;
+    CommandData clear;
+    clear.opcode = CLEAR_DISPLAY_OPCODE;
+    clear.clearDisplay = { 0x0000 };
+    scene.push_back(clear);
+    const double pi = 3.14159265358979;
+    for (int gauge = 0; gauge < 4; ++gauge) {
+        int cx = 100 + gauge * 200;
+        int cy = 110;
+        scene.push_back(shape(FILL_ELLIPSE_OPCODE, cx, cy, 80, 80, 0x2104));
+        scene.push_back(shape(DRAW_ELLIPSE_OPCODE, cx, cy, 80, 80, 0xFFFF));
+        for (int tick = 0; tick < 12; ++tick) {
+            double angle = pi * 0.75 + tick * pi * 1.5 / 11;
+            scene.push_back(shape(DRAW_LINE_OPCODE, cx + static_cast<int>(std::lround(70 * std::cos(angle))), cy + static_cast<int>(std::lround(70 * std::sin(angle))),
+                cx + static_cast<int>(std::lround(78 * std::cos(angle))), cy + static_cast<int>(std::lround(78 * std::sin(angle))), 0xFFFF));
+        }
+        double value = 0.5 + 0.45 * std::sin(update * 0.05 * (gauge + 1));
+        double angle = pi * 0.75 + value * pi * 1.5;
+        scene.push_back(shape(DRAW_LINE_OPCODE, cx, cy, cx + static_cast<int>(std::lround(65 * std::cos(angle))),
+            cy + static_cast<int>(std::lround(65 * std::sin(angle))), 0xF800));
+        scene.push_back(shape(FILL_ELLIPSE_OPCODE, cx, cy, 6, 6, 0xFFFF));
+    }
+    for (int bar = 0; bar < 8; ++bar) {
+        int x = 20 + bar * 50;
+        int level = 100;
+        if (bar == update % 8 || bar == (update * 3 + 1) % 8) {
+            level = 20 + (update * 37 + bar * 11) % 160;
+        }
+        scene.push_back(shape(DRAW_RECTANGLE_OPCODE, x, 240, 30, 180, 0x8410));
+        scene.push_back(shape(FILL_RECTANGLE_OPCODE, x + 2, 418 - level, 26, level, 0x07E0));
+    }
+    for (int light = 0; light < 16; ++light) {
+        bool on = ((light + update / 10) % 3) == 0;
+        scene.push_back(shape(FILL_ELLIPSE_OPCODE, 440 + (light % 4) * 30, 250 + (light / 4) * 30, 10, 10, on ? 0xFFE0 : 0x4208));
+    }
+    for (int segment = 0; segment < 60; ++segment) {
+        int t = segment + update / 30;
+        scene.push_back(shape(DRAW_LINE_OPCODE, 580 + segment * 3, 400 - (t * 17 % 60), 583 + segment * 3, 400 - ((t + 1) * 17 % 60), 0x07FF));
+    }
+    return scene;
+}
+
+// Bytes and datagrams per update: the whole scene as one datagram per
+// command (as UDP.cpp sends), the whole scene in compact batches, and the
+// SceneEncoder update in compact batches. The timed part is the encoder.
+static void BM_DashboardUpdate(benchmark::State& state) {
+    const size_t MAX_DATAGRAM = 1400;
+    const int UPDATES = 300;
+    std::vector<std::vector<CommandData>> scenes;
+    for (int update = 0; update < UPDATES; ++update) {
+        scenes.push_back(dashboard(update));
+    }
+
+    double perCommandBytes = 0;
+    double perCommandDatagrams = 0;
+    double fullBytes = 0;
+    double fullDatagrams = 0;
+    double diffBytes = 0;
+    double diffDatagrams = 0;
+    uint32_t sequence = 0;
+    std::vector<std::vector<uint8_t>> datagrams;
+    SceneEncoder encoder(DASHBOARD_WIDTH, DASHBOARD_HEIGHT);
+    for (const std::vector<CommandData>& scene : scenes) {
+        for (const CommandData& command : scene) {
+            perCommandBytes += commandSize(static_cast<uint8_t>(command.opcode));
+        }
+        perCommandDatagrams += scene.size();
+        packCompactBatches(scene, sequence, MAX_DATAGRAM, datagrams);
+        fullDatagrams += datagrams.size();
+        for (const std::vector<uint8_t>& datagram : datagrams) {
+            fullBytes += datagram.size();
+        }
+        packCompactBatches(encoder.update(scene), sequence, MAX_DATAGRAM, datagrams);
+        diffDatagrams += datagrams.size();
+        for (const std::vector<uint8_t>& datagram : datagrams) {
+            diffBytes += datagram.size();
+        }
+    }
+
+    double fullUpdates = static_cast<double>(encoder.getFullUpdates());
+
+    size_t next = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(encoder.update(scenes[next]).data());
+        next = (next + 1) % scenes.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["scene_cmds"] = static_cast<double>(scenes[0].size());
+    state.counters["percmd_B"] = perCommandBytes / UPDATES;
+    state.counters["percmd_dgrams"] = perCommandDatagrams / UPDATES;
+    state.counters["full_B"] = fullBytes / UPDATES;
+    state.counters["full_dgrams"] = fullDatagrams / UPDATES;
+    state.counters["diff_B"] = diffBytes / UPDATES;
+    state.counters["diff_dgrams"] = diffDatagrams / UPDATES;
+    state.counters["full_updates"] = fullUpdates;
+}
+BENCHMARK(BM_DashboardUpdate);
@@ -0,0 +1,25 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "../display_protocol/span_fill.h"
+
+// One span of state.range(0) pixels per iteration, starting one pixel past
+// a cache line so every kernel pays for its unaligned head.
+static void BM_FillSpan(benchmark::State& state, SpanFillLevel level) {
+    if (level > detectSpanFillLevel()) {
+        state.SkipWithError("not supported by this CPU");
+        return;
+    }
+    SpanFillFunction kernel = spanFillKernel(level);
+    size_t count = static_cast<size_t>(state.range(0));
+    std::vector<uint16_t> memory(count + 64);
+    uint16_t* dst = memory.data() + 1;
+    for (auto _ : state) {
+        kernel(dst, count, 0x5A5A);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * count * 2);
+}
+BENCHMARK_CAPTURE(BM_FillSpan, Scalar, SCALAR_SPAN_FILL)->RangeMultiplier(4)->Range(8, 1 << 21);
+BENCHMARK_CAPTURE(BM_FillSpan, SSE2, SSE2_SPAN_FILL)->RangeMultiplier(4)->Range(8, 1 << 21);
+BENCHMARK_CAPTURE(BM_FillSpan, AVX2, AVX2_SPAN_FILL)->RangeMultiplier(4)->Range(8, 1 << 21);
+BENCHMARK_CAPTURE(BM_FillSpan, AVX512, AVX512_SPAN_FILL)->RangeMultiplier(4)->Range(8, 1 << 21);
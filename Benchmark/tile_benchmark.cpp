@@ -0,0 +1,58 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../display_protocol/tile_renderer.h"
+
+// A burst of filled rectangles and ellipses on a 4K surface.
+static std::vector<CommandData> makeFillBurst(size_t count) {
+    std::mt19937 random(11);
+    std::uniform_int_distribution<int> x(0, 3839);
+    std::uniform_int_distribution<int> y(0, 2159);
+    std::uniform_int_distribution<int> extent(8, 200);
+    std::vector<CommandData> commands(count);
+    for (size_t i = 0; i < count; ++i) {
+        commands[i].opcode = i % 2 ? FILL_ELLIPSE_OPCODE : FILL_RECTANGLE_OPCODE;
+        commands[i].fillRectangle = { static_cast<int16_t>(x(random)), static_cast<int16_t>(y(random)),
+            static_cast<int16_t>(extent(random)), static_cast<int16_t>(extent(random)), static_cast<uint16_t>(random()) };
+    }
+    return commands;
+}
+
+static void BM_SerialRender4K(benchmark::State& state) {
+    std::vector<CommandData> commands = makeFillBurst(20000);
+    Framebuffer framebuffer(3840, 2160);
+    Rasterizer rasterizer(framebuffer);
+    for (auto _ : state) {
+        for (const CommandData& command : commands) {
+            rasterizer.execute(command);
+        }
+        benchmark::DoNotOptimize(framebuffer.data());
+    }
+    state.SetItemsProcessed(state.iterations() * commands.size());
+}
+BENCHMARK(BM_SerialRender4K)->UseRealTime();
+
+// Scaling from 1 thread up to the number of hardware threads.
+static void BM_TiledRender4K(benchmark::State& state) {
+    std::vector<CommandData> commands = makeFillBurst(20000);
+    Framebuffer framebuffer(3840, 2160);
+    TileRenderer renderer(framebuffer, static_cast<size_t>(state.range(0)), static_cast<int>(state.range(1)));
+    for (auto _ : state) {
+        renderer.execute(commands);
+        benchmark::DoNotOptimize(framebuffer.data());
+    }
+    state.SetItemsProcessed(state.iterations() * commands.size());
+    state.counters["threads"] = static_cast<double>(state.range(0));
+}
+
+static void tiledArguments(benchmark::internal::Benchmark* benchmark) {
+    int hardware = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int threads = 1; threads < hardware; threads *= 2) {
+        benchmark->Args({ threads, 128 });
+    }
+    benchmark->Args({ hardware, 64 });
+    benchmark->Args({ hardware, 128 });
+    benchmark->Args({ hardware, 256 });
+}
+BENCHMARK(BM_TiledRender4K)->Apply(tiledArguments)->UseRealTime();
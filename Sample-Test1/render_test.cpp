@@ -0,0 +1,903 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <vector>
+#include <algorithm>
+#include "../display_protocol/rasterizer.h"
+#include "../display_protocol/tile_renderer.h"
+#include "../display_protocol/command_optimizer.h"
+#include "../display_protocol/frame_chain.h"
+#include "../display_protocol/scene_encoder.h"
+#include "../display_protocol/display_protocol.h"
+
+static size_t countColor(const Framebuffer& framebuffer, uint16_t color) {
+    size_t count = 0;
+    for (int y = 0; y < framebuffer.getHeight(); ++y) {
+        for (int x = 0; x < framebuffer.getWidth(); ++x) {
+            count += framebuffer.pixel(x, y) == color;
+        }
+    }
+    return count;
+}
+
+TEST(RasterizerTest, ClearDisplay) {
+    Framebuffer framebuffer(16, 8);
+    Rasterizer rasterizer(framebuffer);
+
+    rasterizer.clearDisplay(0xF800);
+    EXPECT_EQ(countColor(framebuffer, 0xF800), 16u * 8u);
+}
+
+TEST(RasterizerTest, ClearDisplayWithStride) {
+    std::vector<uint16_t> memory(20 * 4, 0x1234);
+    Framebuffer framebuffer(16, 4, 20, memory.data());
+    Rasterizer rasterizer(framebuffer);
+
+    rasterizer.clearDisplay(0x0000);
+    EXPECT_EQ(countColor(framebuffer, 0x0000), 16u * 4u);
+    EXPECT_EQ(memory[16], 0x1234);
+}
+
+TEST(RasterizerTest, DrawPixelClipped) {
+    Framebuffer framebuffer(4, 4);
+    Rasterizer rasterizer(framebuffer);
+
+    rasterizer.drawPixel(3, 2, 0xFFFF);
+    rasterizer.drawPixel(-1, 2, 0xFFFF);
+    rasterizer.drawPixel(4, 0, 0xFFFF);
+    EXPECT_EQ(framebuffer.pixel(3, 2), 0xFFFF);
+    EXPECT_EQ(countColor(framebuffer, 0xFFFF), 1u);
+}
+
+TEST(RasterizerTest, DrawLineEndpointsAndClipping) {
+    Framebuffer framebuffer(10, 10);
+    Rasterizer rasterizer(framebuffer);
+
+    rasterizer.drawLine(1, 1, 8, 4, 0x07E0);
+    EXPECT_EQ(framebuffer.pixel(1, 1), 0x07E0);
+    EXPECT_EQ(framebuffer.pixel(8, 4), 0x07E0);
+    EXPECT_EQ(countColor(framebuffer, 0x07E0), 8u);
+
+    rasterizer.drawLine(-5, -5, 14, 14, 0x001F);
+    EXPECT_EQ(countColor(framebuffer, 0x001F), 10u);
+    EXPECT_EQ(framebuffer.pixel(9, 9), 0x001F);
+
+    rasterizer.drawLine(-100, 20, 100, 30, 0xFFFF);
+    EXPECT_EQ(countColor(framebuffer, 0xFFFF), 0u);
+}
+
+TEST(RasterizerTest, RectangleOutlineAndFill) {
+    Framebuffer framebuffer(10, 10);
+    Rasterizer rasterizer(framebuffer);
+
+    rasterizer.drawRectangle(2, 2, 4, 3, 0xAAAA);
+    EXPECT_EQ(countColor(framebuffer, 0xAAAA), 10u);
+    EXPECT_EQ(framebuffer.pixel(5, 4), 0xAAAA);
+    EXPECT_EQ(framebuffer.pixel(3, 3), 0x0000);
+
+    rasterizer.fillRectangle(-3, 7, 5, 10, 0x5555);
+    EXPECT_EQ(countColor(framebuffer, 0x5555), 2u * 3u);
+
+    rasterizer.fillRectangle(1, 1, -2, 5, 0x1111);
+    EXPECT_EQ(countColor(framebuffer, 0x1111), 0u);
+}
+
+TEST(RasterizerTest, EllipseOutlineWithinFill) {
+    Framebuffer outline(64, 64);
+    Framebuffer fill(64, 64);
+    Rasterizer outlineRasterizer(outline);
+    Rasterizer fillRasterizer(fill);
+
+    outlineRasterizer.drawEllipse(32, 32, 20, 10, 0xFFFF);
+    fillRasterizer.fillEllipse(32, 32, 20, 10, 0xFFFF);
+
+    EXPECT_EQ(outline.pixel(12, 32), 0xFFFF);
+    EXPECT_EQ(outline.pixel(52, 32), 0xFFFF);
+    EXPECT_EQ(outline.pixel(32, 22), 0xFFFF);
+    EXPECT_EQ(outline.pixel(32, 42), 0xFFFF);
+    EXPECT_EQ(outline.pixel(32, 32), 0x0000);
+    EXPECT_EQ(outline.pixel(52, 42), 0x0000);
+
+    for (int y = 0; y < 64; ++y) {
+        for (int x = 0; x < 64; ++x) {
+            if (outline.pixel(x, y) == 0xFFFF) {
+                EXPECT_EQ(fill.pixel(x, y), 0xFFFF);
+            }
+        }
+        // Filled rows are symmetric about the center column.
+        EXPECT_EQ(fill.pixel(31, y), fill.pixel(33, y));
+    }
+
+    size_t area = countColor(fill, 0xFFFF);
+    EXPECT_GT(area, 640u);
+    EXPECT_LT(area, 700u);
+}
+
+TEST(RasterizerTest, ExecuteParsedCommands) {
+    uint8_t byte_array[] = { BATCH_MARKER, 0x02, 0x00,
+        CLEAR_DISPLAY_OPCODE, 0x00, 0x1F,
+        FILL_RECTANGLE_OPCODE, 0x01, 0x00, 0x01, 0x00, 0x02, 0x00, 0x02, 0x00, 0xF8, 0x00 };
+    CommandBuffer buffer;
+    DisplayProtocol protocol;
+    protocol.parseBatch(byte_array, sizeof(byte_array), buffer);
+
+    Framebuffer framebuffer(4, 4);
+    Rasterizer rasterizer(framebuffer);
+    rasterizer.execute(buffer);
+
+    EXPECT_EQ(countColor(framebuffer, 0xF800), 4u);
+    EXPECT_EQ(countColor(framebuffer, 0x001F), 12u);
+    EXPECT_EQ(framebuffer.pixel(2, 2), 0xF800);
+}
+
+TEST(SpanFillTest, AllKernelsMatchScalar) {
+    for (int level = SCALAR_SPAN_FILL; level <= detectSpanFillLevel(); ++level) {
+        SpanFillFunction kernel = spanFillKernel(static_cast<SpanFillLevel>(level));
+        for (size_t offset = 0; offset < 40; ++offset) {
+            for (size_t count : { 0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 257 }) {
+                std::vector<uint16_t> memory(offset + count + 40, 0xDEAD);
+                kernel(memory.data() + offset, count, 0x1234);
+                for (size_t i = 0; i < memory.size(); ++i) {
+                    bool inside = i >= offset && i < offset + count;
+                    ASSERT_EQ(memory[i], inside ? 0x1234 : 0xDEAD) << spanFillLevelName(static_cast<SpanFillLevel>(level))
+                        << " offset " << offset << " count " << count << " index " << i;
+                }
+            }
+        }
+    }
+}
+
+TEST(SpanFillTest, StreamingFill) {
+    for (int level = SCALAR_SPAN_FILL; level <= detectSpanFillLevel(); ++level) {
+        SpanFillFunction kernel = spanFillKernel(static_cast<SpanFillLevel>(level));
+        size_t count = STREAMING_FILL_BYTES / 2 + 3;
+        std::vector<uint16_t> memory(count + 2, 0xDEAD);
+        kernel(memory.data() + 1, count, 0xBEEF);
+        EXPECT_EQ(memory.front(), 0xDEAD);
+        EXPECT_EQ(memory.back(), 0xDEAD);
+        EXPECT_EQ(static_cast<size_t>(std::count(memory.begin(), memory.end(), 0xBEEF)), count);
+    }
+}
+
+TEST(SpanFillTest, ForcedLevel) {
+    SpanFillLevel detected = detectSpanFillLevel();
+    EXPECT_TRUE(setSpanFillLevel(SCALAR_SPAN_FILL));
+    EXPECT_EQ(activeSpanFillLevel(), SCALAR_SPAN_FILL);
+    EXPECT_TRUE(setSpanFillLevel(detected));
+    EXPECT_EQ(activeSpanFillLevel(), detected);
+}
+
+// Random stream of every drawing opcode, partly off-screen, for comparing renderers.
+static std::vector<CommandData> randomCommands(size_t count, int width, int height, unsigned seed) {
+    std::vector<CommandData> commands(count);
+    uint32_t state = seed;
+    auto next = [&state](int range) {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<int>((state >> 8) % static_cast<uint32_t>(range));
+    };
+    for (CommandData& command : commands) {
+        command.opcode = static_cast<CommandOpcode>(next(FILL_ELLIPSE_OPCODE + 1));
+        if (command.opcode == CLEAR_DISPLAY_OPCODE && next(8) != 0) {
+            command.opcode = FILL_RECTANGLE_OPCODE;
+        }
+        int16_t x = static_cast<int16_t>(next(width + 40) - 20);
+        int16_t y = static_cast<int16_t>(next(height + 40) - 20);
+        command.drawLine = { x, y, static_cast<int16_t>(next(width / 2)), static_cast<int16_t>(next(height / 2)), static_cast<uint16_t>(next(0x10000)) };
+        if (command.opcode == CLEAR_DISPLAY_OPCODE) {
+            command.clearDisplay = { static_cast<uint16_t>(next(0x10000)) };
+        }
+        if (command.opcode == DRAW_PIXEL_OPCODE) {
+            command.drawPixel = { x, y, static_cast<uint16_t>(next(0x10000)) };
+        }
+    }
+    return commands;
+}
+
+TEST(TileRendererTest, MatchesSerialRendering) {
+    const int width = 203;
+    const int height = 117;
+    std::vector<CommandData> commands = randomCommands(2000, width, height, 1);
+
+    Framebuffer serial(width, height);
+    Rasterizer rasterizer(serial);
+    for (const CommandData& command : commands) {
+        rasterizer.execute(command);
+    }
+
+    for (size_t threads : { 1, 3, 4 }) {
+        for (int tileSize : { 16, 32, 64 }) {
+            Framebuffer tiled(width, height);
+            TileRenderer renderer(tiled, threads, tileSize);
+            renderer.execute(commands);
+            renderer.execute(commands);
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    ASSERT_EQ(tiled.pixel(x, y), serial.pixel(x, y)) << "threads " << threads << " tile " << tileSize << " at " << x << ", " << y;
+                }
+            }
+        }
+    }
+}
+
+TEST(TileRendererTest, ParallelForRunsEveryIndexOnce) {
+    WorkStealingPool pool(4);
+    for (int round = 0; round < 20; ++round) {
+        std::vector<std::atomic<int>> hits(1000);
+        pool.parallelFor(hits.size(), [&hits](size_t index, size_t) { ++hits[index]; });
+        for (const std::atomic<int>& hit : hits) {
+            ASSERT_EQ(hit.load(), 1);
+        }
+    }
+}
+
+TEST(DamageRegionTest, MergesOverlapsAndStaysBounded) {
+    DamageRegion damage({ 0, 0, 100, 100 }, 3);
+
+    damage.add({ 10, 10, 20, 20 });
+    damage.add({ 15, 15, 30, 30 });
+    ASSERT_EQ(damage.getRects().size(), 1u);
+    EXPECT_EQ(damage.area(), 20 * 20);
+
+    damage.add({ 50, 50, 51, 51 });
+    damage.add({ 90, 0, 100, 10 });
+    damage.add({ 52, 50, 53, 51 });
+    EXPECT_EQ(damage.getRects().size(), 3u);
+    EXPECT_EQ(damage.area(), 20 * 20 + 3 + 10 * 10);
+
+    damage.add({ -10, -10, 5, 5 });
+    damage.add({ 200, 200, 300, 300 });
+    EXPECT_LE(damage.getRects().size(), 3u);
+
+    std::vector<Rect> rects;
+    damage.take(rects);
+    EXPECT_TRUE(damage.empty());
+    for (size_t a = 0; a < rects.size(); ++a) {
+        for (size_t b = a + 1; b < rects.size(); ++b) {
+            EXPECT_FALSE(rects[a].intersects(rects[b]));
+        }
+    }
+}
+
+TEST(DamageRegionTest, FlushReproducesFrame) {
+    const int width = 160;
+    const int height = 100;
+    Framebuffer frame(width, height);
+    Framebuffer panel(width, height);
+    DamageRegion damage({ 0, 0, width, height }, 4);
+    Rasterizer rasterizer(frame);
+    rasterizer.setDamageRegion(&damage);
+
+    std::vector<CommandData> commands = randomCommands(300, width, height, 5);
+    std::vector<Rect> rects;
+    size_t flushed = 0;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        if (commands[i].opcode == CLEAR_DISPLAY_OPCODE) {
+            continue;
+        }
+        rasterizer.execute(commands[i]);
+        if (i % 10 == 9) {
+            damage.take(rects);
+            flushed += flushDamage(frame, panel, rects);
+        }
+    }
+    damage.take(rects);
+    flushed += flushDamage(frame, panel, rects);
+
+    EXPECT_TRUE(std::equal(frame.data(), frame.data() + width * height, panel.data()));
+    EXPECT_LT(flushed, 30u * width * height * sizeof(uint16_t));
+
+    rasterizer.clearDisplay(0x1234);
+    EXPECT_TRUE(damage.empty());
+    CommandData clear;
+    clear.opcode = CLEAR_DISPLAY_OPCODE;
+    clear.clearDisplay = { 0x4321 };
+    rasterizer.execute(clear);
+    EXPECT_EQ(damage.area(), width * height);
+}
+
+TEST(DamageRegionTest, TileRendererRecordsDamage) {
+    Framebuffer frame(128, 128);
+    DamageRegion damage({ 0, 0, 128, 128 });
+    TileRenderer renderer(frame, 2, 32);
+    renderer.setDamageRegion(&damage);
+
+    CommandData rectangle;
+    rectangle.opcode = FILL_RECTANGLE_OPCODE;
+    rectangle.fillRectangle = { 100, 100, 50, 50, 0xFFFF };
+    renderer.execute(std::vector<CommandData>{ rectangle });
+
+    ASSERT_EQ(damage.getRects().size(), 1u);
+    EXPECT_EQ(damage.getRects()[0].left, 100);
+    EXPECT_EQ(damage.getRects()[0].right, 128);
+    EXPECT_EQ(damage.area(), 28 * 28);
+}
+
+static void renderAll(Framebuffer& framebuffer, const std::vector<CommandData>& commands) {
+    Rasterizer rasterizer(framebuffer);
+    for (const CommandData& command : commands) {
+        rasterizer.execute(command);
+    }
+}
+
+TEST(CommandOptimizerTest, MergesPixelRunsAndLines) {
+    std::vector<CommandData> commands;
+    for (int x = 10; x < 20; ++x) {
+        CommandData pixel;
+        pixel.opcode = DRAW_PIXEL_OPCODE;
+        pixel.drawPixel = { static_cast<int16_t>(x), 5, 0xF800 };
+        commands.push_back(pixel);
+    }
+    for (int y = 7; y < 10; ++y) {
+        CommandData pixel;
+        pixel.opcode = DRAW_PIXEL_OPCODE;
+        pixel.drawPixel = { 3, static_cast<int16_t>(y), 0x07E0 };
+        commands.push_back(pixel);
+    }
+    CommandData line;
+    line.opcode = DRAW_LINE_OPCODE;
+    line.drawLine = { 30, 2, 4, 2, 0x001F };
+    commands.push_back(line);
+
+    CommandOptimizer optimizer({ 0, 0, 64, 64 });
+    const OptimizerStats& stats = optimizer.optimize(commands);
+
+    ASSERT_EQ(commands.size(), 3u);
+    EXPECT_EQ(stats.commandsIn, 14u);
+    EXPECT_EQ(stats.commandsMerged, 11u);
+    EXPECT_EQ(stats.linesConverted, 1u);
+    EXPECT_EQ(commands[0].opcode, FILL_RECTANGLE_OPCODE);
+    EXPECT_EQ(commands[0].fillRectangle.width, 10);
+    EXPECT_EQ(commands[1].fillRectangle.height, 3);
+    EXPECT_EQ(commands[2].fillRectangle.x, 4);
+    EXPECT_EQ(commands[2].fillRectangle.width, 27);
+}
+
+TEST(CommandOptimizerTest, DropsOverdrawnCommands) {
+    std::vector<CommandData> commands = randomCommands(50, 64, 64, 9);
+    CommandData clear;
+    clear.opcode = CLEAR_DISPLAY_OPCODE;
+    clear.clearDisplay = { 0x0000 };
+    commands.push_back(clear);
+    CommandData rectangle;
+    rectangle.opcode = FILL_RECTANGLE_OPCODE;
+    rectangle.fillRectangle = { 0, 0, 64, 64, 0x1111 };
+    commands.push_back(rectangle);
+    rectangle.fillRectangle = { 100, 100, 4, 4, 0x2222 };
+    commands.push_back(rectangle);
+
+    CommandOptimizer optimizer({ 0, 0, 64, 64 });
+    const OptimizerStats& stats = optimizer.optimize(commands);
+
+    ASSERT_EQ(commands.size(), 1u);
+    EXPECT_EQ(commands[0].fillRectangle.color, 0x1111);
+    EXPECT_EQ(stats.commandsDropped, 52u);
+    EXPECT_GE(stats.pixelsEliminated, 64 * 64);
+}
+
+TEST(CommandOptimizerTest, PreservesFinalPixels) {
+    const int width = 96;
+    const int height = 80;
+    for (unsigned seed = 1; seed <= 20; ++seed) {
+        std::vector<CommandData> commands = randomCommands(200, width, height, seed);
+        // Sprinkle in pixel runs and axis-aligned lines.
+        for (size_t i = 0; i < commands.size(); i += 7) {
+            if (commands[i].opcode == DRAW_PIXEL_OPCODE && i + 3 < commands.size()) {
+                for (int k = 1; k <= 3; ++k) {
+                    commands[i + k].opcode = DRAW_PIXEL_OPCODE;
+                    commands[i + k].drawPixel = commands[i].drawPixel;
+                    commands[i + k].drawPixel.x0 = static_cast<int16_t>(commands[i].drawPixel.x0 + k);
+                }
+            }
+            if (commands[i].opcode == DRAW_LINE_OPCODE) {
+                commands[i].drawLine.y1 = commands[i].drawLine.y0;
+            }
+        }
+        std::vector<CommandData> optimized = commands;
+        CommandOptimizer optimizer({ 0, 0, width, height });
+        optimizer.optimize(optimized);
+        EXPECT_LE(optimized.size(), commands.size());
+
+        Framebuffer original(width, height);
+        Framebuffer rewritten(width, height);
+        renderAll(original, commands);
+        renderAll(rewritten, optimized);
+        ASSERT_TRUE(std::equal(original.data(), original.data() + width * height, rewritten.data())) << "seed " << seed;
+    }
+}
+
+static CommandData frameMarker(CommandOpcode opcode, uint16_t frame) {
+    CommandData command;
+    command.opcode = opcode;
+    command.beginFrame = { frame };
+    return command;
+}
+
+TEST(FrameChainTest, PresentsOnlyCompletedFrames) {
+    FrameChain frames(16, 8);
+    CommandData fill;
+    fill.opcode = FILL_RECTANGLE_OPCODE;
+    fill.fillRectangle = { 0, 0, 16, 8, 0x07E0 };
+
+    frames.execute(frameMarker(BEGIN_FRAME_OPCODE, 1));
+    frames.execute(fill);
+    EXPECT_TRUE(frames.inFrame());
+    EXPECT_FALSE(frames.acquire());
+    EXPECT_EQ(countColor(frames.frontBuffer(), 0x07E0), 0u);
+
+    frames.execute(frameMarker(END_FRAME_OPCODE, 1));
+    EXPECT_FALSE(frames.inFrame());
+    ASSERT_TRUE(frames.acquire());
+    EXPECT_EQ(frames.frontFrame(), 1u);
+    EXPECT_EQ(countColor(frames.frontBuffer(), 0x07E0), 16u * 8u);
+    EXPECT_FALSE(frames.acquire());
+}
+
+TEST(FrameChainTest, RecycledBuffersCatchUp) {
+    const int width = 61;
+    const int height = 37;
+    std::vector<CommandData> commands = randomCommands(600, width, height, 7);
+    Framebuffer expected(width, height);
+    Rasterizer reference(expected);
+    FrameChain frames(width, height);
+
+    // Frames of varying length; the viewer skips some of them, so buffers
+    // come back after one, two or many presents.
+    size_t next = 0;
+    for (uint16_t frame = 0; next < commands.size(); ++frame) {
+        frames.execute(frameMarker(BEGIN_FRAME_OPCODE, frame));
+        for (size_t end = std::min(commands.size(), next + frame % 7); next < end; ++next) {
+            frames.execute(commands[next]);
+            reference.execute(commands[next]);
+        }
+        frames.execute(frameMarker(END_FRAME_OPCODE, frame));
+        if (frame % 3 != 1) {
+            frames.acquire();
+        }
+        ASSERT_EQ(frames.presentedFrames(), frame + 1u);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                ASSERT_EQ(frames.latest().pixel(x, y), expected.pixel(x, y)) << "frame " << frame << " at " << x << ", " << y;
+            }
+        }
+    }
+    frames.acquire();
+    EXPECT_EQ(frames.frontFrame(), frames.presentedFrames());
+}
+
+TEST(CommandOptimizerTest, KeepsFrameBoundaries) {
+    CommandData small;
+    small.opcode = FILL_RECTANGLE_OPCODE;
+    small.fillRectangle = { 2, 2, 4, 4, 0x1234 };
+    CommandData full;
+    full.opcode = CLEAR_DISPLAY_OPCODE;
+    full.clearDisplay = { 0 };
+    std::vector<CommandData> commands = { small, frameMarker(END_FRAME_OPCODE, 1), full };
+
+    CommandOptimizer optimizer({ 0, 0, 16, 16 });
+    optimizer.optimize(commands);
+    ASSERT_EQ(commands.size(), 3u);
+    EXPECT_EQ(commands[0].opcode, FILL_RECTANGLE_OPCODE);
+    EXPECT_EQ(commands[1].opcode, END_FRAME_OPCODE);
+}
+
+// Bulk commands must draw the same pixels, clipped the same way, as the
+// single commands they stand for.
+TEST(RasterizerTest, BulkCommandsMatchSingleCommands) {
+    std::vector<uint8_t> polyline;
+    encodeDrawPolyline({ { -4, 3 }, { 9, 12 }, { 30, 2 }, { 30, 2 }, { 5, -7 } }, 0x07E0, polyline);
+    std::vector<uint8_t> point;
+    encodeDrawPolyline({ { 6, 6 } }, 0x1234, point);
+    std::vector<uint8_t> span;
+    encodeDrawPixelSpan(-3, 5, { 0x0001, 0x0002, 0x0003, 0x0004, 0x0005, 0x0006 }, span);
+    std::vector<uint16_t> wide(40, 0xF800);
+    std::vector<uint8_t> clippedSpan;
+    encodeDrawPixelSpan(10, 15, wide, clippedSpan);
+    std::vector<uint8_t> boxes;
+    encodeFillRectangles({ { 1, 1, 4, 3 }, { 18, 14, 8, 8 }, { 2, 2, -3, 4 } }, 0x001F, boxes);
+
+    Framebuffer bulk(20, 16);
+    Framebuffer single(20, 16);
+    DamageRegion damage({ 0, 0, 20, 16 }, 64);
+    Rasterizer bulkRasterizer(bulk);
+    bulkRasterizer.setDamageRegion(&damage);
+    Rasterizer singleRasterizer(single);
+    DisplayProtocol protocol;
+    for (const std::vector<uint8_t>* datagram : { &polyline, &point, &span, &clippedSpan, &boxes }) {
+        BulkCommandView command = protocol.parseBulkCommand(datagram->data(), datagram->size());
+        bulkRasterizer.execute(command);
+        std::vector<CommandData> commands;
+        expandBulkCommand(command, commands);
+        for (const CommandData& data : commands) {
+            singleRasterizer.execute(data);
+        }
+    }
+    for (int y = 0; y < 16; ++y) {
+        for (int x = 0; x < 20; ++x) {
+            ASSERT_EQ(bulk.pixel(x, y), single.pixel(x, y)) << x << "," << y;
+            if (bulk.pixel(x, y) != 0) {
+                const std::vector<Rect>& rects = damage.getRects();
+                EXPECT_TRUE(std::any_of(rects.begin(), rects.end(), [&](const Rect& rect) { return rect.contains(x, y); })) << x << "," << y;
+            }
+        }
+    }
+    EXPECT_EQ(bulk.pixel(6, 6), 0x1234);
+    EXPECT_EQ(bulk.pixel(0, 5), 0x0004);
+    EXPECT_EQ(countColor(bulk, 0xF800), 8u);
+}
+
+TEST(EllipseSpanCacheTest, EvictsLeastRecentlyUsed) {
+    EllipseSpanCache cache(2);
+    std::vector<int> expected;
+    computeEllipseHalfWidths(7, 3, expected);
+    EXPECT_EQ(cache.halfWidths(7, 3), expected);
+    EXPECT_EQ(cache.halfWidths(7, 3), expected);
+    cache.halfWidths(4, 4);
+    cache.halfWidths(7, 3);
+    // (4, 4) is now the least recently used and makes room for (5, 9).
+    cache.halfWidths(5, 9);
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.hits(), 2u);
+    EXPECT_EQ(cache.misses(), 3u);
+    EXPECT_EQ(cache.evictions(), 1u);
+    cache.halfWidths(7, 3);
+    EXPECT_EQ(cache.hits(), 3u);
+    cache.halfWidths(4, 4);
+    EXPECT_EQ(cache.misses(), 4u);
+    computeEllipseHalfWidths(5, 9, expected);
+    EXPECT_EQ(cache.halfWidths(5, 9), expected);
+    EXPECT_EQ(cache.misses(), 5u);
+
+    // Too tall to cache, but still correct.
+    computeEllipseHalfWidths(3, EllipseSpanCache::MAX_CACHED_RADIUS + 1, expected);
+    EXPECT_EQ(cache.halfWidths(3, EllipseSpanCache::MAX_CACHED_RADIUS + 1), expected);
+    EXPECT_EQ(cache.size(), 2u);
+}
+
+TEST(EllipseSpanCacheTest, CachedEllipsesMatchUncached) {
+    std::vector<CommandData> commands;
+    for (int i = 0; i < 200; ++i) {
+        CommandData command;
+        command.opcode = i % 2 ? DRAW_ELLIPSE_OPCODE : FILL_ELLIPSE_OPCODE;
+        command.drawEllipse = { static_cast<int16_t>(i * 7 % 70 - 5), static_cast<int16_t>(i * 13 % 50 - 5),
+            static_cast<int16_t>(i % 5), static_cast<int16_t>(i % 7 * 3), static_cast<uint16_t>(i * 331) };
+        commands.push_back(command);
+    }
+    Framebuffer cached(64, 40);
+    Framebuffer small(64, 40);
+    Framebuffer uncached(64, 40);
+    EllipseSpanCache smallCache(3);
+    EllipseSpanCache noCache(0);
+    Rasterizer cachedRasterizer(cached);
+    Rasterizer smallRasterizer(small);
+    smallRasterizer.setEllipseCache(&smallCache);
+    Rasterizer uncachedRasterizer(uncached);
+    uncachedRasterizer.setEllipseCache(&noCache);
+    for (const CommandData& command : commands) {
+        cachedRasterizer.execute(command);
+        smallRasterizer.execute(command);
+        uncachedRasterizer.execute(command);
+    }
+    for (int y = 0; y < 40; ++y) {
+        for (int x = 0; x < 64; ++x) {
+            ASSERT_EQ(cached.pixel(x, y), uncached.pixel(x, y)) << x << "," << y;
+            ASSERT_EQ(small.pixel(x, y), uncached.pixel(x, y)) << x << "," << y;
+        }
+    }
+    EXPECT_EQ(cachedRasterizer.ellipseCache().misses(), 35u);
+    EXPECT_GT(cachedRasterizer.ellipseCache().hits(), 100u);
+    EXPECT_GT(smallCache.evictions(), 0u);
+    EXPECT_EQ(noCache.hits(), 0u);
+}
+
+TEST(CommandClipperTest, CullsAndClips) {
+    CommandClipper clipper(32, 16);
+    CommandData command;
+    command.opcode = FILL_RECTANGLE_OPCODE;
+
+    command.fillRectangle = { 4, 4, 8, 8, 0xFFFF };
+    EXPECT_EQ(clipper.clip(command), CLIP_INSIDE);
+    command.fillRectangle = { -6, 10, 10, 20, 0xFFFF };
+    ASSERT_EQ(clipper.clip(command), CLIP_CLIPPED);
+    EXPECT_EQ(command.fillRectangle.x, 0);
+    EXPECT_EQ(command.fillRectangle.y, 10);
+    EXPECT_EQ(command.fillRectangle.width, 4);
+    EXPECT_EQ(command.fillRectangle.height, 6);
+    command.fillRectangle = { 40, 4, 8, 8, 0xFFFF };
+    EXPECT_EQ(clipper.clip(command), CLIP_CULLED);
+    command.fillRectangle = { 4, 4, -8, 8, 0xFFFF };
+    EXPECT_EQ(clipper.clip(command), CLIP_CULLED);
+
+    command.opcode = DRAW_ELLIPSE_OPCODE;
+    command.drawEllipse = { 0, 0, 5, 5, 0xFFFF };
+    EXPECT_EQ(clipper.clip(command), CLIP_CLIPPED);
+    command.drawEllipse = { 10, 8, 5, -1, 0xFFFF };
+    EXPECT_EQ(clipper.clip(command), CLIP_CULLED);
+
+    LineSteps steps = { -1, -1 };
+    command.opcode = DRAW_LINE_OPCODE;
+    command.drawLine = { -30000, 8, 30000, 8, 0xFFFF };
+    ASSERT_EQ(clipper.clip(command, &steps), CLIP_CLIPPED);
+    EXPECT_EQ(steps.first, 30000);
+    EXPECT_EQ(steps.last, 30031);
+    EXPECT_EQ(command.drawLine.x0, -30000);
+    command.drawLine = { -10, 20, 40, 30, 0xFFFF };
+    EXPECT_EQ(clipper.clip(command, &steps), CLIP_CULLED);
+}
+
+// A command drawn across many tiles still counts as one clip outcome.
+TEST(CommandClipperTest, CountsOncePerCommand) {
+    std::vector<CommandData> commands(3);
+    for (CommandData& command : commands) {
+        command.opcode = FILL_RECTANGLE_OPCODE;
+    }
+    commands[0].fillRectangle = { 0, 0, 32, 32, 0xFFFF };
+    commands[1].fillRectangle = { -6, 10, 20, 20, 0xFFFF };
+    commands[2].fillRectangle = { 40, 4, 8, 8, 0xFFFF };
+
+    Framebuffer serial(32, 32);
+    Rasterizer rasterizer(serial);
+    Framebuffer tiled(32, 32);
+    TileRenderer renderer(tiled, 2, 8);
+    for (int pass = 0; pass < 2; ++pass) {
+        MetricsRegistry::instance().reset();
+        if (pass == 0) {
+            for (const CommandData& command : commands) {
+                rasterizer.execute(command);
+            }
+        }
+        else {
+            renderer.execute(commands);
+        }
+        MetricsSnapshot snapshot = MetricsRegistry::instance().snapshot();
+        EXPECT_EQ(snapshot.clips[CLIP_INSIDE], 1u) << "pass " << pass;
+        EXPECT_EQ(snapshot.clips[CLIP_CLIPPED], 1u) << "pass " << pass;
+        EXPECT_EQ(snapshot.clips[CLIP_CULLED], 1u) << "pass " << pass;
+    }
+}
+
+// Clipped lines start mid-way with computed Bresenham state; they must
+// match the visible part of the same line drawn without clipping.
+TEST(CommandClipperTest, ClippedLinesMatchUnclipped) {
+    const int OFFSET = 100;
+    Framebuffer window(20, 16);
+    Framebuffer reference(240, 240);
+    Rasterizer windowRasterizer(window);
+    Rasterizer referenceRasterizer(reference);
+    unsigned seed = 5;
+    auto next = [&seed](int range) {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<int>((seed >> 8) % range);
+    };
+    for (int i = 0; i < 3000; ++i) {
+        int x0 = next(100) - 40;
+        int y0 = next(100) - 40;
+        int x1 = next(100) - 40;
+        int y1 = next(100) - 40;
+        uint16_t color = static_cast<uint16_t>(i + 1);
+        CommandData command;
+        command.opcode = DRAW_LINE_OPCODE;
+        command.drawLine = { static_cast<int16_t>(x0), static_cast<int16_t>(y0), static_cast<int16_t>(x1), static_cast<int16_t>(y1), color };
+        windowRasterizer.execute(command);
+        referenceRasterizer.drawLine(x0 + OFFSET, y0 + OFFSET, x1 + OFFSET, y1 + OFFSET, color);
+        if (i % 100 == 99) {
+            for (int y = 0; y < 16; ++y) {
+                for (int x = 0; x < 20; ++x) {
+                    ASSERT_EQ(window.pixel(x, y), reference.pixel(x + OFFSET, y + OFFSET)) << "line " << i << " at " << x << "," << y;
+                }
+            }
+        }
+    }
+}
+
+// Full-range lines clipped far from their start skip tens of thousands of
+// steps; the pixels must still match the whole line walked step by step.
+TEST(CommandClipperTest, ClippedExtremeLinesMatchUnclipped) {
+    const Rect clip = { 32, 32, 128, 128 };
+    const int lines[][4] = {
+        { -32768, -32768, 32767, 32767 },
+        { 32767, 32767, -32768, -32768 },
+        { -32768, -32000, 32767, 32000 },
+        { -20000, -32768, 20100, 32767 },
+    };
+    for (const auto& line : lines) {
+        Framebuffer clipped(128, 128);
+        Rasterizer rasterizer(clipped);
+        rasterizer.setClip(clip);
+        CommandData command;
+        command.opcode = DRAW_LINE_OPCODE;
+        command.drawLine = { static_cast<int16_t>(line[0]), static_cast<int16_t>(line[1]),
+            static_cast<int16_t>(line[2]), static_cast<int16_t>(line[3]), 0xFFFF };
+        rasterizer.execute(command);
+
+        Framebuffer reference(128, 128);
+        int64_t x = line[0];
+        int64_t y = line[1];
+        int64_t dx = std::abs(line[2] - line[0]);
+        int64_t dy = -std::abs(line[3] - line[1]);
+        int64_t error = dx + dy;
+        size_t visible = 0;
+        for (;;) {
+            if (clip.contains(static_cast<int>(x), static_cast<int>(y))) {
+                reference.row(static_cast<int>(y))[x] = 0xFFFF;
+                ++visible;
+            }
+            if (x == line[2] && y == line[3]) {
+                break;
+            }
+            int64_t error2 = 2 * error;
+            if (error2 >= dy) {
+                error += dy;
+                x += line[0] < line[2] ? 1 : -1;
+            }
+            if (error2 <= dx) {
+                error += dx;
+                y += line[1] < line[3] ? 1 : -1;
+            }
+        }
+        ASSERT_GT(visible, 0u);
+        for (int py = 0; py < 128; ++py) {
+            for (int px = 0; px < 128; ++px) {
+                ASSERT_EQ(clipped.pixel(px, py), reference.pixel(px, py)) << "line from " << line[0] << "," << line[1] << " at " << px << "," << py;
+            }
+        }
+    }
+}
+
+TEST(FrameExportTest, PublishesPresentedFrames) {
+    const int width = 21;
+    const int height = 13;
+    std::vector<uint64_t> memory(frameExportSize(width, height) / sizeof(uint64_t));
+    size_t size = memory.size() * sizeof(uint64_t);
+    FrameExportWriter writer(memory.data(), size, width, height);
+    FrameExportReader reader(memory.data(), size);
+    FrameChain frames(width, height, &writer);
+    Framebuffer copy(width, height);
+    EXPECT_EQ(reader.copyLatest(copy), 0u);
+
+    std::vector<CommandData> commands = randomCommands(200, width, height, 3);
+    for (size_t i = 0; i < commands.size(); ++i) {
+        frames.execute(commands[i]);
+        if (i % 10 != 9) {
+            continue;
+        }
+        frames.present();
+        // Presents cycle through all three buffers.
+        EXPECT_EQ(frames.latest().data(), writer.buffer((frames.presentedFrames() - 1) % FRAME_EXPORT_BUFFERS));
+        Rect damage = { 0, 0, 0, 0 };
+        ASSERT_EQ(reader.read([&](const Framebuffer& frame, const Rect& changed) {
+            damage = changed;
+            // The reader looks at FrameChain's own buffer, not a copy.
+            EXPECT_EQ(frame.data(), frames.latest().data());
+        }), frames.presentedFrames());
+        EXPECT_TRUE(Rect({ 0, 0, width, height }).contains(damage));
+        ASSERT_EQ(reader.copyLatest(copy), frames.presentedFrames());
+        EXPECT_TRUE(std::equal(copy.data(), copy.data() + width * height, frames.latest().data()));
+    }
+
+    // A buffer being drawn into is never handed out as consistent.
+    CommandData fill;
+    fill.opcode = FILL_RECTANGLE_OPCODE;
+    fill.fillRectangle = { 2, 3, 4, 5, 0xFFFF };
+    frames.execute(fill);
+    frames.present();
+    EXPECT_EQ(reader.read([&](const Framebuffer&, const Rect& changed) {
+        EXPECT_EQ(changed.left, 2);
+        EXPECT_EQ(changed.bottom, 8);
+        writer.beginWrite(frames.latest().data() == writer.buffer(0) ? 0 : frames.latest().data() == writer.buffer(1) ? 1 : 2);
+    }, 1), 0u);
+
+    // A corrupt header cannot send the reader outside the memory.
+    frames.execute(fill);
+    frames.present();
+    ASSERT_EQ(reader.copyLatest(copy), frames.presentedFrames());
+    FrameExportHeader* header = reinterpret_cast<FrameExportHeader*>(memory.data());
+    for (uint64_t& offset : header->bufferOffset) {
+        offset = size - 2;
+    }
+    EXPECT_EQ(reader.copyLatest(copy), 0u);
+
+    std::vector<uint64_t> garbage(memory.size());
+    EXPECT_THROW(FrameExportReader(garbage.data(), size), std::invalid_argument);
+    EXPECT_THROW(FrameExportReader(memory.data(), size / 2), std::invalid_argument);
+    EXPECT_THROW(FrameChain(width + 1, height, &writer), std::invalid_argument);
+}
+
+// Scenes without clears, with mostly small shapes so updates stay partial.
+static std::vector<CommandData> randomScene(size_t count, int width, int height, unsigned seed) {
+    std::vector<CommandData> scene = randomCommands(count, width, height, seed);
+    for (CommandData& command : scene) {
+        if (command.opcode == CLEAR_DISPLAY_OPCODE) {
+            command.opcode = DRAW_PIXEL_OPCODE;
+        }
+        if (command.opcode != DRAW_PIXEL_OPCODE && seed % 4 != 0) {
+            command.drawLine.x1 = static_cast<int16_t>(command.drawLine.x1 % 9);
+            command.drawLine.y1 = static_cast<int16_t>(command.drawLine.y1 % 9);
+        }
+    }
+    return scene;
+}
+
+TEST(SceneEncoderTest, UpdatesReproduceFullScene) {
+    const int width = 97;
+    const int height = 61;
+    SceneEncoder encoder(width, height, 0x0010);
+    FrameChain frames(width, height);
+    std::vector<CommandData> scene = randomScene(60, width, height, 1);
+    size_t partial = 0;
+    for (unsigned step = 0; step < 200; ++step) {
+        std::vector<CommandData> change = randomScene(3, width, height, step + 2);
+        switch (step % 5) {
+        case 0:
+        case 1:
+            scene[step * 7 % scene.size()] = change[0];
+            break;
+        case 2:
+            scene.insert(scene.begin() + step % scene.size(), change.begin(), change.end());
+            break;
+        case 3:
+            scene.erase(scene.begin() + step % scene.size());
+            break;
+        default:
+            break;
+        }
+        std::vector<CommandData> full = scene;
+        if (step % 50 == 49) {
+            CommandData clear;
+            clear.opcode = CLEAR_DISPLAY_OPCODE;
+            clear.clearDisplay = { static_cast<uint16_t>(step) };
+            full.insert(full.begin(), clear);
+        }
+
+        const std::vector<CommandData>& update = encoder.update(full);
+        ASSERT_EQ(update.front().opcode, BEGIN_FRAME_OPCODE);
+        ASSERT_EQ(update.back().opcode, END_FRAME_OPCODE);
+        partial += update[1].opcode != CLEAR_DISPLAY_OPCODE;
+        for (const CommandData& command : update) {
+            frames.execute(command);
+        }
+
+        Framebuffer expected(width, height);
+        Rasterizer reference(expected);
+        CommandData clear;
+        clear.opcode = CLEAR_DISPLAY_OPCODE;
+        clear.clearDisplay = { 0x0010 };
+        if (full.front().opcode != CLEAR_DISPLAY_OPCODE) {
+            reference.execute(clear);
+        }
+        for (const CommandData& command : full) {
+            reference.execute(command);
+        }
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                ASSERT_EQ(frames.latest().pixel(x, y), expected.pixel(x, y)) << "step " << step << " at " << x << ", " << y;
+            }
+        }
+    }
+    EXPECT_GT(partial, 50u);
+}
+
+TEST(SceneEncoderTest, PacksCompactBatches) {
+    std::vector<CommandData> commands = randomScene(500, 640, 480, 3);
+    uint32_t sequence = 10;
+    std::vector<std::vector<uint8_t>> datagrams;
+    packCompactBatches(commands, sequence, 200, datagrams);
+    EXPECT_EQ(sequence, 10 + datagrams.size());
+    ASSERT_GT(datagrams.size(), 1u);
+
+    DisplayProtocol protocol;
+    CommandBuffer buffer;
+    for (size_t i = 0; i < datagrams.size(); ++i) {
+        EXPECT_LE(datagrams[i].size(), 200u);
+        uint32_t batchSequence;
+        protocol.parseCompactBatch(datagrams[i], buffer, &batchSequence);
+        EXPECT_EQ(batchSequence, 10 + i);
+    }
+    ASSERT_EQ(buffer.size(), commands.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+        CommandBuffer expected;
+        expected.push(commands[i]);
+        ASSERT_EQ(buffer.opcode[i], expected.opcode[0]);
+        ASSERT_EQ(buffer.x0[i], expected.x0[0]);
+        ASSERT_EQ(buffer.y1[i], expected.y1[0]);
+        ASSERT_EQ(buffer.color[i], expected.color[0]);
+    }
+}
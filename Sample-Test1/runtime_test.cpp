@@ -0,0 +1,292 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <cstdio>
+#include <vector>
+#include "../display_protocol/spsc_ring.h"
+#include "../display_protocol/command.h"
+#include "../display_protocol/capture_log.h"
+#include "../display_protocol/display_protocol.h"
+#include "../display_protocol/frame_chain.h"
+
+TEST(SpscRingTest, CapacityRoundsUpToPowerOfTwo) {
+    SpscRing<int> ring(5);
+    EXPECT_EQ(ring.capacity(), 8u);
+    EXPECT_THROW(SpscRing<int>(0), std::invalid_argument);
+}
+
+TEST(SpscRingTest, PushPopFifoUntilFull) {
+    SpscRing<int> ring(4);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(ring.tryPush(i));
+    }
+    EXPECT_FALSE(ring.tryPush(4));
+
+    int value = -1;
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(ring.tryPop(value));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_FALSE(ring.tryPop(value));
+}
+
+TEST(SpscRingTest, BatchPushPopWrapsAround) {
+    SpscRing<int> ring(8);
+    int items[6] = { 0, 1, 2, 3, 4, 5 };
+    int out[8] = {};
+
+    EXPECT_EQ(ring.tryPush(items, 6), 6u);
+    EXPECT_EQ(ring.tryPop(out, 4), 4u);
+    EXPECT_EQ(ring.tryPush(items, 6), 6u);
+    EXPECT_EQ(ring.tryPush(items, 6), 0u);
+
+    EXPECT_EQ(ring.tryPop(out, 8), 8u);
+    int expected[8] = { 4, 5, 0, 1, 2, 3, 4, 5 };
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_EQ(out[i], expected[i]);
+    }
+}
+
+TEST(SpscRingTest, CarriesCommandsAcrossThreads) {
+    const int total = 100000;
+    SpscRing<CommandData> ring(64);
+
+    std::thread producer([&] {
+        CommandData command;
+        command.opcode = DRAW_PIXEL_OPCODE;
+        for (int i = 0; i < total; ++i) {
+            command.drawPixel = { static_cast<int16_t>(i), static_cast<int16_t>(i >> 16), static_cast<uint16_t>(i) };
+            ring.push(command);
+        }
+    });
+
+    CommandData batch[16];
+    int received = 0;
+    bool ordered = true;
+    while (received < total) {
+        size_t count = ring.pop(batch, 16);
+        for (size_t i = 0; i < count; ++i, ++received) {
+            ordered &= batch[i].drawPixel.x0 == static_cast<int16_t>(received);
+        }
+    }
+    producer.join();
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(received, total);
+}
+
+TEST(SpscRingTest, WakeReleasesIdleConsumer) {
+    SpscRing<int> ring(4);
+    std::atomic<bool> stop{ false };
+    size_t popped = 1;
+
+    std::thread consumer([&] {
+        int value;
+        popped = ring.popUntilWoken(&value, 1, stop);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    stop = true;
+    ring.wake();
+    consumer.join();
+    EXPECT_EQ(popped, 0u);
+}
+
+TEST(CaptureLogTest, RecordsRoundTrip) {
+    const char* path = "capture_roundtrip.dpcp";
+    const uint8_t pixel[] = { 0x01, 0x05, 0x00, 0x06, 0x00, 0xF8, 0x00 };
+    const uint8_t clear[] = { 0x00, 0xFF, 0xFF };
+    {
+        CaptureWriter writer(path);
+        writer.append(pixel, sizeof(pixel), 100);
+        writer.append(clear, sizeof(clear), 250);
+        EXPECT_EQ(writer.recordCount(), 2u);
+    }
+
+    CaptureReader reader(path);
+    CaptureRecord record;
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(record.timestamp, 100u);
+    EXPECT_EQ(std::vector<uint8_t>(record.data, record.data + record.size), std::vector<uint8_t>(pixel, pixel + sizeof(pixel)));
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(record.timestamp, 250u);
+    EXPECT_EQ(record.size, sizeof(clear));
+    EXPECT_FALSE(reader.next(record));
+    EXPECT_FALSE(reader.truncated());
+
+    reader.rewind();
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(record.timestamp, 100u);
+    std::remove(path);
+}
+
+TEST(CaptureLogTest, TruncatedTailEndsCapture) {
+    const char* path = "capture_truncated.dpcp";
+    const uint8_t clear[] = { 0x00, 0xFF, 0xFF };
+    {
+        CaptureWriter writer(path);
+        writer.append(clear, sizeof(clear), 1);
+    }
+    {
+        std::FILE* file = std::fopen(path, "ab");
+        const uint8_t partial[] = { 2, 0, 0, 0, 0, 0, 0, 0, 11, 0, 0, 0, 0x04 };
+        std::fwrite(partial, 1, sizeof(partial), file);
+        std::fclose(file);
+    }
+
+    CaptureReader reader(path);
+    CaptureRecord record;
+    EXPECT_TRUE(reader.next(record));
+    EXPECT_FALSE(reader.next(record));
+    EXPECT_TRUE(reader.truncated());
+    std::remove(path);
+}
+
+TEST(CaptureLogTest, RejectsForeignFile) {
+    const char* path = "capture_foreign.dpcp";
+    std::FILE* file = std::fopen(path, "wb");
+    std::fputs("not a capture", file);
+    std::fclose(file);
+    EXPECT_THROW(CaptureReader reader(path), std::runtime_error);
+    std::remove(path);
+}
+
+TEST(ProtocolMetricsTest, BucketsBoundRelativeError) {
+    for (uint64_t value : { 0ull, 15ull, 16ull, 17ull, 100ull, 1000ull, 123456ull, 987654321ull }) {
+        size_t bucket = latencyBucket(value);
+        EXPECT_GE(latencyBucketLimit(bucket), value);
+        EXPECT_LE(latencyBucketLimit(bucket) - value, value / 16);
+    }
+    EXPECT_EQ(latencyBucket(1ull << 60), LATENCY_BUCKET_COUNT - 1);
+}
+
+TEST(ProtocolMetricsTest, Percentiles) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.percentile(0.5), 0u);
+    for (uint64_t i = 1; i <= 100; ++i) {
+        histogram.record(i);
+    }
+    EXPECT_EQ(histogram.count(), 100u);
+    EXPECT_NEAR(static_cast<double>(histogram.percentile(0.5)), 50.0, 4.0);
+    EXPECT_NEAR(static_cast<double>(histogram.percentile(0.99)), 99.0, 7.0);
+    EXPECT_GE(histogram.percentile(1.0), 100u);
+}
+
+#if DISPLAY_PROTOCOL_METRICS
+TEST(ProtocolMetricsTest, CountsOpcodesAndErrorsAcrossThreads) {
+    MetricsRegistry::instance().reset();
+    DisplayProtocol protocol;
+    const std::vector<uint8_t> pixel = { 0x01, 0x05, 0x00, 0x06, 0x00, 0xF8, 0x00 };
+
+    std::thread worker([&] {
+        for (int i = 0; i < 100; ++i) {
+            protocol.parseCommand(pixel);
+        }
+    });
+    worker.join();
+    EXPECT_THROW(protocol.parseCommand(std::vector<uint8_t>()), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCommand(std::vector<uint8_t>{ 0x42 }), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCommand(std::vector<uint8_t>{ 0x01, 0x00 }), std::invalid_argument);
+
+    MetricsSnapshot snapshot = MetricsRegistry::instance().snapshot();
+    EXPECT_EQ(snapshot.opcodes[DRAW_PIXEL_OPCODE], 100u);
+    EXPECT_EQ(snapshot.errors[EMPTY_INPUT_ERROR], 1u);
+    EXPECT_EQ(snapshot.errors[UNKNOWN_OPCODE_ERROR], 1u);
+    EXPECT_EQ(snapshot.errors[INVALID_LENGTH_ERROR], 1u);
+    EXPECT_GE(snapshot.latency[PARSE_LATENCY].count(), 1u);
+    EXPECT_NE(snapshot.toJson().find("\"draw_pixel\":100"), std::string::npos);
+    EXPECT_NE(snapshot.toText().find("error unknown_opcode: 1"), std::string::npos);
+}
+#endif
+
+TEST(FrameChainTest, ViewerNeverSeesPartialFrames) {
+    const int frameCount = 2000;
+    FrameChain frames(32, 16);
+    std::atomic<bool> stop{ false };
+
+    std::thread renderer([&] {
+        CommandData command;
+        for (int frame = 1; frame <= frameCount; ++frame) {
+            command.opcode = BEGIN_FRAME_OPCODE;
+            command.beginFrame = { static_cast<uint16_t>(frame) };
+            frames.execute(command);
+            // Each frame paints every row in its own color, one row at a time.
+            for (int16_t y = 0; y < 16; ++y) {
+                command.opcode = FILL_RECTANGLE_OPCODE;
+                command.fillRectangle = { 0, y, 32, 1, static_cast<uint16_t>(frame) };
+                frames.execute(command);
+            }
+            command.opcode = END_FRAME_OPCODE;
+            command.endFrame = { static_cast<uint16_t>(frame) };
+            frames.execute(command);
+        }
+        stop = true;
+        frames.wake();
+    });
+
+    uint64_t last = 0;
+    size_t seen = 0;
+    bool consistent = true;
+    while (frames.waitForFrame(stop)) {
+        const Framebuffer& front = frames.frontBuffer();
+        uint16_t color = front.pixel(0, 0);
+        for (int y = 0; y < 16; ++y) {
+            for (int x = 0; x < 32; ++x) {
+                consistent &= front.pixel(x, y) == color;
+            }
+        }
+        consistent &= frames.frontFrame() > last && color == static_cast<uint16_t>(frames.frontFrame());
+        last = frames.frontFrame();
+        ++seen;
+    }
+    renderer.join();
+    frames.acquire();
+    EXPECT_TRUE(consistent);
+    EXPECT_GT(seen, 0u);
+    EXPECT_EQ(frames.frontFrame(), static_cast<uint64_t>(frameCount));
+}
+
+// A reader polling the exported frames, as another process would, only
+// ever accepts frames that were drawn completely.
+TEST(FrameExportTest, ReaderNeverAcceptsTornFrames) {
+    const int frameCount = 2000;
+    std::vector<uint64_t> memory(frameExportSize(32, 16) / sizeof(uint64_t));
+    FrameExportWriter writer(memory.data(), memory.size() * sizeof(uint64_t), 32, 16);
+    FrameExportReader reader(memory.data(), memory.size() * sizeof(uint64_t));
+    FrameChain frames(32, 16, &writer);
+    std::atomic<bool> stop{ false };
+
+    std::thread renderer([&] {
+        CommandData command;
+        for (int frame = 1; frame <= frameCount; ++frame) {
+            for (int16_t y = 0; y < 16; ++y) {
+                command.opcode = FILL_RECTANGLE_OPCODE;
+                command.fillRectangle = { 0, y, 32, 1, static_cast<uint16_t>(frame) };
+                frames.execute(command);
+            }
+            frames.present();
+        }
+        stop = true;
+    });
+
+    uint64_t last = 0;
+    bool consistent = true;
+    while (!stop.load()) {
+        bool uniform = true;
+        uint16_t color = 0;
+        uint64_t frame = reader.read([&](const Framebuffer& view, const Rect&) {
+            color = view.pixel(0, 0);
+            uniform = true;
+            for (int y = 0; y < 16; ++y) {
+                for (int x = 0; x < 32; ++x) {
+                    uniform &= view.pixel(x, y) == color;
+                }
+            }
+        });
+        if (frame != 0) {
+            consistent &= uniform && color == static_cast<uint16_t>(frame) && frame >= last;
+            last = frame;
+        }
+    }
+    renderer.join();
+    EXPECT_TRUE(consistent);
+    EXPECT_EQ(reader.read([](const Framebuffer&, const Rect&) {}), static_cast<uint64_t>(frameCount));
+}
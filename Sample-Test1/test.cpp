@@ -1,6 +1,7 @@
 #include "pch.h"
 #include <gtest/gtest.h>
 #include <vector>
+#include <random>
 #include "../display_protocol/display_protocol.h"
 
 //      ClearDisplay
@@ -213,3 +214,484 @@ TEST(DisplayProtocolTest, ValidFillEllipseCommand) {
 
     delete cmd; 
 }
+
+// Allocation-free parse path
+TEST(DisplayProtocolTest, ValidDrawLineCommandData) {
+    uint8_t byte_array[] = { DRAW_LINE_OPCODE, 0x00, 0x10, 0x00, 0x20, 0x00, 0x30, 0x00, 0x40, 0xCC, 0x05 };
+
+    DisplayProtocol protocol;
+    CommandData cmd = protocol.parseCommand(byte_array, sizeof(byte_array));
+
+    ASSERT_EQ(cmd.opcode, DRAW_LINE_OPCODE);
+    EXPECT_EQ(cmd.drawLine.x0, 0x1000);
+    EXPECT_EQ(cmd.drawLine.y0, 0x2000);
+    EXPECT_EQ(cmd.drawLine.x1, 0x3000);
+    EXPECT_EQ(cmd.drawLine.y1, 0x4000);
+    EXPECT_EQ(cmd.drawLine.color, 0xCC05);
+}
+
+TEST(DisplayProtocolTest, InvalidCommandDataParams) {
+    uint8_t byte_array[] = { FILL_ELLIPSE_OPCODE, 0x00, 0x06 };
+
+    DisplayProtocol protocol;
+    EXPECT_THROW(protocol.parseCommand(byte_array, sizeof(byte_array)), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCommand(byte_array, 0), std::invalid_argument);
+}
+
+struct ColorVisitor {
+    uint16_t operator()(const ClearDisplayData& d) const { return d.color; }
+    uint16_t operator()(const DrawPixelData& d) const { return d.color; }
+    uint16_t operator()(const DrawLineData& d) const { return d.color; }
+    uint16_t operator()(const DrawRectangleData& d) const { return d.color; }
+    uint16_t operator()(const FillRectangleData& d) const { return d.color; }
+    uint16_t operator()(const DrawEllipseData& d) const { return d.color; }
+    uint16_t operator()(const FillEllipseData& d) const { return d.color; }
+    uint16_t operator()(const BeginFrameData&) const { return 0; }
+    uint16_t operator()(const EndFrameData&) const { return 0; }
+};
+
+TEST(DisplayProtocolTest, VisitCommandData) {
+    uint8_t byte_array[] = { FILL_RECTANGLE_OPCODE, 0x00, 0x05, 0x00, 0x10, 0x00, 0x15, 0x00, 0x20, 0x11, 0x22 };
+
+    DisplayProtocol protocol;
+    CommandData cmd = protocol.parseCommand(byte_array, sizeof(byte_array));
+
+    EXPECT_EQ(visitCommand(cmd, ColorVisitor()), 0x1122);
+
+    Command* command = makeCommand(cmd);
+    FillRectangle* fillRectCmd = dynamic_cast<FillRectangle*>(command);
+    ASSERT_NE(fillRectCmd, nullptr);
+    EXPECT_EQ(fillRectCmd->width, 0x1500);
+    EXPECT_EQ(fillRectCmd->height, 0x2000);
+
+    delete command;
+}
+
+// Batch datagrams
+TEST(DisplayProtocolTest, ValidBatch) {
+    uint8_t byte_array[] = { BATCH_MARKER, 0x03, 0x00,
+        CLEAR_DISPLAY_OPCODE, 0xFF, 0xFF,
+        DRAW_PIXEL_OPCODE, 0x00, 0x10, 0x00, 0x20, 0xAA, 0xBB,
+        FILL_ELLIPSE_OPCODE, 0x00, 0x06, 0x00, 0x11, 0x00, 0x05, 0x00, 0x04, 0x55, 0x66 };
+    CommandBuffer buffer;
+
+    DisplayProtocol protocol;
+    EXPECT_EQ(protocol.parseBatch(byte_array, sizeof(byte_array), buffer), 3u);
+    ASSERT_EQ(buffer.size(), 3u);
+
+    EXPECT_EQ(buffer.opcode[0], CLEAR_DISPLAY_OPCODE);
+    EXPECT_EQ(buffer.color[0], 0xFFFF);
+    EXPECT_EQ(buffer.opcode[1], DRAW_PIXEL_OPCODE);
+    EXPECT_EQ(buffer.x0[1], 0x1000);
+    EXPECT_EQ(buffer.y0[1], 0x2000);
+    EXPECT_EQ(buffer.color[1], 0xAABB);
+    EXPECT_EQ(buffer.opcode[2], FILL_ELLIPSE_OPCODE);
+    EXPECT_EQ(buffer.x1[2], 0x0500);
+    EXPECT_EQ(buffer.y1[2], 0x0400);
+
+    CommandData cmd = buffer.at(2);
+    ASSERT_EQ(cmd.opcode, FILL_ELLIPSE_OPCODE);
+    EXPECT_EQ(cmd.fillEllipse.rx, 0x0500);
+    EXPECT_EQ(cmd.fillEllipse.color, 0x5566);
+}
+
+TEST(DisplayProtocolTest, InvalidBatchKeepsBuffer) {
+    uint8_t valid[] = { BATCH_MARKER, 0x01, 0x00, CLEAR_DISPLAY_OPCODE, 0x12, 0x34 };
+    uint8_t truncated[] = { BATCH_MARKER, 0x02, 0x00, CLEAR_DISPLAY_OPCODE, 0xFF, 0xFF, DRAW_PIXEL_OPCODE, 0x00 };
+    uint8_t trailing[] = { BATCH_MARKER, 0x01, 0x00, CLEAR_DISPLAY_OPCODE, 0xFF, 0xFF, 0x00 };
+    uint8_t unknown[] = { BATCH_MARKER, 0x01, 0x00, 0x7F, 0xFF, 0xFF };
+    CommandBuffer buffer;
+
+    DisplayProtocol protocol;
+    protocol.parseBatch(valid, sizeof(valid), buffer);
+    EXPECT_THROW(protocol.parseBatch(truncated, sizeof(truncated), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseBatch(trailing, sizeof(trailing), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseBatch(unknown, sizeof(unknown), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseBatch(valid, 2, buffer), std::invalid_argument);
+    ASSERT_EQ(buffer.size(), 1u);
+    EXPECT_EQ(buffer.color[0], 0x1234);
+}
+
+// Table-driven codec
+TEST(DisplayProtocolTest, EncodeMatchesWireFormat) {
+    std::vector<std::vector<uint8_t>> commandBytes = {
+        { CLEAR_DISPLAY_OPCODE, 0xFF, 0x01 },
+        { DRAW_PIXEL_OPCODE, 0x00, 0x10, 0x00, 0x20, 0xAA, 0xBB },
+        { DRAW_LINE_OPCODE, 0x00, 0x10, 0x00, 0x20, 0x00, 0x30, 0x00, 0x40, 0xCC, 0x05 },
+        { DRAW_RECTANGLE_OPCODE, 0x00, 0x05, 0x00, 0x10, 0x00, 0x15, 0x00, 0x20, 0xEE, 0xFF },
+        { FILL_RECTANGLE_OPCODE, 0x00, 0x05, 0x00, 0x10, 0x00, 0x15, 0x00, 0x20, 0x11, 0x22 },
+        { DRAW_ELLIPSE_OPCODE, 0x00, 0x08, 0x00, 0x12, 0x00, 0x09, 0x00, 0x07, 0x33, 0x44 },
+        { FILL_ELLIPSE_OPCODE, 0x00, 0x06, 0x00, 0x11, 0x00, 0x05, 0x00, 0x04, 0x55, 0x66 },
+    };
+
+    DisplayProtocol protocol;
+    for (const auto& bytes : commandBytes) {
+        EXPECT_EQ(commandSize(bytes[0]), bytes.size());
+
+        std::vector<uint8_t> encoded;
+        appendCommand(protocol.parseCommand(bytes), encoded);
+        EXPECT_EQ(encoded, bytes);
+    }
+    EXPECT_EQ(commandSize(COMMAND_OPCODE_COUNT), 0u);
+}
+
+TEST(DisplayProtocolTest, EncodeBatchRoundTrip) {
+    uint8_t pixel[] = { DRAW_PIXEL_OPCODE, 0xFF, 0xFF, 0x02, 0x00, 0x12, 0x34 };
+    uint8_t line[] = { DRAW_LINE_OPCODE, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00, 0x04, 0x00, 0x56, 0x78 };
+
+    DisplayProtocol protocol;
+    std::vector<CommandData> commands = {
+        protocol.parseCommand(pixel, sizeof(pixel)),
+        protocol.parseCommand(line, sizeof(line)),
+    };
+    std::vector<uint8_t> batch;
+    encodeBatch(commands, batch);
+    EXPECT_EQ(batch.size(), BATCH_HEADER_SIZE + sizeof(pixel) + sizeof(line));
+
+    CommandBuffer buffer;
+    ASSERT_EQ(protocol.parseBatch(batch, buffer), 2u);
+    EXPECT_EQ(buffer.x0[0], -1);
+    EXPECT_EQ(buffer.y0[0], 2);
+    EXPECT_EQ(buffer.color[0], 0x1234);
+    EXPECT_EQ(buffer.y1[1], 4);
+
+    CommandData cmd = buffer.at(0);
+    ASSERT_EQ(cmd.opcode, DRAW_PIXEL_OPCODE);
+    EXPECT_EQ(cmd.drawPixel.x0, -1);
+    EXPECT_EQ(cmd.drawPixel.color, 0x1234);
+}
+
+TEST(DisplayProtocolTest, CompactBatchRoundTrip) {
+    uint8_t clear[] = { CLEAR_DISPLAY_OPCODE, 0x00, 0x1F };
+    uint8_t line[] = { DRAW_LINE_OPCODE, 0x00, 0x80, 0xFF, 0x7F, 0xFF, 0x7F, 0x00, 0x80, 0x00, 0x1F };
+    uint8_t rect[] = { FILL_RECTANGLE_OPCODE, 0x0A, 0x00, 0x0B, 0x00, 0x05, 0x00, 0x06, 0x00, 0x00, 0x1F };
+    uint8_t ellipse[] = { DRAW_ELLIPSE_OPCODE, 0x0C, 0x00, 0x0B, 0x00, 0x03, 0x00, 0x02, 0x00, 0xF8, 0x00 };
+
+    DisplayProtocol protocol;
+    std::vector<CommandData> commands = {
+        protocol.parseCommand(clear, sizeof(clear)),
+        protocol.parseCommand(line, sizeof(line)),
+        protocol.parseCommand(rect, sizeof(rect)),
+        protocol.parseCommand(ellipse, sizeof(ellipse)),
+    };
+    std::vector<uint8_t> compact;
+    encodeCompactBatch(commands, 300, compact);
+    std::vector<uint8_t> legacy;
+    encodeBatch(commands, legacy);
+    EXPECT_LT(compact.size(), legacy.size());
+
+    CommandBuffer expected;
+    protocol.parseBatch(legacy, expected);
+    CommandBuffer buffer;
+    uint32_t sequence = 0;
+    ASSERT_EQ(protocol.parseCompactBatch(compact, buffer, &sequence), commands.size());
+    EXPECT_EQ(sequence, 300u);
+    EXPECT_EQ(buffer.opcode, expected.opcode);
+    EXPECT_EQ(buffer.x0, expected.x0);
+    EXPECT_EQ(buffer.y0, expected.y0);
+    EXPECT_EQ(buffer.x1, expected.x1);
+    EXPECT_EQ(buffer.y1, expected.y1);
+    EXPECT_EQ(buffer.color, expected.color);
+}
+
+TEST(DisplayProtocolTest, CompactBatchReusesColorAndOrigin) {
+    uint8_t first[] = { DRAW_PIXEL_OPCODE, 0x10, 0x00, 0x20, 0x00, 0x12, 0x34 };
+    uint8_t second[] = { DRAW_PIXEL_OPCODE, 0x11, 0x00, 0x1F, 0x00, 0x12, 0x34 };
+
+    DisplayProtocol protocol;
+    std::vector<CommandData> commands = {
+        protocol.parseCommand(first, sizeof(first)),
+        protocol.parseCommand(second, sizeof(second)),
+    };
+    std::vector<uint8_t> compact;
+    encodeCompactBatch(commands, 0, compact);
+    // Header, then the first pixel with its color, then one byte of opcode
+    // and one byte per delta.
+    std::vector<uint8_t> bytes = { COMPACT_BATCH_MARKER, 0x00, 0x02,
+        DRAW_PIXEL_OPCODE | COMPACT_COLOR_FLAG, 0x20, 0x40, 0x12, 0x34,
+        DRAW_PIXEL_OPCODE, 0x02, 0x01 };
+    EXPECT_EQ(compact, bytes);
+}
+
+TEST(DisplayProtocolTest, RejectMalformedCompactBatch) {
+    uint8_t truncated[] = { COMPACT_BATCH_MARKER, 0x00, 0x02, CLEAR_DISPLAY_OPCODE | COMPACT_COLOR_FLAG, 0xFF, 0xFF, DRAW_PIXEL_OPCODE, 0x02 };
+    uint8_t trailing[] = { COMPACT_BATCH_MARKER, 0x00, 0x01, CLEAR_DISPLAY_OPCODE, 0x00 };
+    uint8_t unknown[] = { COMPACT_BATCH_MARKER, 0x00, 0x01, 0x0F };
+    uint8_t overlong[] = { COMPACT_BATCH_MARKER, 0x00, 0x01, DRAW_PIXEL_OPCODE, 0x80, 0x80, 0x80, 0x01, 0x00 };
+    uint8_t header[] = { COMPACT_BATCH_MARKER, 0x80 };
+
+    DisplayProtocol protocol;
+    CommandBuffer buffer;
+    buffer.push(CLEAR_DISPLAY_OPCODE, 0, 0, 0, 0, 0x1234);
+    EXPECT_THROW(protocol.parseCompactBatch(truncated, sizeof(truncated), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCompactBatch(trailing, sizeof(trailing), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCompactBatch(unknown, sizeof(unknown), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCompactBatch(overlong, sizeof(overlong), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCompactBatch(header, sizeof(header), buffer), std::invalid_argument);
+    EXPECT_EQ(buffer.size(), 1u);
+}
+
+// Every value has one encoding: zero padding and values wider than the
+// field are malformed rather than truncated.
+TEST(DisplayProtocolTest, RejectNonCanonicalCompactVarints) {
+    uint8_t widest[] = { COMPACT_BATCH_MARKER, 0x00, 0x01, DRAW_PIXEL_OPCODE, 0xFF, 0xFF, 0x03, 0x00 };
+    uint8_t padded[] = { COMPACT_BATCH_MARKER, 0x00, 0x01, DRAW_PIXEL_OPCODE, 0x82, 0x00, 0x00 };
+    uint8_t paddedTwice[] = { COMPACT_BATCH_MARKER, 0x00, 0x01, DRAW_PIXEL_OPCODE, 0x82, 0x80, 0x00, 0x00 };
+    uint8_t tooWide[] = { COMPACT_BATCH_MARKER, 0x00, 0x01, DRAW_PIXEL_OPCODE, 0xFF, 0xFF, 0x07, 0x00 };
+    uint8_t paddedHeader[] = { COMPACT_BATCH_MARKER, 0x80, 0x00, 0x01, DRAW_PIXEL_OPCODE, 0x00, 0x00 };
+    uint8_t tooWideHeader[] = { COMPACT_BATCH_MARKER, 0xFF, 0xFF, 0xFF, 0xFF, 0x1F, 0x01, DRAW_PIXEL_OPCODE, 0x00, 0x00 };
+
+    DisplayProtocol protocol;
+    CommandBuffer buffer;
+    protocol.parseCompactBatch(widest, sizeof(widest), buffer);
+    ASSERT_EQ(buffer.size(), 1u);
+    EXPECT_EQ(buffer.at(0).drawPixel.x0, -32768);
+    EXPECT_THROW(protocol.parseCompactBatch(padded, sizeof(padded), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCompactBatch(paddedTwice, sizeof(paddedTwice), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCompactBatch(tooWide, sizeof(tooWide), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCompactBatch(paddedHeader, sizeof(paddedHeader), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCompactBatch(tooWideHeader, sizeof(tooWideHeader), buffer), std::invalid_argument);
+    EXPECT_EQ(buffer.size(), 1u);
+}
+
+TEST(DisplayProtocolTest, RejectCompactColorFlagWithoutColor) {
+    uint8_t plain[] = { COMPACT_BATCH_MARKER, 0x00, 0x02, BEGIN_FRAME_OPCODE, 0x02, END_FRAME_OPCODE, 0x02 };
+    uint8_t begin[] = { COMPACT_BATCH_MARKER, 0x00, 0x01, BEGIN_FRAME_OPCODE | COMPACT_COLOR_FLAG, 0x02 };
+    uint8_t end[] = { COMPACT_BATCH_MARKER, 0x00, 0x01, END_FRAME_OPCODE | COMPACT_COLOR_FLAG, 0x02 };
+
+    DisplayProtocol protocol;
+    CommandBuffer buffer;
+    protocol.parseCompactBatch(plain, sizeof(plain), buffer);
+    ASSERT_EQ(buffer.size(), 2u);
+    EXPECT_EQ(buffer.at(0).beginFrame.frame, 1);
+    EXPECT_THROW(protocol.parseCompactBatch(begin, sizeof(begin), buffer), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCompactBatch(end, sizeof(end), buffer), std::invalid_argument);
+    EXPECT_EQ(buffer.size(), 2u);
+}
+
+TEST(DisplayProtocolTest, ParseFrameMarkers) {
+    uint8_t begin[] = { BEGIN_FRAME_OPCODE, 0x34, 0x12 };
+    uint8_t end[] = { END_FRAME_OPCODE, 0x34, 0x12 };
+    uint8_t truncated[] = { END_FRAME_OPCODE, 0x34 };
+
+    DisplayProtocol protocol;
+    CommandData command = protocol.parseCommand(begin, sizeof(begin));
+    ASSERT_EQ(command.opcode, BEGIN_FRAME_OPCODE);
+    EXPECT_EQ(command.beginFrame.frame, 0x1234);
+    command = protocol.parseCommand(end, sizeof(end));
+    ASSERT_EQ(command.opcode, END_FRAME_OPCODE);
+    EXPECT_EQ(command.endFrame.frame, 0x1234);
+    EXPECT_THROW(protocol.parseCommand(truncated, sizeof(truncated)), std::invalid_argument);
+
+    std::vector<CommandData> commands = { protocol.parseCommand(begin, sizeof(begin)), protocol.parseCommand(end, sizeof(end)) };
+    std::vector<uint8_t> compact;
+    encodeCompactBatch(commands, 0, compact);
+    CommandBuffer buffer;
+    ASSERT_EQ(protocol.parseCompactBatch(compact, buffer), 2u);
+    EXPECT_EQ(buffer.at(1).opcode, END_FRAME_OPCODE);
+    EXPECT_EQ(buffer.at(1).endFrame.frame, 0x1234);
+}
+
+TEST(DisplayProtocolTest, ParseBulkCommands) {
+    std::vector<uint8_t> polyline;
+    encodeDrawPolyline({ { 1, -2 }, { 300, 400 }, { -5, 6 } }, 0xF81F, polyline);
+    std::vector<uint8_t> span;
+    encodeDrawPixelSpan(-7, 9, { 0x0001, 0xABCD }, span);
+    std::vector<uint8_t> boxes;
+    encodeFillRectangles({ { 1, 2, 3, 4 }, { -5, 6, 70, 80 } }, 0x07E0, boxes);
+    ASSERT_EQ(polyline.size(), 5u + 3u * 4u);
+    ASSERT_EQ(span.size(), 7u + 2u * 2u);
+    ASSERT_EQ(boxes.size(), 5u + 2u * 8u);
+
+    DisplayProtocol protocol;
+    BulkCommandView command = protocol.parseBulkCommand(polyline.data(), polyline.size());
+    ASSERT_EQ(command.opcode, DRAW_POLYLINE_OPCODE);
+    EXPECT_EQ(command.color, 0xF81F);
+    ASSERT_EQ(command.points.size(), 3u);
+    EXPECT_EQ(command.points[0].x, 1);
+    EXPECT_EQ(command.points[0].y, -2);
+    EXPECT_EQ(command.points[1].x, 300);
+    EXPECT_EQ(command.points[2].x, -5);
+
+    command = protocol.parseBulkCommand(span.data(), span.size());
+    ASSERT_EQ(command.opcode, DRAW_PIXEL_SPAN_OPCODE);
+    EXPECT_EQ(command.x, -7);
+    EXPECT_EQ(command.y, 9);
+    ASSERT_EQ(command.colors.size(), 2u);
+    EXPECT_EQ(command.colors[1], 0xABCD);
+
+    command = protocol.parseBulkCommand(boxes.data(), boxes.size());
+    ASSERT_EQ(command.opcode, FILL_RECTANGLES_OPCODE);
+    EXPECT_EQ(command.color, 0x07E0);
+    ASSERT_EQ(command.boxes.size(), 2u);
+    EXPECT_EQ(command.boxes[1].x, -5);
+    EXPECT_EQ(command.boxes[1].height, 80);
+
+    // The views read the datagram in place rather than copying it.
+    boxes[boxes.size() - 2] = 90;
+    EXPECT_EQ(command.boxes[1].height, 90);
+}
+
+TEST(DisplayProtocolTest, RejectMalformedBulkCommands) {
+    std::vector<uint8_t> polyline;
+    encodeDrawPolyline({ { 1, 2 }, { 3, 4 } }, 0xFFFF, polyline);
+    std::vector<uint8_t> empty;
+    encodeFillRectangles({}, 0xFFFF, empty);
+    uint8_t header[] = { DRAW_PIXEL_SPAN_OPCODE, 0, 0, 0, 0, 1 };
+
+    DisplayProtocol protocol;
+    EXPECT_EQ(protocol.parseBulkCommand(empty.data(), empty.size()).boxes.size(), 0u);
+    EXPECT_THROW(protocol.parseBulkCommand(polyline.data(), polyline.size() - 1), std::invalid_argument);
+    std::vector<uint8_t> longer = polyline;
+    longer.push_back(0);
+    EXPECT_THROW(protocol.parseBulkCommand(longer.data(), longer.size()), std::invalid_argument);
+    // A count claiming more elements than the datagram holds.
+    polyline[1] = 200;
+    EXPECT_THROW(protocol.parseBulkCommand(polyline.data(), polyline.size()), std::invalid_argument);
+    EXPECT_THROW(protocol.parseBulkCommand(header, sizeof(header)), std::invalid_argument);
+    EXPECT_THROW(protocol.parseBulkCommand(polyline.data(), 0), std::invalid_argument);
+
+    uint8_t pixel[] = { DRAW_PIXEL_OPCODE, 0, 0, 0, 0, 0, 0 };
+    EXPECT_THROW(protocol.parseBulkCommand(pixel, sizeof(pixel)), std::invalid_argument);
+    EXPECT_THROW(protocol.parseCommand(empty), std::invalid_argument);
+}
+
+TEST(DisplayProtocolTest, ParseCommandsIntoArena) {
+    DisplayProtocol protocol;
+    CommandArena arena(64);
+    std::vector<Command*> commands;
+    for (int16_t i = 0; i < 10; ++i) {
+        Command* cmd = nullptr;
+        protocol.parseCommand({ DRAW_LINE_OPCODE, static_cast<uint8_t>(i), 0x00, 0x02, 0x00, 0x03, 0x00, 0x04, 0x00, 0xAA, 0xBB }, cmd, arena);
+        commands.push_back(cmd);
+    }
+    Command* cmd = nullptr;
+    EXPECT_THROW(protocol.parseCommand({ DRAW_LINE_OPCODE, 0x01 }, cmd, arena), std::invalid_argument);
+    EXPECT_EQ(arena.objects(), 10u);
+
+    for (int16_t i = 0; i < 10; ++i) {
+        ASSERT_EQ(commands[i]->opcode, DRAW_LINE_OPCODE);
+        const DrawLine* line = static_cast<const DrawLine*>(commands[i]);
+        EXPECT_EQ(line->x0, i);
+        EXPECT_EQ(line->y1, 4);
+        EXPECT_EQ(line->color, 0xAABB);
+    }
+
+    // Reset hands the same blocks out again.
+    size_t blocks = arena.blockAllocations();
+    EXPECT_GT(blocks, 1u);
+    arena.reset();
+    protocol.parseCommand({ CLEAR_DISPLAY_OPCODE, 0x12, 0x34 }, cmd, arena);
+    EXPECT_EQ(static_cast<void*>(cmd), static_cast<void*>(commands[0]));
+    EXPECT_EQ(static_cast<ClearDisplay*>(cmd)->color, 0x1234);
+    EXPECT_EQ(arena.objects(), 1u);
+    EXPECT_EQ(arena.blockAllocations(), blocks);
+}
+
+TEST(DisplayProtocolTest, TryParseReportsStatus) {
+    DisplayProtocol protocol;
+    CommandData command;
+    const char* message = nullptr;
+    EXPECT_EQ(protocol.tryParseCommand(nullptr, 0, command, &message), PARSE_EMPTY_INPUT);
+    EXPECT_STREQ(message, "Empty byte array");
+
+    uint8_t unknown[] = { 0x63, 0x00 };
+    EXPECT_EQ(protocol.tryParseCommand(unknown, sizeof(unknown), command), PARSE_UNKNOWN_OPCODE);
+
+    uint8_t truncated[] = { DRAW_LINE_OPCODE, 0x01, 0x00, 0x02 };
+    EXPECT_EQ(protocol.tryParseCommand(truncated, sizeof(truncated), command), PARSE_INVALID_LENGTH);
+    EXPECT_EQ(command.opcode, DRAW_LINE_OPCODE);
+    EXPECT_EQ(parseErrorReason(PARSE_INVALID_LENGTH), INVALID_LENGTH_ERROR);
+
+    uint8_t pixel[] = { DRAW_PIXEL_OPCODE, 0x05, 0x00, 0x06, 0x00, 0xAA, 0xBB };
+    ASSERT_EQ(protocol.tryParseCommand(pixel, sizeof(pixel), command), PARSE_OK);
+    EXPECT_EQ(command.opcode, DRAW_PIXEL_OPCODE);
+    EXPECT_EQ(command.drawPixel.x0, 5);
+    EXPECT_EQ(command.drawPixel.color, 0xAABB);
+
+    uint8_t batch[] = { BATCH_MARKER, 0x02, 0x00, CLEAR_DISPLAY_OPCODE, 0x00, 0x00, DRAW_PIXEL_OPCODE, 0x01 };
+    CommandBuffer buffer;
+    size_t count = 0;
+    EXPECT_EQ(protocol.tryParseBatch(batch, sizeof(batch), buffer, count), PARSE_MALFORMED_BATCH);
+    EXPECT_EQ(buffer.size(), 0u);
+
+    BulkCommandView view;
+    uint8_t bulk[] = { DRAW_POLYLINE_OPCODE };
+    EXPECT_EQ(protocol.tryParseBulkCommand(bulk, sizeof(bulk), view), PARSE_INVALID_LENGTH);
+
+    // The throwing API reports the same failures.
+    EXPECT_THROW(protocol.parseCommand(truncated, sizeof(truncated)), std::invalid_argument);
+    EXPECT_THROW(protocol.parseBatch(batch, sizeof(batch), buffer), std::invalid_argument);
+}
+
+TEST(DisplayProtocolTest, RecordKernelsMatchParser) {
+    std::mt19937 random(42);
+    for (int level = SCALAR_RECORD_DECODE; level <= detectRecordDecodeLevel(); ++level) {
+        RecordDecodeFunction kernel = recordDecodeKernel(static_cast<RecordDecodeLevel>(level));
+        for (size_t count : { 0, 1, 7, 8, 9, 15, 16, 17, 23, 24, 25, 31, 32, 33, 100 }) {
+            std::vector<uint8_t> records(count * GEOMETRY_RECORD_SIZE);
+            for (size_t i = 0; i < records.size(); ++i) {
+                records[i] = i % GEOMETRY_RECORD_SIZE == 0 ? static_cast<uint8_t>(FILL_RECTANGLE_OPCODE) : static_cast<uint8_t>(random());
+            }
+            // Guard values past each column catch overlong stores.
+            std::vector<int16_t> x0(count + 16, 0x5A5A), y0(count + 16, 0x5A5A), x1(count + 16, 0x5A5A), y1(count + 16, 0x5A5A);
+            std::vector<uint16_t> color(count + 16, 0x5A5A);
+            kernel(records.data(), count, { x0.data(), y0.data(), x1.data(), y1.data(), color.data() });
+
+            DisplayProtocol protocol;
+            for (size_t i = 0; i < count; ++i) {
+                CommandData command;
+                ASSERT_EQ(protocol.tryParseCommand(records.data() + i * GEOMETRY_RECORD_SIZE, GEOMETRY_RECORD_SIZE, command), PARSE_OK);
+                const FillRectangleData& expected = command.fillRectangle;
+                ASSERT_EQ(x0[i], expected.x) << recordDecodeLevelName(static_cast<RecordDecodeLevel>(level)) << " count " << count << " record " << i;
+                ASSERT_EQ(y0[i], expected.y);
+                ASSERT_EQ(x1[i], expected.width);
+                ASSERT_EQ(y1[i], expected.height);
+                ASSERT_EQ(color[i], expected.color);
+            }
+            for (size_t i = count; i < count + 16; ++i) {
+                ASSERT_EQ(x0[i], 0x5A5A);
+                ASSERT_EQ(color[i], 0x5A5A);
+            }
+        }
+    }
+}
+
+TEST(DisplayProtocolTest, BatchRunsMatchSingleCommands) {
+    std::mt19937 random(7);
+    std::vector<CommandData> commands;
+    for (int i = 0; i < 300; ++i) {
+        CommandData command;
+        command.opcode = i % 50 < 40 ? DRAW_LINE_OPCODE : (i % 7 == 0 ? DRAW_PIXEL_OPCODE : FILL_ELLIPSE_OPCODE);
+        if (command.opcode == DRAW_PIXEL_OPCODE) {
+            command.drawPixel = { static_cast<int16_t>(random()), static_cast<int16_t>(random()), static_cast<uint16_t>(random()) };
+        }
+        else {
+            command.drawLine = { static_cast<int16_t>(random()), static_cast<int16_t>(random()), static_cast<int16_t>(random()),
+                static_cast<int16_t>(random()), static_cast<uint16_t>(random()) };
+        }
+        commands.push_back(command);
+    }
+    std::vector<uint8_t> batch;
+    encodeBatch(commands, batch);
+
+    DisplayProtocol protocol;
+    CommandBuffer buffer;
+    ASSERT_EQ(protocol.parseBatch(batch, buffer), commands.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+        CommandBuffer expected;
+        expected.push(commands[i]);
+        ASSERT_EQ(buffer.opcode[i], expected.opcode[0]) << "command " << i;
+        ASSERT_EQ(buffer.x0[i], expected.x0[0]);
+        ASSERT_EQ(buffer.y0[i], expected.y0[0]);
+        ASSERT_EQ(buffer.x1[i], expected.x1[0]);
+        ASSERT_EQ(buffer.y1[i], expected.y1[0]);
+        ASSERT_EQ(buffer.color[i], expected.color[0]);
+    }
+
+    // A run cut short by the end of the datagram is still rejected whole.
+    batch.pop_back();
+    buffer.clear();
+    EXPECT_THROW(protocol.parseBatch(batch, buffer), std::invalid_argument);
+    EXPECT_EQ(buffer.size(), 0u);
+}
@@ -0,0 +1,255 @@
+// Linux display protocol server: receives datagrams on SERVER_PORT with
+// recvmmsg or io_uring, decodes them through DisplayProtocol and draws them into a
+// headless framebuffer, either inline or on a separate render thread fed
+// through a lock-free ring. --capture records every datagram for replay;
+// --export publishes presented frames in shared memory for other processes.
+//
+// Build: g++ -std=c++17 -O2 -pthread Server.cpp -o display_server
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <csignal>
+#include <cerrno>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "../display_protocol/capture_log.h"
+#include "datagram_handler.h"
+#include "receivers.h"
+#include "shared_memory.h"
+
+#define SERVER_PORT 777
+
+struct ServerOptions {
+    uint16_t port = SERVER_PORT;
+    unsigned batchSize = 64;
+    int receiveBufferSize = 4 << 20;
+    unsigned reportInterval = 1;
+    int width = 800;
+    int height = 480;
+    unsigned renderQueue = 0;
+    unsigned uringBuffers = 0;
+    unsigned uringBufferSize = 2048;
+    std::string capturePath;
+    std::string exportName;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void stopServer(int) {
+    running = 0;
+}
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--port N] [--batch N] [--rcvbuf BYTES] [--interval SECONDS] [--width N] [--height N] [--render-queue COMMANDS] [--io-uring BUFFERS] [--uring-buffer BYTES] [--capture FILE] [--export SHM_NAME]" << std::endl;
+}
+
+static bool parseOptions(int argc, char** argv, ServerOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string name = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (name == "--capture") {
+            options.capturePath = argv[++i];
+            continue;
+        }
+        if (name == "--export") {
+            options.exportName = argv[++i];
+            continue;
+        }
+        long value = std::strtol(argv[++i], nullptr, 10);
+        if (name == "--port" && value > 0 && value <= 65535) {
+            options.port = static_cast<uint16_t>(value);
+        }
+        else if (name == "--batch" && value > 0 && value <= 1024) {
+            options.batchSize = static_cast<unsigned>(value);
+        }
+        else if (name == "--rcvbuf" && value > 0) {
+            options.receiveBufferSize = static_cast<int>(value);
+        }
+        else if (name == "--interval" && value > 0) {
+            options.reportInterval = static_cast<unsigned>(value);
+        }
+        else if (name == "--width" && value > 0 && value <= 32767) {
+            options.width = static_cast<int>(value);
+        }
+        else if (name == "--height" && value > 0 && value <= 32767) {
+            options.height = static_cast<int>(value);
+        }
+        else if (name == "--render-queue" && value >= 0 && value <= (1 << 24)) {
+            options.renderQueue = static_cast<unsigned>(value);
+        }
+        else if (name == "--io-uring" && value >= 0 && value <= 32768 && (value & (value - 1)) == 0) {
+            options.uringBuffers = static_cast<unsigned>(value);
+        }
+        else if (name == "--uring-buffer" && value > 0 && value <= static_cast<long>(MAX_DATAGRAM_SIZE)) {
+            options.uringBufferSize = static_cast<unsigned>(value);
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void report(const ServerStats& stats, ServerStats& last, double seconds) {
+    uint64_t packets = stats.packets - last.packets;
+    uint64_t calls = stats.syscalls - last.syscalls;
+    std::cout << "packets/s: " << static_cast<uint64_t>(packets / seconds)
+        << ", commands/s: " << static_cast<uint64_t>((stats.commands - last.commands) / seconds)
+        << ", MB/s: " << (stats.bytes - last.bytes) / seconds / 1e6
+        << ", errors: " << stats.errors - last.errors
+        << ", packets/syscall: " << (calls ? static_cast<double>(packets) / calls : 0.0) << std::endl;
+    last = stats;
+}
+
+// Receives until SIGINT/SIGTERM with either receiver and reports periodically.
+template <typename Receiver>
+static void serve(Receiver& receiver, DatagramHandler& handler, CaptureWriter* capture, const ServerOptions& options, ServerStats& stats) {
+    ServerStats last;
+    auto lastReport = std::chrono::steady_clock::now();
+    while (running) {
+        int received = receiver.receive([&](const uint8_t* data, size_t size) {
+            if (capture) {
+                // A full disk ends the capture, not the server.
+                try {
+                    capture->append(data, size);
+                }
+                catch (const std::exception& error) {
+                    std::cerr << error.what() << ", capture stopped" << std::endl;
+                    capture = nullptr;
+                }
+            }
+            handler.handle(data, size, stats);
+            stats.bytes += size;
+        });
+        if (received < 0) {
+            std::cerr << "Receive failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        handler.presentUnframed();
+        stats.packets += received;
+        stats.syscalls = receiver.syscalls();
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastReport).count();
+        if (elapsed >= options.reportInterval) {
+            report(stats, last, elapsed);
+            lastReport = now;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    ServerOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    int serverSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (serverSocket < 0) {
+        std::cerr << "Socket creation failed: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    if (setsockopt(serverSocket, SOL_SOCKET, SO_RCVBUF, &options.receiveBufferSize, sizeof(options.receiveBufferSize)) != 0) {
+        std::cerr << "SO_RCVBUF failed: " << std::strerror(errno) << std::endl;
+    }
+    int actualBufferSize = 0;
+    socklen_t optionLength = sizeof(actualBufferSize);
+    getsockopt(serverSocket, SOL_SOCKET, SO_RCVBUF, &actualBufferSize, &optionLength);
+
+    // Wake up periodically so reports and shutdown happen on an idle socket.
+    timeval timeout = { 0, RECEIVE_TIMEOUT_MS * 1000 };
+    setsockopt(serverSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    sockaddr_in serverAddr = {};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(options.port);
+    serverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(serverSocket, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) != 0) {
+        std::cerr << "Bind failed: " << std::strerror(errno) << std::endl;
+        close(serverSocket);
+        return 1;
+    }
+
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+
+    std::cout << "Listening on port " << options.port << ", batch " << options.batchSize
+        << ", receive buffer " << actualBufferSize << " bytes" << std::endl;
+
+    std::unique_ptr<SharedMemory> exportMemory;
+    std::unique_ptr<FrameExportWriter> exported;
+    if (!options.exportName.empty()) {
+        try {
+            exportMemory.reset(new SharedMemory(SharedMemory::create(options.exportName, frameExportSize(options.width, options.height))));
+            exported.reset(new FrameExportWriter(exportMemory->data(), exportMemory->size(), options.width, options.height));
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << std::endl;
+            close(serverSocket);
+            return 1;
+        }
+        std::cout << "Exporting frames to " << options.exportName;
+        if (options.exportName[0] != '/') {
+            std::cout << " (/proc/" << getpid() << "/fd/" << exportMemory->descriptor() << ")";
+        }
+        std::cout << std::endl;
+    }
+
+    std::unique_ptr<RenderThread> renderThread;
+    if (options.renderQueue > 0) {
+        renderThread.reset(new RenderThread(options.width, options.height, options.renderQueue, exported.get()));
+    }
+    DatagramHandler handler(options.width, options.height, renderThread ? &renderThread->queue() : nullptr, exported.get());
+    std::unique_ptr<CaptureWriter> capture;
+    if (!options.capturePath.empty()) {
+        try {
+            capture.reset(new CaptureWriter(options.capturePath));
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << std::endl;
+            close(serverSocket);
+            return 1;
+        }
+    }
+
+    ServerStats stats;
+    std::unique_ptr<UringReceiver> uring;
+    if (options.uringBuffers > 0) {
+        try {
+            uring.reset(new UringReceiver(serverSocket, options.uringBuffers, options.uringBufferSize));
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << ", falling back to recvmmsg" << std::endl;
+        }
+    }
+    if (uring) {
+        std::cout << "Receiving with io_uring, " << options.uringBuffers << " buffers of " << options.uringBufferSize << " bytes" << std::endl;
+        serve(*uring, handler, capture.get(), options, stats);
+    }
+    else {
+        RecvmmsgReceiver receiver(serverSocket, options.batchSize);
+        serve(receiver, handler, capture.get(), options, stats);
+    }
+
+    close(serverSocket);
+    std::cout << "Total packets: " << stats.packets << ", commands: " << stats.commands
+        << ", errors: " << stats.errors << ", lost compact batches: " << stats.lostBatches << std::endl;
+    if (!renderThread) {
+        std::cout << "ellipse cache hit rate: " << handler.ellipseCache()->hitRate() << std::endl;
+    }
+#if DISPLAY_PROTOCOL_METRICS
+    std::cout << "metrics: " << MetricsRegistry::instance().snapshot().toJson() << std::endl;
+#endif
+    return 0;
+}
@@ -0,0 +1,190 @@
+#pragma once
+#ifndef DATAGRAM_HANDLER_H
+#define DATAGRAM_HANDLER_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include "../display_protocol/display_protocol.h"
+#include "../display_protocol/frame_chain.h"
+#include "../display_protocol/spsc_ring.h"
+
+struct ServerStats {
+    uint64_t packets = 0;
+    uint64_t commands = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    uint64_t syscalls = 0;
+    // Compact batches skipped in the sender's sequence numbering.
+    uint64_t lostBatches = 0;
+};
+
+// Drains commands queued by the receive thread and draws them, so a slow
+// frame does not stall recvmmsg and overflow the socket buffer. Commands
+// outside BeginFrame/EndFrame are presented whenever the queue runs dry.
+class RenderThread {
+public:
+    RenderThread(int width, int height, size_t capacity, FrameExportWriter* exported = nullptr)
+        : ring(capacity), frames(width, height, exported), worker([this] { run(); }) {
+    }
+
+    ~RenderThread() {
+        stop = true;
+        ring.wake();
+        worker.join();
+    }
+
+    SpscRing<CommandData>& queue() {
+        return ring;
+    }
+
+private:
+    void run() {
+        const size_t BATCH = 256;
+        CommandData batch[BATCH];
+        size_t count;
+        while ((count = ring.popUntilWoken(batch, BATCH, stop)) > 0) {
+            for (size_t i = 0; i < count; ++i) {
+                frames.execute(batch[i]);
+            }
+            if (count < BATCH && !frames.inFrame() && frames.dirty()) {
+                frames.present();
+            }
+        }
+    }
+
+    SpscRing<CommandData> ring;
+    FrameChain frames;
+    std::atomic<bool> stop{ false };
+    std::thread worker;
+};
+
+// Decodes datagrams into a CommandBuffer that is reused for every packet and
+// draws them, or hands them to renderQueue when one is given, so
+// steady-state handling does not allocate. Inline rendering publishes its
+// frames to exported when one is given. Only inline rendering owns frame
+// buffers; with a render queue they live in the render thread.
+class DatagramHandler {
+public:
+    DatagramHandler(int width, int height, SpscRing<CommandData>* renderQueue = nullptr, FrameExportWriter* exported = nullptr)
+        : renderQueue(renderQueue) {
+        if (renderQueue == nullptr) {
+            frames.reset(new FrameChain(width, height, exported));
+        }
+        buffer.reserve(1024);
+        pending.reserve(1024);
+    }
+
+    void handle(const uint8_t* data, size_t size, ServerStats& stats) {
+        buffer.clear();
+        if (size > 0 && isBulkOpcode(data[0])) {
+            handleBulk(data, size, stats);
+            return;
+        }
+        // Malformed datagrams are common on UDP; the status API rejects
+        // them without unwinding.
+        ParseStatus status;
+        size_t count;
+        if (size > 0 && data[0] == BATCH_MARKER) {
+            status = protocol.tryParseBatch(data, size, buffer, count);
+        }
+        else if (size > 0 && data[0] == COMPACT_BATCH_MARKER) {
+            uint32_t sequence;
+            status = protocol.tryParseCompactBatch(data, size, buffer, count, &sequence);
+            if (status == PARSE_OK) {
+                trackSequence(sequence, stats);
+            }
+        }
+        else {
+            CommandData command;
+            status = protocol.tryParseCommand(data, size, command);
+            if (status == PARSE_OK) {
+                buffer.push(command);
+            }
+        }
+        if (status != PARSE_OK) {
+            ++stats.errors;
+        }
+        stats.commands += buffer.size();
+        if (renderQueue == nullptr) {
+            frames->execute(buffer);
+            return;
+        }
+        pending.clear();
+        for (size_t i = 0; i < buffer.size(); ++i) {
+            pending.push_back(buffer.at(i));
+        }
+        renderQueue->push(pending.data(), pending.size());
+    }
+
+    // Presents what inline rendering drew outside BeginFrame/EndFrame.
+    // Called once per receive call rather than per datagram, so senders
+    // that never mark frames do not pay for a present per command.
+    void presentUnframed() {
+        if (frames && !frames->inFrame() && frames->dirty()) {
+            frames->present();
+        }
+    }
+
+    const CommandBuffer& commands() const {
+        return buffer;
+    }
+
+    // The newest frame inline rendering presented; null when a render
+    // queue is used.
+    const Framebuffer* surface() const {
+        return frames ? &frames->latest() : nullptr;
+    }
+
+    // Ellipse table cache of inline rendering; null when a render queue is
+    // used.
+    const EllipseSpanCache* ellipseCache() const {
+        return frames ? &frames->ellipseCache() : nullptr;
+    }
+
+private:
+    // Bulk commands are drawn straight from views into the datagram; only
+    // a render queue, which holds CommandData, needs them expanded.
+    void handleBulk(const uint8_t* data, size_t size, ServerStats& stats) {
+        BulkCommandView command;
+        if (protocol.tryParseBulkCommand(data, size, command) != PARSE_OK) {
+            ++stats.errors;
+            return;
+        }
+        ++stats.commands;
+        if (renderQueue == nullptr) {
+            frames->execute(command);
+            return;
+        }
+        pending.clear();
+        expandBulkCommand(command, pending);
+        renderQueue->push(pending.data(), pending.size());
+    }
+
+    // A jump forward counts the skipped batches as lost. A batch from
+    // behind the expected sequence arrived late; it was already counted as
+    // lost and does not move the expectation.
+    void trackSequence(uint32_t sequence, ServerStats& stats) {
+        uint32_t gap = sequence - nextSequence;
+        if (haveSequence && gap >= (1u << 31)) {
+            return;
+        }
+        if (haveSequence) {
+            stats.lostBatches += gap;
+        }
+        haveSequence = true;
+        nextSequence = sequence + 1;
+    }
+
+    DisplayProtocol protocol;
+    CommandBuffer buffer;
+    std::unique_ptr<FrameChain> frames;
+    SpscRing<CommandData>* renderQueue;
+    std::vector<CommandData> pending;
+    uint32_t nextSequence = 0;
+    bool haveSequence = false;
+};
+
+#endif // DATAGRAM_HANDLER_H
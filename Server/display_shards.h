@@ -0,0 +1,267 @@
+#pragma once
+#ifndef DISPLAY_SHARDS_H
+#define DISPLAY_SHARDS_H
+
+// Many independent displays served by one process, one epoll loop per
+// shard thread. Every display belongs to exactly one shard, display % the
+// shard count, and only that shard's thread ever parses or draws for it,
+// so shards share nothing and take no locks.
+//
+// A datagram reaches its display in one of two ways:
+//   DISPLAY_BY_PORT    display d listens on its own port, basePort + d;
+//                      only the owning shard opens it.
+//   DISPLAY_BY_HEADER  every display shares basePort and each datagram
+//                      starts with a display id byte ahead of the usual
+//                      payload. Every shard binds the port with
+//                      SO_REUSEPORT, and a classic BPF program on the group
+//                      picks the socket from the id byte, so the kernel
+//                      delivers a display's datagrams to its owner.
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/filter.h>
+#include <unistd.h>
+#include "datagram_handler.h"
+#include "receivers.h"
+
+enum DisplaySelection {
+    DISPLAY_BY_PORT,
+    DISPLAY_BY_HEADER
+};
+
+// Display ids are one byte on the wire.
+const unsigned MAX_DISPLAYS = 256;
+
+struct ShardOptions {
+    uint16_t basePort = 7000;
+    unsigned displays = 1;
+    unsigned shards = 1;
+    DisplaySelection selection = DISPLAY_BY_PORT;
+    int width = 800;
+    int height = 480;
+    unsigned batchSize = 32;
+    int receiveBufferSize = 4 << 20;
+    // Pin shard i to CPU i modulo the CPU count.
+    bool pin = true;
+};
+
+inline unsigned displayShard(unsigned display, unsigned shards) {
+    return display % shards;
+}
+
+// Opens a non-blocking UDP socket bound to port on all interfaces.
+inline int openDisplaySocket(uint16_t port, bool reusePort, int receiveBufferSize) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Socket creation failed: ") + std::strerror(errno));
+    }
+    int one = 1;
+    if (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error(std::string("SO_REUSEPORT failed: ") + std::strerror(error));
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error("Bind to port " + std::to_string(port) + " failed: " + std::strerror(error));
+    }
+    return fd;
+}
+
+// Steers each datagram of a SO_REUSEPORT group to socket id % shards, the
+// sockets numbered in bind order. The program sees the UDP payload at
+// offset 0; for an empty datagram the load fails and the program returns
+// 0, so shard 0 gets it and rejects it.
+inline void steerByDisplayId(int fd, unsigned shards) {
+    sock_filter code[] = {
+        { BPF_LD | BPF_B | BPF_ABS, 0, 0, 0 },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, shards },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    sock_fprog program = { static_cast<unsigned short>(sizeof(code) / sizeof(code[0])), code };
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) != 0) {
+        throw std::runtime_error(std::string("SO_ATTACH_REUSEPORT_CBPF failed: ") + std::strerror(errno));
+    }
+}
+
+// One shard: its sockets, the displays it owns and the thread running its
+// epoll loop. Counters are written by the shard thread only and may be read
+// from any thread.
+class DisplayShard {
+public:
+    DisplayShard(unsigned index, const ShardOptions& options)
+        : index(index), options(options), receiver(-1, options.batchSize), displays(options.displays) {
+        epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll < 0) {
+            throw std::runtime_error(std::string("epoll_create1 failed: ") + std::strerror(errno));
+        }
+        for (unsigned display = 0; display < options.displays; ++display) {
+            if (displayShard(display, options.shards) == index) {
+                displays[display].reset(new DatagramHandler(options.width, options.height));
+            }
+        }
+    }
+
+    DisplayShard(const DisplayShard&) = delete;
+    DisplayShard& operator=(const DisplayShard&) = delete;
+
+    ~DisplayShard() {
+        stop();
+        for (const Source& source : sources) {
+            close(source.fd);
+        }
+        close(epoll);
+    }
+
+    // Watches fd, which receives datagrams for display, or for the display
+    // named in each datagram's first byte when display is HEADER_DISPLAY.
+    // Takes ownership of fd.
+    void addSocket(int fd, unsigned display) {
+        sources.push_back({ fd, display });
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u32 = static_cast<uint32_t>(sources.size() - 1);
+        if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            throw std::runtime_error(std::string("epoll_ctl failed: ") + std::strerror(errno));
+        }
+    }
+
+    void start() {
+        worker = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        stopping = true;
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    uint64_t packets() const { return packetCount.load(std::memory_order_relaxed); }
+    uint64_t commands() const { return commandCount.load(std::memory_order_relaxed); }
+    uint64_t errors() const { return errorCount.load(std::memory_order_relaxed); }
+
+    // Display state; only to be inspected once the shard has stopped.
+    const DatagramHandler* display(unsigned display) const {
+        return display < displays.size() ? displays[display].get() : nullptr;
+    }
+
+    static const unsigned HEADER_DISPLAY = MAX_DISPLAYS;
+
+private:
+    struct Source {
+        int fd;
+        unsigned display;
+    };
+
+    void run() {
+        if (options.pin) {
+            unsigned cpus = std::thread::hardware_concurrency();
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus ? index % cpus : 0, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+        const int MAX_EVENTS = 64;
+        epoll_event events[MAX_EVENTS];
+        std::vector<bool> touched(displays.size());
+        while (!stopping.load(std::memory_order_relaxed)) {
+            int ready = epoll_wait(epoll, events, MAX_EVENTS, RECEIVE_TIMEOUT_MS);
+            for (int i = 0; i < ready; ++i) {
+                const Source& source = sources[events[i].data.u32];
+                receiver.receive(source.fd, [&](const uint8_t* data, size_t size) {
+                    unsigned display = source.display;
+                    if (display == HEADER_DISPLAY) {
+                        display = size > 0 ? data[0] : MAX_DISPLAYS;
+                        ++data;
+                        size = size > 0 ? size - 1 : 0;
+                    }
+                    ++stats.packets;
+                    if (display >= displays.size() || !displays[display]) {
+                        ++stats.errors;
+                        return;
+                    }
+                    displays[display]->handle(data, size, stats);
+                    touched[display] = true;
+                });
+            }
+            // As in the single-display server, unframed drawing is
+            // presented once per wakeup rather than per datagram.
+            for (size_t display = 0; display < touched.size(); ++display) {
+                if (touched[display]) {
+                    displays[display]->presentUnframed();
+                    touched[display] = false;
+                }
+            }
+            packetCount.store(stats.packets, std::memory_order_relaxed);
+            commandCount.store(stats.commands, std::memory_order_relaxed);
+            errorCount.store(stats.errors, std::memory_order_relaxed);
+        }
+    }
+
+    unsigned index;
+    ShardOptions options;
+    int epoll;
+    RecvmmsgReceiver receiver;
+    std::vector<Source> sources;
+    std::vector<std::unique_ptr<DatagramHandler>> displays;
+    ServerStats stats;
+    std::atomic<uint64_t> packetCount{ 0 };
+    std::atomic<uint64_t> commandCount{ 0 };
+    std::atomic<uint64_t> errorCount{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::thread worker;
+};
+
+// Creates the shards and their sockets. In DISPLAY_BY_HEADER mode the
+// shards join the SO_REUSEPORT group in index order, which is the order
+// steerByDisplayId numbers them in.
+inline std::vector<std::unique_ptr<DisplayShard>> openDisplayShards(const ShardOptions& options) {
+    if (options.displays == 0 || options.displays > MAX_DISPLAYS || options.shards == 0) {
+        throw std::invalid_argument("Invalid display or shard count");
+    }
+    if (options.selection == DISPLAY_BY_PORT && options.basePort + options.displays - 1 > 65535) {
+        throw std::invalid_argument("Display ports exceed 65535");
+    }
+    std::vector<std::unique_ptr<DisplayShard>> shards;
+    for (unsigned i = 0; i < options.shards; ++i) {
+        shards.emplace_back(new DisplayShard(i, options));
+    }
+    if (options.selection == DISPLAY_BY_PORT) {
+        for (unsigned display = 0; display < options.displays; ++display) {
+            int fd = openDisplaySocket(static_cast<uint16_t>(options.basePort + display), false, options.receiveBufferSize);
+            shards[displayShard(display, options.shards)]->addSocket(fd, display);
+        }
+    }
+    else {
+        for (unsigned i = 0; i < options.shards; ++i) {
+            int fd = openDisplaySocket(options.basePort, true, options.receiveBufferSize);
+            shards[i]->addSocket(fd, DisplayShard::HEADER_DISPLAY);
+            if (i == 0) {
+                steerByDisplayId(fd, options.shards);
+            }
+        }
+    }
+    return shards;
+}
+
+#endif // DISPLAY_SHARDS_H
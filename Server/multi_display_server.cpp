@@ -0,0 +1,128 @@
+// Linux server for many displays at once: --displays independent surfaces
+// spread over --shards epoll threads (see display_shards.h). Displays are
+// addressed by port (--port + display) or, with --select header, by an id
+// byte in front of each datagram on --port.
+//
+// Build: g++ -std=c++17 -O2 -pthread multi_display_server.cpp -o multi_display_server
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <cstdlib>
+#include "display_shards.h"
+
+static volatile sig_atomic_t running = 1;
+
+static void stopServer(int) {
+    running = 0;
+}
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--port N] [--displays N] [--shards N] [--select port|header] [--width N] [--height N] [--batch N] [--interval SECONDS] [--no-pin]" << std::endl;
+}
+
+static bool parseOptions(int argc, char** argv, ShardOptions& options, unsigned& interval) {
+    for (int i = 1; i < argc; ++i) {
+        std::string name = argv[i];
+        if (name == "--no-pin") {
+            options.pin = false;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (name == "--select") {
+            std::string mode = argv[++i];
+            if (mode != "port" && mode != "header") {
+                return false;
+            }
+            options.selection = mode == "port" ? DISPLAY_BY_PORT : DISPLAY_BY_HEADER;
+            continue;
+        }
+        long value = std::strtol(argv[++i], nullptr, 10);
+        if (name == "--port" && value > 0 && value <= 65535) {
+            options.basePort = static_cast<uint16_t>(value);
+        }
+        else if (name == "--displays" && value > 0 && value <= static_cast<long>(MAX_DISPLAYS)) {
+            options.displays = static_cast<unsigned>(value);
+        }
+        else if (name == "--shards" && value > 0 && value <= 1024) {
+            options.shards = static_cast<unsigned>(value);
+        }
+        else if (name == "--width" && value > 0 && value <= 32767) {
+            options.width = static_cast<int>(value);
+        }
+        else if (name == "--height" && value > 0 && value <= 32767) {
+            options.height = static_cast<int>(value);
+        }
+        else if (name == "--batch" && value > 0 && value <= 1024) {
+            options.batchSize = static_cast<unsigned>(value);
+        }
+        else if (name == "--interval" && value > 0) {
+            interval = static_cast<unsigned>(value);
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    ShardOptions options;
+    unsigned interval = 1;
+    if (!parseOptions(argc, argv, options, interval)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<DisplayShard>> shards;
+    try {
+        shards = openDisplayShards(options);
+    }
+    catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+    std::cout << "Serving " << options.displays << " displays on " << options.shards << " shards, "
+        << (options.selection == DISPLAY_BY_PORT ? "ports " + std::to_string(options.basePort) + "-" + std::to_string(options.basePort + options.displays - 1)
+            : "port " + std::to_string(options.basePort) + " with display id bytes") << std::endl;
+    for (auto& shard : shards) {
+        shard->start();
+    }
+
+    uint64_t lastPackets = 0;
+    auto lastReport = std::chrono::steady_clock::now();
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(RECEIVE_TIMEOUT_MS));
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastReport).count();
+        if (elapsed < interval) {
+            continue;
+        }
+        uint64_t packets = 0;
+        std::cout << "packets per shard:";
+        for (const auto& shard : shards) {
+            packets += shard->packets();
+            std::cout << " " << shard->packets();
+        }
+        std::cout << ", packets/s: " << static_cast<uint64_t>((packets - lastPackets) / elapsed) << std::endl;
+        lastPackets = packets;
+        lastReport = now;
+    }
+
+    uint64_t packets = 0;
+    uint64_t commands = 0;
+    uint64_t errors = 0;
+    for (auto& shard : shards) {
+        shard->stop();
+        packets += shard->packets();
+        commands += shard->commands();
+        errors += shard->errors();
+    }
+    std::cout << "Total packets: " << packets << ", commands: " << commands << ", errors: " << errors << std::endl;
+    return 0;
+}
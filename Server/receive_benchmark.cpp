@@ -0,0 +1,114 @@
+// Loopback comparison of the two receive paths: a sender thread floods a
+// socket with 11-byte FILL_RECTANGLE datagrams via sendmmsg while the
+// receiver drains it with recvmmsg or io_uring. Prints packets/s and
+// receive-side system calls per mode.
+//
+// Build: g++ -std=c++17 -O2 -pthread receive_benchmark.cpp -o receive_benchmark
+// Usage: receive_benchmark [PACKETS]
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "receivers.h"
+
+struct Loopback {
+    int receiver = -1;
+    int sender = -1;
+    sockaddr_in address = {};
+
+    Loopback() {
+        receiver = socket(AF_INET, SOCK_DGRAM, 0);
+        sender = socket(AF_INET, SOCK_DGRAM, 0);
+        int bufferSize = 8 << 20;
+        setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+        timeval timeout = { 0, RECEIVE_TIMEOUT_MS * 1000 };
+        setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(receiver, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        socklen_t length = sizeof(address);
+        getsockname(receiver, reinterpret_cast<sockaddr*>(&address), &length);
+        connect(sender, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    }
+
+    ~Loopback() {
+        close(receiver);
+        close(sender);
+    }
+};
+
+static void flood(int socket, uint64_t packets, std::atomic<bool>& done) {
+    const unsigned BURST = 64;
+    uint8_t command[11] = { 4, 10, 0, 20, 0, 30, 0, 40, 0, 0xF8, 0x00 };
+    iovec vector = { command, sizeof(command) };
+    std::vector<mmsghdr> messages(BURST);
+    for (mmsghdr& message : messages) {
+        message = {};
+        message.msg_hdr.msg_iov = &vector;
+        message.msg_hdr.msg_iovlen = 1;
+    }
+    for (uint64_t sent = 0; sent < packets;) {
+        unsigned burst = static_cast<unsigned>(packets - sent < BURST ? packets - sent : BURST);
+        int result = sendmmsg(socket, messages.data(), burst, 0);
+        if (result > 0) {
+            sent += result;
+        }
+    }
+    done = true;
+}
+
+template <typename Receiver>
+static void run(const char* name, Receiver& receiver, Loopback& loopback, uint64_t packets) {
+    std::atomic<bool> done{ false };
+    uint64_t received = 0;
+    uint64_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::thread sender(flood, loopback.sender, packets, std::ref(done));
+    while (received < packets) {
+        int count = receiver.receive([&](const uint8_t*, size_t size) { bytes += size; });
+        if (count < 0 || (count == 0 && done)) {
+            break;
+        }
+        received += count;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sender.join();
+
+    std::cout << std::left << std::setw(10) << name
+        << " packets/s: " << std::setw(10) << static_cast<uint64_t>(received / seconds)
+        << " syscalls: " << std::setw(10) << receiver.syscalls()
+        << " packets/syscall: " << std::setw(8) << std::setprecision(3) << static_cast<double>(received) / receiver.syscalls()
+        << " lost: " << packets - received << std::endl;
+}
+
+int main(int argc, char** argv) {
+    uint64_t packets = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    {
+        Loopback loopback;
+        RecvmmsgReceiver receiver(loopback.receiver, 64);
+        run("recvmmsg", receiver, loopback, packets);
+    }
+    {
+        Loopback loopback;
+        std::unique_ptr<UringReceiver> receiver;
+        try {
+            receiver.reset(new UringReceiver(loopback.receiver, 4096, 2048));
+        }
+        catch (const std::exception& error) {
+            std::cerr << "io_uring unavailable: " << error.what() << std::endl;
+            return 1;
+        }
+        run("io_uring", *receiver, loopback, packets);
+    }
+    return 0;
+}
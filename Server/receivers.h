@@ -0,0 +1,345 @@
+#pragma once
+#ifndef RECEIVERS_H
+#define RECEIVERS_H
+
+// Datagram receive loops for the Linux server: batched recvmmsg on a plain
+// socket, and io_uring multishot recvmsg over a provided buffer ring. Both
+// hand every datagram to a handler in place, without copying it.
+//
+// io_uring is driven through raw system calls so the server does not
+// depend on liburing.
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+// How long a receive call may block before returning 0, so reports and
+// shutdown still happen on an idle socket.
+const int RECEIVE_TIMEOUT_MS = 200;
+
+// Largest UDP payload over IPv4.
+const size_t MAX_DATAGRAM_SIZE = 65507;
+
+// recvmmsg with MSG_WAITFORONE into buffers that are set up once. The
+// socket must carry an SO_RCVTIMEO of RECEIVE_TIMEOUT_MS.
+class RecvmmsgReceiver {
+public:
+    RecvmmsgReceiver(int socket, unsigned batchSize)
+        : socket(socket), storage(static_cast<size_t>(batchSize) * MAX_DATAGRAM_SIZE), vectors(batchSize), messages(batchSize) {
+        for (unsigned i = 0; i < batchSize; ++i) {
+            vectors[i].iov_base = storage.data() + i * MAX_DATAGRAM_SIZE;
+            vectors[i].iov_len = MAX_DATAGRAM_SIZE;
+            messages[i] = {};
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    // Calls handler(data, size) for each datagram received. Returns the
+    // number of datagrams, 0 on timeout, or -1 with errno set on failure.
+    template <typename Handler>
+    int receive(Handler&& handler) {
+        return receive(socket, handler);
+    }
+
+    // Same, from another socket; lets one set of buffers serve every socket
+    // an epoll loop watches. On a non-blocking socket 0 means nothing was
+    // queued.
+    template <typename Handler>
+    int receive(int from, Handler&& handler) {
+        ++calls;
+        int received = recvmmsg(from, messages.data(), static_cast<unsigned>(messages.size()), MSG_WAITFORONE, nullptr);
+        if (received < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+        for (int i = 0; i < received; ++i) {
+            handler(static_cast<const uint8_t*>(vectors[i].iov_base), static_cast<size_t>(messages[i].msg_len));
+        }
+        return received;
+    }
+
+    uint64_t syscalls() const {
+        return calls;
+    }
+
+private:
+    int socket;
+    std::vector<uint8_t> storage;
+    std::vector<iovec> vectors;
+    std::vector<mmsghdr> messages;
+    uint64_t calls = 0;
+};
+
+// One multishot IORING_OP_RECVMSG keeps the socket armed; the kernel picks
+// a buffer from the registered ring for every datagram and posts a
+// completion. A single io_uring_enter both waits and reaps all completions
+// queued since the last call, and buffers go back to the ring once the
+// handler returns.
+class UringReceiver {
+public:
+    // bufferCount must be a power of two no larger than 32768. Datagrams
+    // longer than bufferSize are delivered truncated. Throws
+    // std::runtime_error when the kernel lacks the required io_uring
+    // features, multishot RECVMSG included, so callers can fall back to
+    // RecvmmsgReceiver.
+    UringReceiver(int socket, unsigned bufferCount, size_t bufferSize) : socket(socket) {
+        if (bufferCount == 0 || bufferCount > 32768 || (bufferCount & (bufferCount - 1)) != 0) {
+            throw std::invalid_argument("Buffer count must be a power of two up to 32768");
+        }
+        try {
+            setupRing();
+            setupBuffers(bufferCount, bufferSize);
+            probeMultishot();
+        }
+        catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    ~UringReceiver() {
+        release();
+    }
+
+    UringReceiver(const UringReceiver&) = delete;
+    UringReceiver& operator=(const UringReceiver&) = delete;
+
+    // Same contract as RecvmmsgReceiver::receive.
+    template <typename Handler>
+    int receive(Handler&& handler) {
+        unsigned submit = 0;
+        if (!armed) {
+            arm();
+            submit = 1;
+        }
+        if (submit > 0 || completionsReady() == 0) {
+            __kernel_timespec timeout = { 0, RECEIVE_TIMEOUT_MS * 1000000LL };
+            io_uring_getevents_arg argument = {};
+            argument.ts = reinterpret_cast<uint64_t>(&timeout);
+            ++calls;
+            long result = syscall(__NR_io_uring_enter, ringFd, submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                &argument, sizeof(argument));
+            if (result < 0 && errno != ETIME && errno != EINTR) {
+                return -1;
+            }
+        }
+
+        int datagrams = 0;
+        int failure = 0;
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& completion = cqes[head & cqMask];
+            if ((completion.flags & IORING_CQE_F_MORE) == 0) {
+                armed = false;
+            }
+            if (completion.res < 0) {
+                // Running out of buffers only ends the multishot request;
+                // it is re-armed once this batch has been recycled.
+                if (completion.res != -ENOBUFS) {
+                    failure = -completion.res;
+                }
+                continue;
+            }
+            if ((completion.flags & IORING_CQE_F_BUFFER) == 0) {
+                continue;
+            }
+            uint16_t id = static_cast<uint16_t>(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+            uint8_t* buffer = buffers.data() + static_cast<size_t>(id) * bufferStride;
+            const io_uring_recvmsg_out* out = reinterpret_cast<const io_uring_recvmsg_out*>(buffer);
+            size_t offset = sizeof(io_uring_recvmsg_out) + header.msg_namelen + header.msg_controllen;
+            size_t available = static_cast<size_t>(completion.res) - offset;
+            handler(buffer + offset, out->payloadlen < available ? out->payloadlen : available);
+            recycle(id);
+            ++datagrams;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        __atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+
+        if (datagrams == 0 && failure != 0) {
+            errno = failure;
+            return -1;
+        }
+        return datagrams;
+    }
+
+    uint64_t syscalls() const {
+        return calls;
+    }
+
+private:
+    static const uint16_t BUFFER_GROUP = 0;
+    static const unsigned SUBMISSION_ENTRIES = 8;
+    static const unsigned COMPLETION_ENTRIES = 4096;
+
+    void setupRing() {
+        io_uring_params params = {};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = COMPLETION_ENTRIES;
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, SUBMISSION_ENTRIES, &params));
+        if (ringFd < 0) {
+            throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+        }
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+            throw std::runtime_error("io_uring lacks IORING_FEAT_SINGLE_MMAP");
+        }
+
+        size_t submissionSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t completionSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ringSize = submissionSize > completionSize ? submissionSize : completionSize;
+        ring = map(ringSize, IORING_OFF_SQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(map(sqesSize, IORING_OFF_SQES));
+
+        uint8_t* base = static_cast<uint8_t*>(ring);
+        sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+    }
+
+    void setupBuffers(unsigned bufferCount, size_t bufferSize) {
+        bufferStride = sizeof(io_uring_recvmsg_out) + bufferSize;
+        buffers.resize(bufferStride * bufferCount);
+        bufferMask = bufferCount - 1;
+
+        bufferRingSize = bufferCount * sizeof(io_uring_buf);
+        void* memory = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::runtime_error(std::string("Buffer ring allocation failed: ") + std::strerror(errno));
+        }
+        bufferRing = static_cast<io_uring_buf_ring*>(memory);
+        // Not bufferRing->bufs: its flexible-array wrapper has a non-zero
+        // size in C++ and would shift every slot by eight bytes.
+        bufferSlots = static_cast<io_uring_buf*>(memory);
+
+        io_uring_buf_reg registration = {};
+        registration.ring_addr = reinterpret_cast<uint64_t>(bufferRing);
+        registration.ring_entries = bufferCount;
+        registration.bgid = BUFFER_GROUP;
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+            throw std::runtime_error(std::string("Provided buffer ring registration failed: ") + std::strerror(errno));
+        }
+        for (unsigned id = 0; id < bufferCount; ++id) {
+            recycle(static_cast<uint16_t>(id));
+        }
+        __atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+    }
+
+    void* map(size_t size, unsigned long long offset) {
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, static_cast<off_t>(offset));
+        if (memory == MAP_FAILED) {
+            throw std::runtime_error(std::string("io_uring mmap failed: ") + std::strerror(errno));
+        }
+        return memory;
+    }
+
+    void arm() {
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        io_uring_sqe& entry = sqes[index];
+        std::memset(&entry, 0, sizeof(entry));
+        entry.opcode = IORING_OP_RECVMSG;
+        entry.fd = socket;
+        entry.addr = reinterpret_cast<uint64_t>(&header);
+        entry.len = 1;
+        entry.ioprio = IORING_RECV_MULTISHOT;
+        entry.flags = IOSQE_BUFFER_SELECT;
+        entry.buf_group = BUFFER_GROUP;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        armed = true;
+    }
+
+    // Multishot RECVMSG needs Linux 6.0; older kernels take the ring and
+    // the buffer ring but fail the request with -EINVAL on submission.
+    // Arming here surfaces that while the caller can still fall back. A
+    // datagram completed meanwhile stays queued for receive().
+    void probeMultishot() {
+        arm();
+        ++calls;
+        if (syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0) < 0) {
+            throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+        if (completionsReady() > 0) {
+            const io_uring_cqe& completion = cqes[*cqHead & cqMask];
+            if (completion.res < 0 && completion.res != -ENOBUFS) {
+                throw std::runtime_error(std::string("Multishot recvmsg is not supported: ") + std::strerror(-completion.res));
+            }
+        }
+    }
+
+    unsigned completionsReady() const {
+        return __atomic_load_n(cqTail, __ATOMIC_ACQUIRE) - *cqHead;
+    }
+
+    // Queues buffer id for reuse; published by the next tail store.
+    void recycle(uint16_t id) {
+        io_uring_buf& slot = bufferSlots[bufferTail & bufferMask];
+        slot.addr = reinterpret_cast<uint64_t>(buffers.data() + static_cast<size_t>(id) * bufferStride);
+        slot.len = static_cast<uint32_t>(bufferStride);
+        slot.bid = id;
+        ++bufferTail;
+    }
+
+    void release() {
+        if (sqes != nullptr) {
+            munmap(sqes, sqesSize);
+        }
+        if (ring != nullptr) {
+            munmap(ring, ringSize);
+        }
+        if (ringFd >= 0) {
+            close(ringFd);
+        }
+        if (bufferRing != nullptr) {
+            munmap(bufferRing, bufferRingSize);
+        }
+        sqes = nullptr;
+        ring = nullptr;
+        ringFd = -1;
+        bufferRing = nullptr;
+    }
+
+    int socket;
+    int ringFd = -1;
+    void* ring = nullptr;
+    size_t ringSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    io_uring_buf_ring* bufferRing = nullptr;
+    io_uring_buf* bufferSlots = nullptr;
+    size_t bufferRingSize = 0;
+    std::vector<uint8_t> buffers;
+    size_t bufferStride = 0;
+    unsigned bufferMask = 0;
+    uint16_t bufferTail = 0;
+
+    // No name or control data is requested, so payload follows the
+    // io_uring_recvmsg_out header directly.
+    msghdr header = {};
+    bool armed = false;
+    uint64_t calls = 0;
+};
+
+#endif // RECEIVERS_H
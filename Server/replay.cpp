@@ -0,0 +1,131 @@
+// Replays a capture written by display_server --capture through the same
+// parse and render path, without a network. By default datagrams are fed
+// as fast as possible; --paced reproduces the recorded inter-arrival times.
+// Prints throughput and a checksum of the final framebuffer, which is
+// identical across runs of the same capture.
+//
+// Build: g++ -std=c++17 -O2 -pthread replay.cpp -o display_replay
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include "../display_protocol/capture_log.h"
+#include "datagram_handler.h"
+
+// Unframed commands are presented this often, like a server receiving 64
+// datagrams per call.
+const uint64_t REPLAY_PRESENT_INTERVAL = 64;
+
+struct ReplayOptions {
+    std::string path;
+    bool paced = false;
+    unsigned loops = 1;
+    int width = 800;
+    int height = 480;
+};
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " CAPTURE [--paced] [--loops N] [--width N] [--height N]" << std::endl;
+}
+
+static bool parseOptions(int argc, char** argv, ReplayOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string name = argv[i];
+        if (name == "--paced") {
+            options.paced = true;
+            continue;
+        }
+        if (name.compare(0, 2, "--") != 0) {
+            if (!options.path.empty()) {
+                return false;
+            }
+            options.path = name;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        long value = std::strtol(argv[++i], nullptr, 10);
+        if (name == "--loops" && value > 0) {
+            options.loops = static_cast<unsigned>(value);
+        }
+        else if (name == "--width" && value > 0 && value <= 32767) {
+            options.width = static_cast<int>(value);
+        }
+        else if (name == "--height" && value > 0 && value <= 32767) {
+            options.height = static_cast<int>(value);
+        }
+        else {
+            return false;
+        }
+    }
+    return !options.path.empty();
+}
+
+// FNV-1a over the visible pixels.
+static uint64_t checksum(const Framebuffer& framebuffer) {
+    uint64_t hash = 14695981039346656037ull;
+    for (int y = 0; y < framebuffer.getHeight(); ++y) {
+        const uint16_t* row = framebuffer.row(y);
+        for (int x = 0; x < framebuffer.getWidth(); ++x) {
+            hash = (hash ^ row[x]) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    try {
+        CaptureReader reader(options.path);
+        DatagramHandler handler(options.width, options.height);
+        ServerStats stats;
+        CaptureRecord record;
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned loop = 0; loop < options.loops; ++loop) {
+            reader.rewind();
+            auto loopStart = std::chrono::steady_clock::now();
+            while (reader.next(record)) {
+                if (options.paced) {
+                    std::this_thread::sleep_until(loopStart + std::chrono::nanoseconds(record.timestamp));
+                }
+                handler.handle(record.data, record.size, stats);
+                if (++stats.packets % REPLAY_PRESENT_INTERVAL == 0) {
+                    handler.presentUnframed();
+                }
+                stats.bytes += record.size;
+            }
+        }
+        handler.presentUnframed();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (reader.truncated()) {
+            std::cerr << "Capture ends with a truncated record" << std::endl;
+        }
+        std::cout << "packets: " << stats.packets << ", commands: " << stats.commands << ", errors: " << stats.errors
+            << ", seconds: " << seconds
+            << ", packets/s: " << static_cast<uint64_t>(stats.packets / seconds)
+            << ", commands/s: " << static_cast<uint64_t>(stats.commands / seconds)
+            << ", MB/s: " << stats.bytes / seconds / 1e6 << std::endl;
+        const EllipseSpanCache& ellipses = *handler.ellipseCache();
+        std::cout << "ellipse cache: hits " << ellipses.hits() << ", misses " << ellipses.misses()
+            << ", evictions " << ellipses.evictions() << ", hit rate " << ellipses.hitRate() << std::endl;
+        std::cout << "framebuffer checksum: " << std::hex << checksum(*handler.surface()) << std::dec << std::endl;
+#if DISPLAY_PROTOCOL_METRICS
+        std::cout << MetricsRegistry::instance().snapshot().toText();
+#endif
+    }
+    catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+// Saves the newest frame a display_server --export publishes as a binary
+// PPM. Maps the segment read-only and copies one frame out of it without
+// stopping or signalling the server; consumers that only look at pixels
+// (a compositor uploading a texture) can use FrameExportReader::read to
+// skip the copy as well.
+//
+// Build: g++ -std=c++17 -O2 screenshot.cpp -o display_screenshot
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include "../display_protocol/frame_export.h"
+#include "shared_memory.h"
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " SHM_NAME|/proc/PID/fd/FD OUTPUT.ppm" << std::endl;
+        return 1;
+    }
+    try {
+        SharedMemory memory = SharedMemory::open(argv[1]);
+        FrameExportReader reader(memory.data(), memory.size());
+        Framebuffer frame(reader.getWidth(), reader.getHeight());
+        uint64_t number = reader.copyLatest(frame);
+        if (number == 0) {
+            std::cerr << "No consistent frame available" << std::endl;
+            return 1;
+        }
+
+        std::ofstream out(argv[2], std::ios::binary);
+        out << "P6\n" << frame.getWidth() << " " << frame.getHeight() << "\n255\n";
+        std::vector<uint8_t> row(static_cast<size_t>(frame.getWidth()) * 3);
+        for (int y = 0; y < frame.getHeight(); ++y) {
+            for (int x = 0; x < frame.getWidth(); ++x) {
+                uint16_t pixel = frame.pixel(x, y);
+                row[3 * x] = static_cast<uint8_t>((pixel >> 11) * 255 / 31);
+                row[3 * x + 1] = static_cast<uint8_t>(((pixel >> 5) & 0x3F) * 255 / 63);
+                row[3 * x + 2] = static_cast<uint8_t>((pixel & 0x1F) * 255 / 31);
+            }
+            out.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+        }
+        if (!out) {
+            std::cerr << "Cannot write " << argv[2] << std::endl;
+            return 1;
+        }
+        std::cout << "frame " << number << ", " << frame.getWidth() << "x" << frame.getHeight() << std::endl;
+    }
+    catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Loopback throughput of the sharded server: for each shard count, sender
+// threads flood DISPLAY_BY_HEADER datagrams (one FILL_RECTANGLE each, the
+// display id cycling over all displays) for a fixed time while the shards
+// receive, parse and draw them. Prints datagrams handled per second.
+// Shard n runs on CPU n and the senders share the CPUs after the shards, so
+// they never compete with a shard. A run that has fewer CPUs than shards
+// plus one is marked as not measuring scaling: its numbers only show the
+// overhead of the extra threads.
+//
+// Build: g++ -std=c++17 -O2 -pthread shard_benchmark.cpp -o shard_benchmark
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <arpa/inet.h>
+#include "display_shards.h"
+
+// cpu < 0 leaves the sender unpinned.
+static void flood(uint16_t port, unsigned displays, unsigned first, int cpu, const std::atomic<bool>& running) {
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    uint8_t datagram[] = { 0, FILL_RECTANGLE_OPCODE, 10, 0, 10, 0, 20, 0, 20, 0, 0xF8, 0x00 };
+    for (unsigned display = first; running.load(std::memory_order_relaxed); ++display) {
+        datagram[0] = static_cast<uint8_t>(display % displays);
+        sendto(fd, datagram, sizeof(datagram), 0, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    }
+    close(fd);
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+    unsigned senders = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2])) : 2;
+    unsigned cpus = std::thread::hardware_concurrency();
+    std::cout << cpus << " CPUs, " << senders << " senders, " << seconds << " s per run" << std::endl;
+    for (unsigned shardCount : { 1u, 2u, 4u }) {
+        ShardOptions options;
+        options.basePort = 7300;
+        options.displays = 16;
+        options.shards = shardCount;
+        options.selection = DISPLAY_BY_HEADER;
+        auto shards = openDisplayShards(options);
+        for (auto& shard : shards) {
+            shard->start();
+        }
+        // Shards pin themselves to CPUs 0 to shardCount - 1.
+        bool separate = cpus > shardCount;
+        std::atomic<bool> running{ true };
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < senders; ++i) {
+            int cpu = separate ? static_cast<int>(shardCount + i % (cpus - shardCount)) : -1;
+            threads.emplace_back(flood, options.basePort, options.displays, i, cpu, std::cref(running));
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        running = false;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        uint64_t packets = 0;
+        for (auto& shard : shards) {
+            shard->stop();
+            packets += shard->packets();
+        }
+        std::cout << "shards " << shardCount << ": " << static_cast<uint64_t>(packets / seconds) << " datagrams/s";
+        if (!separate) {
+            std::cout << " (senders share the shard CPUs; not a scaling measurement)";
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
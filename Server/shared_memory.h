@@ -0,0 +1,108 @@
+#pragma once
+#ifndef SHARED_MEMORY_H
+#define SHARED_MEMORY_H
+
+// Shared memory segments for exporting frames to other processes (see
+// frame_export.h). A name starting with '/' is a POSIX shared memory object
+// that readers open by the same name; any other name creates an anonymous
+// memfd, which readers reach through /proc/<pid>/fd/<fd> or a passed
+// descriptor.
+
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class SharedMemory {
+public:
+    // Creates a segment of size bytes, mapped read-write.
+    static SharedMemory create(const std::string& name, size_t size) {
+        int fd = name.compare(0, 1, "/") == 0
+            ? shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)
+            : memfd_create(name.c_str(), MFD_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot create shared memory " + name + ": " + std::strerror(errno));
+        }
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error("Cannot size shared memory " + name + ": " + std::strerror(error));
+        }
+        return SharedMemory(fd, size, true, name.compare(0, 1, "/") == 0 ? name : std::string());
+    }
+
+    // Maps an existing segment read-only: a POSIX shared memory name, or a
+    // path such as /proc/<pid>/fd/<fd> for a memfd.
+    static SharedMemory open(const std::string& name) {
+        int fd = name.compare(0, 1, "/") == 0 && name.find('/', 1) == std::string::npos
+            ? shm_open(name.c_str(), O_RDONLY, 0)
+            : ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open shared memory " + name + ": " + std::strerror(errno));
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error("Cannot open shared memory " + name + ": " + std::strerror(error));
+        }
+        return SharedMemory(fd, static_cast<size_t>(status.st_size), false, std::string());
+    }
+
+    SharedMemory(SharedMemory&& other) noexcept
+        : fd(other.fd), length(other.length), memory(other.memory), unlinkName(other.unlinkName) {
+        other.fd = -1;
+        other.memory = nullptr;
+        other.unlinkName.clear();
+    }
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+    SharedMemory& operator=(SharedMemory&&) = delete;
+
+    // The creator removes a named segment; readers that still map it keep
+    // their mapping.
+    ~SharedMemory() {
+        if (memory) {
+            munmap(memory, length);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!unlinkName.empty()) {
+            shm_unlink(unlinkName.c_str());
+        }
+    }
+
+    void* data() { return memory; }
+    const void* data() const { return memory; }
+    size_t size() const { return length; }
+    int descriptor() const { return fd; }
+
+private:
+    SharedMemory(int fd, size_t size, bool writable, const std::string& unlinkName)
+        : fd(fd), length(size), unlinkName(unlinkName) {
+        memory = size == 0 ? MAP_FAILED : mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            int error = size == 0 ? EINVAL : errno;
+            memory = nullptr;
+            close(fd);
+            this->fd = -1;
+            if (!unlinkName.empty()) {
+                shm_unlink(unlinkName.c_str());
+            }
+            throw std::runtime_error(std::string("Cannot map shared memory: ") + std::strerror(error));
+        }
+    }
+
+    int fd;
+    size_t length;
+    void* memory;
+    std::string unlinkName;
+};
+
+#endif // SHARED_MEMORY_H
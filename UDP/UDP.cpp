@@ -21,6 +21,8 @@ std::string getCommandName(CommandOpcode opcode) {
     case FILL_RECTANGLE_OPCODE: return "FILL_RECTANGLE";
     case DRAW_ELLIPSE_OPCODE: return "DRAW_ELLIPSE";
     case FILL_ELLIPSE_OPCODE: return "FILL_ELLIPSE";
+    case BEGIN_FRAME_OPCODE: return "BEGIN_FRAME";
+    case END_FRAME_OPCODE: return "END_FRAME";
     default: return "UNKNOWN_COMMAND";
     }
 }
@@ -0,0 +1,240 @@
+#pragma once
+#ifndef BULK_COMMANDS_H
+#define BULK_COMMANDS_H
+
+#include <vector>
+#include <cstdint>
+#include "command_codec.h"
+
+// Variable-length commands that carry many shapes in one datagram. Each is
+// sent as a datagram of its own, never inside a batch:
+//   DRAW_POLYLINE    uint16 count, color, count * (x, y)
+//   DRAW_PIXEL_SPAN  x, y, uint16 count, count * color
+//   FILL_RECTANGLES  uint16 count, color, count * (x, y, width, height)
+// Counts and coordinates are little-endian and colors big-endian, as in the
+// fixed-size commands. The datagram length must match the count exactly.
+enum BulkOpcode {
+    DRAW_POLYLINE_OPCODE = COMMAND_OPCODE_COUNT,
+    DRAW_PIXEL_SPAN_OPCODE,
+    FILL_RECTANGLES_OPCODE
+};
+
+// Every opcode that can start a datagram, fixed-size and bulk.
+constexpr size_t WIRE_OPCODE_COUNT = FILL_RECTANGLES_OPCODE + 1;
+
+inline bool isBulkOpcode(uint8_t opcode) {
+    return opcode >= DRAW_POLYLINE_OPCODE && opcode < WIRE_OPCODE_COUNT;
+}
+
+inline const char* opcodeName(size_t opcode) {
+    static const char* const BULK_NAMES[] = { "draw_polyline", "draw_pixel_span", "fill_rectangles" };
+    return opcode < COMMAND_OPCODE_COUNT ? COMMAND_DESCRIPTORS[opcode].name : BULK_NAMES[opcode - COMMAND_OPCODE_COUNT];
+}
+
+struct Point {
+    int16_t x;
+    int16_t y;
+};
+
+struct Box {
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
+};
+
+// Read-only views of the arrays inside a received datagram. They copy
+// nothing and must not outlive the datagram. The parser checks the count
+// against the datagram length once, so element access is unchecked.
+class PointView {
+public:
+    PointView() = default;
+    PointView(const uint8_t* data, size_t count) : data(data), count(count) {}
+
+    size_t size() const { return count; }
+
+    Point operator[](size_t index) const {
+        const uint8_t* item = data + 4 * index;
+        return { static_cast<int16_t>(item[0] | (item[1] << 8)), static_cast<int16_t>(item[2] | (item[3] << 8)) };
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t count = 0;
+};
+
+class BoxView {
+public:
+    BoxView() = default;
+    BoxView(const uint8_t* data, size_t count) : data(data), count(count) {}
+
+    size_t size() const { return count; }
+
+    Box operator[](size_t index) const {
+        const uint8_t* item = data + 8 * index;
+        return { static_cast<int16_t>(item[0] | (item[1] << 8)), static_cast<int16_t>(item[2] | (item[3] << 8)),
+            static_cast<int16_t>(item[4] | (item[5] << 8)), static_cast<int16_t>(item[6] | (item[7] << 8)) };
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t count = 0;
+};
+
+class ColorView {
+public:
+    ColorView() = default;
+    ColorView(const uint8_t* data, size_t count) : data(data), count(count) {}
+
+    size_t size() const { return count; }
+
+    uint16_t operator[](size_t index) const {
+        return static_cast<uint16_t>((data[2 * index] << 8) | data[2 * index + 1]);
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t count = 0;
+};
+
+// A decoded bulk command; opcode says which members are set.
+struct BulkCommandView {
+    BulkOpcode opcode;
+    int16_t x = 0;
+    int16_t y = 0;
+    uint16_t color = 0;
+    PointView points;
+    ColorView colors;
+    BoxView boxes;
+};
+
+// Header length and bytes per element of each bulk opcode.
+struct BulkLayout {
+    size_t headerSize;
+    size_t countOffset;
+    size_t elementSize;
+    const char* error;
+};
+
+inline const BulkLayout& bulkLayout(uint8_t opcode) {
+    static const BulkLayout LAYOUTS[] = {
+        { 5, 1, 4, "Invalid parameters for draw polyline" },
+        { 7, 5, 2, "Invalid parameters for draw pixel span" },
+        { 5, 1, 8, "Invalid parameters for fill rectangles" },
+    };
+    return LAYOUTS[opcode - DRAW_POLYLINE_OPCODE];
+}
+
+// Decodes a bulk command of size bytes into views over data. Returns false
+// if the header is short or the length does not match the element count.
+inline bool decodeBulkCommand(const uint8_t* data, size_t size, BulkCommandView& view) {
+    const BulkLayout& layout = bulkLayout(data[0]);
+    if (size < layout.headerSize) {
+        return false;
+    }
+    size_t count = static_cast<size_t>(data[layout.countOffset] | (data[layout.countOffset + 1] << 8));
+    if (size - layout.headerSize != count * layout.elementSize) {
+        return false;
+    }
+    const uint8_t* elements = data + layout.headerSize;
+    view = BulkCommandView();
+    view.opcode = static_cast<BulkOpcode>(data[0]);
+    switch (view.opcode) {
+    case DRAW_POLYLINE_OPCODE:
+        view.color = static_cast<uint16_t>((data[3] << 8) | data[4]);
+        view.points = PointView(elements, count);
+        break;
+    case DRAW_PIXEL_SPAN_OPCODE:
+        view.x = static_cast<int16_t>(data[1] | (data[2] << 8));
+        view.y = static_cast<int16_t>(data[3] | (data[4] << 8));
+        view.colors = ColorView(elements, count);
+        break;
+    case FILL_RECTANGLES_OPCODE:
+        view.color = static_cast<uint16_t>((data[3] << 8) | data[4]);
+        view.boxes = BoxView(elements, count);
+        break;
+    }
+    return true;
+}
+
+// Appends the fixed-size commands that draw the same pixels as command, for
+// consumers that only take CommandData. A polyline becomes one DrawLine per
+// segment (a single point becomes a one-pixel line), a pixel span one
+// DrawPixel per color and FillRectangles one FillRectangle per box.
+inline void expandBulkCommand(const BulkCommandView& command, std::vector<CommandData>& commands) {
+    CommandData data;
+    switch (command.opcode) {
+    case DRAW_POLYLINE_OPCODE:
+        data.opcode = DRAW_LINE_OPCODE;
+        for (size_t i = 0; i < command.points.size(); ++i) {
+            Point from = command.points[i == 0 ? 0 : i - 1];
+            Point to = command.points[i];
+            if (i > 0 || command.points.size() == 1) {
+                data.drawLine = { from.x, from.y, to.x, to.y, command.color };
+                commands.push_back(data);
+            }
+        }
+        break;
+    case DRAW_PIXEL_SPAN_OPCODE:
+        data.opcode = DRAW_PIXEL_OPCODE;
+        for (size_t i = 0; i < command.colors.size(); ++i) {
+            data.drawPixel = { static_cast<int16_t>(command.x + i), command.y, command.colors[i] };
+            commands.push_back(data);
+        }
+        break;
+    case FILL_RECTANGLES_OPCODE:
+        data.opcode = FILL_RECTANGLE_OPCODE;
+        for (size_t i = 0; i < command.boxes.size(); ++i) {
+            Box box = command.boxes[i];
+            data.fillRectangle = { box.x, box.y, box.width, box.height, command.color };
+            commands.push_back(data);
+        }
+        break;
+    }
+}
+
+inline void appendInt16(int16_t value, std::vector<uint8_t>& byteArray) {
+    byteArray.push_back(static_cast<uint8_t>(value));
+    byteArray.push_back(static_cast<uint8_t>(static_cast<uint16_t>(value) >> 8));
+}
+
+inline void appendColor(uint16_t color, std::vector<uint8_t>& byteArray) {
+    byteArray.push_back(static_cast<uint8_t>(color >> 8));
+    byteArray.push_back(static_cast<uint8_t>(color));
+}
+
+// Encoders for the bulk commands; each replaces the contents of byteArray.
+// Element counts are limited to 65535.
+inline void encodeDrawPolyline(const std::vector<Point>& points, uint16_t color, std::vector<uint8_t>& byteArray) {
+    byteArray.assign(1, static_cast<uint8_t>(DRAW_POLYLINE_OPCODE));
+    appendInt16(static_cast<int16_t>(points.size()), byteArray);
+    appendColor(color, byteArray);
+    for (const Point& point : points) {
+        appendInt16(point.x, byteArray);
+        appendInt16(point.y, byteArray);
+    }
+}
+
+inline void encodeDrawPixelSpan(int16_t x, int16_t y, const std::vector<uint16_t>& colors, std::vector<uint8_t>& byteArray) {
+    byteArray.assign(1, static_cast<uint8_t>(DRAW_PIXEL_SPAN_OPCODE));
+    appendInt16(x, byteArray);
+    appendInt16(y, byteArray);
+    appendInt16(static_cast<int16_t>(colors.size()), byteArray);
+    for (uint16_t color : colors) {
+        appendColor(color, byteArray);
+    }
+}
+
+inline void encodeFillRectangles(const std::vector<Box>& boxes, uint16_t color, std::vector<uint8_t>& byteArray) {
+    byteArray.assign(1, static_cast<uint8_t>(FILL_RECTANGLES_OPCODE));
+    appendInt16(static_cast<int16_t>(boxes.size()), byteArray);
+    appendColor(color, byteArray);
+    for (const Box& box : boxes) {
+        appendInt16(box.x, byteArray);
+        appendInt16(box.y, byteArray);
+        appendInt16(box.width, byteArray);
+        appendInt16(box.height, byteArray);
+    }
+}
+
+#endif // BULK_COMMANDS_H
@@ -0,0 +1,254 @@
+#pragma once
+#ifndef CAPTURE_LOG_H
+#define CAPTURE_LOG_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Append-only log of received datagrams. The file starts with
+// CAPTURE_MAGIC and CAPTURE_VERSION; each record is a little-endian
+// uint64 timestamp (nanoseconds since the capture was opened), a
+// little-endian uint32 length and the raw bytes as they reached the parser.
+const char CAPTURE_MAGIC[4] = { 'D', 'P', 'C', 'P' };
+const uint32_t CAPTURE_VERSION = 1;
+const size_t CAPTURE_HEADER_SIZE = 8;
+const size_t CAPTURE_RECORD_HEADER_SIZE = 12;
+
+struct CaptureRecord {
+    uint64_t timestamp;
+    const uint8_t* data;
+    size_t size;
+};
+
+// Buffers records and writes them in large chunks so the receive loop only
+// pays for a memcpy per datagram.
+class CaptureWriter {
+public:
+    explicit CaptureWriter(const std::string& path, size_t bufferSize = 1 << 20)
+        : file(std::fopen(path.c_str(), "wb")), capacity(bufferSize), start(std::chrono::steady_clock::now()) {
+        if (!file) {
+            throw std::runtime_error("Cannot open capture file " + path);
+        }
+        buffer.reserve(capacity);
+        buffer.insert(buffer.end(), CAPTURE_MAGIC, CAPTURE_MAGIC + sizeof(CAPTURE_MAGIC));
+        putLittleEndian(CAPTURE_VERSION, 4);
+    }
+
+    // A destructor must not throw, so a failed final write is only
+    // reported; call flush() first to handle it.
+    ~CaptureWriter() {
+        if (!tryFlush()) {
+            std::fprintf(stderr, "Capture write failed, records lost\n");
+        }
+        std::fclose(file);
+    }
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    // Records a datagram stamped with the time elapsed since construction.
+    void append(const uint8_t* data, size_t size) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        append(data, size, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    void append(const uint8_t* data, size_t size, uint64_t timestamp) {
+        if (size > UINT32_MAX) {
+            throw std::invalid_argument("Capture record too large");
+        }
+        if (buffer.size() + CAPTURE_RECORD_HEADER_SIZE + size > capacity) {
+            flush();
+        }
+        putLittleEndian(timestamp, 8);
+        putLittleEndian(size, 4);
+        buffer.insert(buffer.end(), data, data + size);
+        ++records;
+    }
+
+    void flush() {
+        if (!tryFlush()) {
+            throw std::runtime_error("Capture write failed");
+        }
+    }
+
+    // Writes out the buffered records; false if the file rejected them.
+    // The buffer is emptied either way.
+    bool tryFlush() noexcept {
+        bool written = buffer.empty() || std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        buffer.clear();
+        return std::fflush(file) == 0 && written;
+    }
+
+    uint64_t recordCount() const {
+        return records;
+    }
+
+private:
+    void putLittleEndian(uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; ++i) {
+            buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    std::FILE* file;
+    size_t capacity;
+    std::vector<uint8_t> buffer;
+    std::chrono::steady_clock::time_point start;
+    uint64_t records = 0;
+};
+
+// Read-only memory map of a capture; records point straight into the
+// mapping. A record cut short by a crashed writer ends the capture and
+// sets truncated().
+class CaptureReader {
+public:
+    explicit CaptureReader(const std::string& path) {
+        map(path);
+        if (length < CAPTURE_HEADER_SIZE || std::memcmp(bytes, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+            unmap();
+            throw std::runtime_error("Not a capture file: " + path);
+        }
+        if (getLittleEndian(bytes + 4, 4) != CAPTURE_VERSION) {
+            unmap();
+            throw std::runtime_error("Unsupported capture version: " + path);
+        }
+        rewind();
+    }
+
+    ~CaptureReader() {
+        unmap();
+    }
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    bool next(CaptureRecord& record) {
+        if (length - offset < CAPTURE_RECORD_HEADER_SIZE) {
+            incomplete = offset != length;
+            return false;
+        }
+        uint64_t size = getLittleEndian(bytes + offset + 8, 4);
+        if (length - offset - CAPTURE_RECORD_HEADER_SIZE < size) {
+            incomplete = true;
+            return false;
+        }
+        record.timestamp = getLittleEndian(bytes + offset, 8);
+        record.data = bytes + offset + CAPTURE_RECORD_HEADER_SIZE;
+        record.size = static_cast<size_t>(size);
+        offset += CAPTURE_RECORD_HEADER_SIZE + record.size;
+        return true;
+    }
+
+    void rewind() {
+        offset = CAPTURE_HEADER_SIZE;
+        incomplete = false;
+    }
+
+    bool truncated() const {
+        return incomplete;
+    }
+
+    size_t fileSize() const {
+        return length;
+    }
+
+private:
+    static uint64_t getLittleEndian(const uint8_t* data, size_t count) {
+        uint64_t value = 0;
+        for (size_t i = 0; i < count; ++i) {
+            value |= static_cast<uint64_t>(data[i]) << (8 * i);
+        }
+        return value;
+    }
+
+#if defined(_WIN32)
+    void map(const std::string& path) {
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+            unmap();
+            throw std::runtime_error("Cannot open capture file " + path);
+        }
+        length = static_cast<size_t>(size.QuadPart);
+        if (length == 0) {
+            return;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        bytes = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        if (!bytes) {
+            unmap();
+            throw std::runtime_error("Cannot map capture file " + path);
+        }
+    }
+
+    void unmap() {
+        if (bytes) {
+            UnmapViewOfFile(bytes);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        bytes = nullptr;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+    }
+
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    void map(const std::string& path) {
+        int descriptor = open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+            if (descriptor >= 0) {
+                close(descriptor);
+            }
+            throw std::runtime_error("Cannot open capture file " + path);
+        }
+        length = static_cast<size_t>(status.st_size);
+        void* memory = length ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0) : nullptr;
+        close(descriptor);
+        if (memory == MAP_FAILED) {
+            throw std::runtime_error("Cannot map capture file " + path);
+        }
+        bytes = static_cast<const uint8_t*>(memory);
+        if (bytes) {
+            madvise(memory, length, MADV_SEQUENTIAL);
+        }
+    }
+
+    void unmap() {
+        if (bytes) {
+            munmap(const_cast<uint8_t*>(bytes), length);
+        }
+        bytes = nullptr;
+    }
+#endif
+
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+    size_t offset = 0;
+    bool incomplete = false;
+};
+
+#endif // CAPTURE_LOG_H
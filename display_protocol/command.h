@@ -0,0 +1,238 @@
+#pragma once
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <cstdint>
+#include <stdexcept>
+
+enum CommandOpcode {
+    CLEAR_DISPLAY_OPCODE,
+    DRAW_PIXEL_OPCODE,
+    DRAW_LINE_OPCODE,
+    DRAW_RECTANGLE_OPCODE,
+    FILL_RECTANGLE_OPCODE,
+    DRAW_ELLIPSE_OPCODE,
+    FILL_ELLIPSE_OPCODE,
+    BEGIN_FRAME_OPCODE,
+    END_FRAME_OPCODE
+};
+
+
+struct Command {
+    const CommandOpcode opcode;
+
+    Command(const CommandOpcode opcode) : opcode(opcode) {};
+    virtual ~Command() {}
+};
+struct ClearDisplay : Command {
+    const uint16_t color;
+
+    ClearDisplay(const uint16_t color) : Command(CLEAR_DISPLAY_OPCODE), color(color) {};
+};
+
+struct DrawPixel : Command {
+    const int16_t x0;
+    const int16_t y0;
+    const uint16_t color;
+
+    DrawPixel(const int16_t x0, const int16_t y0, const uint16_t color) :
+        Command(DRAW_PIXEL_OPCODE), x0(x0), y0(y0), color(color) {};
+};
+
+struct DrawLine : Command {
+    const int16_t x0;
+    const int16_t y0;
+    const int16_t x1;
+    const int16_t y1;
+    const uint16_t color;
+
+    DrawLine(const int16_t x0, const int16_t y0, const int16_t x1, const int16_t y1, const uint16_t color) :
+        Command(DRAW_LINE_OPCODE), x0(x0), y0(y0), x1(x1), y1(y1), color(color) {};
+};
+
+struct DrawRectangle : Command {
+    const int16_t x;
+    const int16_t y;
+    const int16_t width;
+    const int16_t height;
+    const uint16_t color;
+
+    DrawRectangle(const int16_t x, const int16_t y, const int16_t width, const int16_t height, const uint16_t color) :
+        Command(DRAW_RECTANGLE_OPCODE), x(x), y(y), width(width), height(height), color(color) {};
+};
+
+struct FillRectangle : Command {
+    const int16_t x;
+    const int16_t y;
+    const int16_t width;
+    const int16_t height;
+    const uint16_t color;
+
+    FillRectangle(const int16_t x, const int16_t y, const int16_t width, const int16_t height, const uint16_t color) :
+        Command(FILL_RECTANGLE_OPCODE), x(x), y(y), width(width), height(height), color(color) {};
+};
+
+struct DrawEllipse : Command {
+    const int16_t x;
+    const int16_t y;
+    const int16_t rx;
+    const int16_t ry;
+    const uint16_t color;
+
+    DrawEllipse(const int16_t x, const int16_t y, const int16_t rx, const int16_t ry, const uint16_t color) :
+        Command(DRAW_ELLIPSE_OPCODE), x(x), y(y), rx(rx), ry(ry), color(color) {};
+};
+
+struct FillEllipse : Command {
+    const int16_t x;
+    const int16_t y;
+    const int16_t rx;
+    const int16_t ry;
+    const uint16_t color;
+
+    FillEllipse(const int16_t x, const int16_t y, const int16_t rx, const int16_t ry, const uint16_t color) :
+        Command(FILL_ELLIPSE_OPCODE), x(x), y(y), rx(rx), ry(ry), color(color) {};
+};
+
+// Frame markers draw nothing. Commands between BeginFrame and EndFrame are
+// shown together once EndFrame arrives; frame is the sender's frame number.
+struct BeginFrame : Command {
+    const uint16_t frame;
+
+    BeginFrame(const uint16_t frame) : Command(BEGIN_FRAME_OPCODE), frame(frame) {};
+};
+
+struct EndFrame : Command {
+    const uint16_t frame;
+
+    EndFrame(const uint16_t frame) : Command(END_FRAME_OPCODE), frame(frame) {};
+};
+
+// Plain counterparts of the Command subclasses for the allocation-free parse
+// path. Same fields, but no vtable and no const members, so they can share a
+// union and be copied by value. Members are declared in wire order and are all
+// 16 bits wide; the codec in command_codec.h relies on that.
+struct ClearDisplayData {
+    uint16_t color;
+};
+
+struct DrawPixelData {
+    int16_t x0;
+    int16_t y0;
+    uint16_t color;
+};
+
+struct DrawLineData {
+    int16_t x0;
+    int16_t y0;
+    int16_t x1;
+    int16_t y1;
+    uint16_t color;
+};
+
+struct DrawRectangleData {
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
+    uint16_t color;
+};
+
+struct FillRectangleData {
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
+    uint16_t color;
+};
+
+struct DrawEllipseData {
+    int16_t x;
+    int16_t y;
+    int16_t rx;
+    int16_t ry;
+    uint16_t color;
+};
+
+struct FillEllipseData {
+    int16_t x;
+    int16_t y;
+    int16_t rx;
+    int16_t ry;
+    uint16_t color;
+};
+
+struct BeginFrameData {
+    uint16_t frame;
+};
+
+struct EndFrameData {
+    uint16_t frame;
+};
+
+// Decoded command as a tagged value: opcode selects the active union member.
+struct CommandData {
+    CommandOpcode opcode;
+    union {
+        ClearDisplayData clearDisplay;
+        DrawPixelData drawPixel;
+        DrawLineData drawLine;
+        DrawRectangleData drawRectangle;
+        FillRectangleData fillRectangle;
+        DrawEllipseData drawEllipse;
+        FillEllipseData fillEllipse;
+        BeginFrameData beginFrame;
+        EndFrameData endFrame;
+    };
+};
+
+// Calls visitor with the active member of command. Every overload of the
+// visitor must return the same type.
+template <typename Visitor>
+auto visitCommand(const CommandData& command, Visitor&& visitor) -> decltype(visitor(command.clearDisplay)) {
+    switch (command.opcode) {
+    case CLEAR_DISPLAY_OPCODE:
+        return visitor(command.clearDisplay);
+    case DRAW_PIXEL_OPCODE:
+        return visitor(command.drawPixel);
+    case DRAW_LINE_OPCODE:
+        return visitor(command.drawLine);
+    case DRAW_RECTANGLE_OPCODE:
+        return visitor(command.drawRectangle);
+    case FILL_RECTANGLE_OPCODE:
+        return visitor(command.fillRectangle);
+    case DRAW_ELLIPSE_OPCODE:
+        return visitor(command.drawEllipse);
+    case FILL_ELLIPSE_OPCODE:
+        return visitor(command.fillEllipse);
+    case BEGIN_FRAME_OPCODE:
+        return visitor(command.beginFrame);
+    case END_FRAME_OPCODE:
+        return visitor(command.endFrame);
+    }
+    throw std::invalid_argument("Unknown command opcode");
+}
+
+// Builds the heap-allocated Command for a decoded value.
+struct CommandAllocator {
+    Command* operator()(const ClearDisplayData& d) const { return new ClearDisplay(d.color); }
+    Command* operator()(const DrawPixelData& d) const { return new DrawPixel(d.x0, d.y0, d.color); }
+    Command* operator()(const DrawLineData& d) const { return new DrawLine(d.x0, d.y0, d.x1, d.y1, d.color); }
+    Command* operator()(const DrawRectangleData& d) const { return new DrawRectangle(d.x, d.y, d.width, d.height, d.color); }
+    Command* operator()(const FillRectangleData& d) const { return new FillRectangle(d.x, d.y, d.width, d.height, d.color); }
+    Command* operator()(const DrawEllipseData& d) const { return new DrawEllipse(d.x, d.y, d.rx, d.ry, d.color); }
+    Command* operator()(const FillEllipseData& d) const { return new FillEllipse(d.x, d.y, d.rx, d.ry, d.color); }
+    Command* operator()(const BeginFrameData& d) const { return new BeginFrame(d.frame); }
+    Command* operator()(const EndFrameData& d) const { return new EndFrame(d.frame); }
+};
+
+// True for the commands that delimit frames rather than draw.
+inline bool isFrameMarker(CommandOpcode opcode) {
+    return opcode == BEGIN_FRAME_OPCODE || opcode == END_FRAME_OPCODE;
+}
+
+inline Command* makeCommand(const CommandData& command) {
+    return visitCommand(command, CommandAllocator());
+}
+
+#endif // COMMAND_H
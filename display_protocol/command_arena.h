@@ -0,0 +1,99 @@
+#pragma once
+#ifndef COMMAND_ARENA_H
+#define COMMAND_ARENA_H
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "command.h"
+
+// Bump allocator for the Command objects of one frame. Commands are placed
+// back to back in large blocks and released all at once by reset(), usually
+// at frame end, so the old Command* interface costs no heap allocation per
+// command once the arena has grown to the largest frame. The classes are
+// unchanged; the only difference to makeCommand is ownership: a command
+// made in an arena must not be deleted and is gone after the next reset().
+// Command subclasses hold nothing but integers, so reset() does not run
+// their destructors.
+class CommandArena {
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 16 * 1024;
+
+    explicit CommandArena(size_t blockSize = DEFAULT_BLOCK_SIZE) : blockSize(blockSize) {}
+
+    CommandArena(const CommandArena&) = delete;
+    CommandArena& operator=(const CommandArena&) = delete;
+
+    // Constructs a T in the arena.
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        void* memory = allocate(sizeof(T), alignof(T));
+        ++objectCount;
+        return new (memory) T(std::forward<Args>(args)...);
+    }
+
+    // Forgets every object made since the last reset; the blocks are kept
+    // for the next frame.
+    void reset() {
+        current = 0;
+        offset = 0;
+        objectCount = 0;
+    }
+
+    // Objects made since the last reset.
+    size_t objects() const { return objectCount; }
+    // Heap blocks the arena has allocated over its lifetime.
+    size_t blockAllocations() const { return blocks.size(); }
+    size_t capacity() const { return blocks.size() * blockSize; }
+
+private:
+    void* allocate(size_t size, size_t alignment) {
+        while (true) {
+            if (current < blocks.size()) {
+                size_t start = (offset + alignment - 1) / alignment * alignment;
+                if (start + size <= blockSize) {
+                    offset = start + size;
+                    return blocks[current].get() + start;
+                }
+                ++current;
+                offset = 0;
+                continue;
+            }
+            if (size > blockSize) {
+                throw std::bad_alloc();
+            }
+            // operator new[] returns memory aligned for any fundamental type.
+            blocks.emplace_back(new uint8_t[blockSize]);
+        }
+    }
+
+    size_t blockSize;
+    std::vector<std::unique_ptr<uint8_t[]>> blocks;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t objectCount = 0;
+};
+
+// Builds the arena-allocated Command for a decoded value.
+struct ArenaCommandAllocator {
+    CommandArena& arena;
+
+    Command* operator()(const ClearDisplayData& d) const { return arena.make<ClearDisplay>(d.color); }
+    Command* operator()(const DrawPixelData& d) const { return arena.make<DrawPixel>(d.x0, d.y0, d.color); }
+    Command* operator()(const DrawLineData& d) const { return arena.make<DrawLine>(d.x0, d.y0, d.x1, d.y1, d.color); }
+    Command* operator()(const DrawRectangleData& d) const { return arena.make<DrawRectangle>(d.x, d.y, d.width, d.height, d.color); }
+    Command* operator()(const FillRectangleData& d) const { return arena.make<FillRectangle>(d.x, d.y, d.width, d.height, d.color); }
+    Command* operator()(const DrawEllipseData& d) const { return arena.make<DrawEllipse>(d.x, d.y, d.rx, d.ry, d.color); }
+    Command* operator()(const FillEllipseData& d) const { return arena.make<FillEllipse>(d.x, d.y, d.rx, d.ry, d.color); }
+    Command* operator()(const BeginFrameData& d) const { return arena.make<BeginFrame>(d.frame); }
+    Command* operator()(const EndFrameData& d) const { return arena.make<EndFrame>(d.frame); }
+};
+
+inline Command* makeCommand(const CommandData& command, CommandArena& arena) {
+    return visitCommand(command, ArenaCommandAllocator{ arena });
+}
+
+#endif // COMMAND_ARENA_H
@@ -0,0 +1,119 @@
+#pragma once
+#ifndef COMMAND_BOUNDS_H
+#define COMMAND_BOUNDS_H
+
+#include <algorithm>
+#include "command.h"
+#include "bulk_commands.h"
+
+// Half-open pixel rectangle [left, right) x [top, bottom).
+struct Rect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+
+    bool empty() const { return left >= right || top >= bottom; }
+    long long area() const { return empty() ? 0 : static_cast<long long>(right - left) * (bottom - top); }
+
+    bool contains(int x, int y) const { return x >= left && x < right && y >= top && y < bottom; }
+
+    bool contains(const Rect& other) const {
+        return other.empty() || (other.left >= left && other.right <= right && other.top >= top && other.bottom <= bottom);
+    }
+
+    bool intersects(const Rect& other) const {
+        return !intersect(other).empty();
+    }
+
+    Rect intersect(const Rect& other) const {
+        return { std::max(left, other.left), std::max(top, other.top), std::min(right, other.right), std::min(bottom, other.bottom) };
+    }
+
+    // Smallest rectangle covering both; an empty side is ignored.
+    Rect unite(const Rect& other) const {
+        if (empty()) {
+            return other;
+        }
+        if (other.empty()) {
+            return *this;
+        }
+        return { std::min(left, other.left), std::min(top, other.top), std::max(right, other.right), std::max(bottom, other.bottom) };
+    }
+};
+
+// Pixels a command can touch, before clipping to any surface. ClearDisplay
+// has no geometry of its own and reports surface, the rectangle it covers;
+// frame markers touch nothing.
+inline Rect commandBounds(const CommandData& command, const Rect& surface) {
+    switch (command.opcode) {
+    case CLEAR_DISPLAY_OPCODE:
+        return surface;
+    case DRAW_PIXEL_OPCODE: {
+        const DrawPixelData& c = command.drawPixel;
+        return { c.x0, c.y0, c.x0 + 1, c.y0 + 1 };
+    }
+    case DRAW_LINE_OPCODE: {
+        const DrawLineData& c = command.drawLine;
+        return { std::min(c.x0, c.x1), std::min(c.y0, c.y1), std::max(c.x0, c.x1) + 1, std::max(c.y0, c.y1) + 1 };
+    }
+    case DRAW_RECTANGLE_OPCODE: {
+        const DrawRectangleData& c = command.drawRectangle;
+        return { c.x, c.y, c.x + c.width, c.y + c.height };
+    }
+    case FILL_RECTANGLE_OPCODE: {
+        const FillRectangleData& c = command.fillRectangle;
+        return { c.x, c.y, c.x + c.width, c.y + c.height };
+    }
+    case DRAW_ELLIPSE_OPCODE: {
+        const DrawEllipseData& c = command.drawEllipse;
+        if (c.rx < 0 || c.ry < 0) {
+            return { 0, 0, 0, 0 };
+        }
+        return { c.x - c.rx, c.y - c.ry, c.x + c.rx + 1, c.y + c.ry + 1 };
+    }
+    case FILL_ELLIPSE_OPCODE: {
+        const FillEllipseData& c = command.fillEllipse;
+        if (c.rx < 0 || c.ry < 0) {
+            return { 0, 0, 0, 0 };
+        }
+        return { c.x - c.rx, c.y - c.ry, c.x + c.rx + 1, c.y + c.ry + 1 };
+    }
+    case BEGIN_FRAME_OPCODE:
+    case END_FRAME_OPCODE:
+        break;
+    }
+    return { 0, 0, 0, 0 };
+}
+
+inline Rect boxBounds(const Box& box) {
+    return { box.x, box.y, box.x + box.width, box.y + box.height };
+}
+
+// Bounding box of every pixel a bulk command can touch.
+inline Rect bulkCommandBounds(const BulkCommandView& command) {
+    Rect bounds = { 0, 0, 0, 0 };
+    switch (command.opcode) {
+    case DRAW_POLYLINE_OPCODE:
+        for (size_t i = 0; i < command.points.size(); ++i) {
+            Point point = command.points[i];
+            Rect pixel = { point.x, point.y, point.x + 1, point.y + 1 };
+            bounds = i == 0 ? pixel : bounds.unite(pixel);
+        }
+        break;
+    case DRAW_PIXEL_SPAN_OPCODE:
+        bounds = { command.x, command.y, command.x + static_cast<int>(command.colors.size()), command.y + 1 };
+        break;
+    case FILL_RECTANGLES_OPCODE:
+        for (size_t i = 0; i < command.boxes.size(); ++i) {
+            Rect box = boxBounds(command.boxes[i]);
+            if (!box.empty()) {
+                bounds = bounds.empty() ? box : bounds.unite(box);
+            }
+        }
+        break;
+    }
+    return bounds;
+}
+
+#endif // COMMAND_BOUNDS_H
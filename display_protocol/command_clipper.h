@@ -0,0 +1,161 @@
+#pragma once
+#ifndef COMMAND_CLIPPER_H
+#define COMMAND_CLIPPER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "command.h"
+#include "command_bounds.h"
+#include "protocol_metrics.h"
+
+// Pixels of a line are numbered by the step along its major axis, 0 at
+// (x0, y0) through max(|x1 - x0|, |y1 - y0|) at (x1, y1).
+struct LineSteps {
+    int first;
+    int last;
+};
+
+// Rounds toward negative infinity / positive infinity; divisor > 0.
+inline int64_t floorDivide(int64_t value, int64_t divisor) {
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+inline int64_t ceilDivide(int64_t value, int64_t divisor) {
+    return -floorDivide(-value, divisor);
+}
+
+// The Bresenham line from (x0, y0) to (x1, y1) puts pixel k at
+//   major = k,  minor = floor((2 * k * minorLength + majorLength) / (2 * majorLength))
+// counted from (x0, y0) in the direction of (x1, y1); Rasterizer::drawLine
+// relies on this to start a line at any step. Clipping is Liang-Barsky on
+// the step parameter: each side of clip bounds k from one end, exactly and
+// in integer math since the minor offset is monotonic in k. Returns false
+// if no pixel of the line lies in clip.
+inline bool clipLineSteps(int x0, int y0, int x1, int y1, const Rect& clip, LineSteps& steps) {
+    int dx = std::abs(x1 - x0);
+    int dy = std::abs(y1 - y0);
+    bool xMajor = dx >= dy;
+    int64_t major = xMajor ? dx : dy;
+    int64_t minor = xMajor ? dy : dx;
+    int64_t first = 0;
+    int64_t last = major;
+
+    // Bounds on the offset from start towards end along one axis, given the
+    // inclusive pixel range [low, high] on that axis.
+    auto offsets = [](int start, int end, int low, int high, int64_t& from, int64_t& to) {
+        if (end >= start) {
+            from = static_cast<int64_t>(low) - start;
+            to = static_cast<int64_t>(high) - start;
+        }
+        else {
+            from = static_cast<int64_t>(start) - high;
+            to = static_cast<int64_t>(start) - low;
+        }
+    };
+    int64_t majorFrom, majorTo, minorFrom, minorTo;
+    if (xMajor) {
+        offsets(x0, x1, clip.left, clip.right - 1, majorFrom, majorTo);
+        offsets(y0, y1, clip.top, clip.bottom - 1, minorFrom, minorTo);
+    }
+    else {
+        offsets(y0, y1, clip.top, clip.bottom - 1, majorFrom, majorTo);
+        offsets(x0, x1, clip.left, clip.right - 1, minorFrom, minorTo);
+    }
+    first = std::max(first, majorFrom);
+    last = std::min(last, majorTo);
+    if (minor == 0) {
+        if (minorFrom > 0 || minorTo < 0) {
+            return false;
+        }
+    }
+    else {
+        // minor(k) >= minorFrom and minor(k) <= minorTo, solved for k.
+        if (minorFrom > 0) {
+            first = std::max(first, ceilDivide(2 * major * minorFrom - major, 2 * minor));
+        }
+        last = std::min(last, floorDivide(2 * major * (minorTo + 1) - major - 1, 2 * minor));
+    }
+    if (first > last) {
+        return false;
+    }
+    steps = { static_cast<int>(first), static_cast<int>(last) };
+    return true;
+}
+
+// First stage of drawing: checks each command against the viewport before
+// anything touches the framebuffer. Commands that draw nothing there are
+// culled: shapes with a negative or zero extent (which by definition draw
+// nothing, so they are dropped rather than flipped) and shapes entirely
+// outside. Fills that are partly outside are cut to the viewport; lines
+// get the range of their steps inside it; outlines and ellipses are left
+// for the rasterizer, which draws only their visible rows. The clipper
+// does not count outcomes: a command clipped once per tile would be
+// counted once per tile, so the caller that sees each command once does.
+class CommandClipper {
+public:
+    CommandClipper(int width, int height) : viewport{ 0, 0, width, height } {}
+    explicit CommandClipper(const Rect& viewport) : viewport(viewport) {}
+
+    void setViewport(const Rect& rectangle) {
+        viewport = rectangle;
+    }
+
+    const Rect& getViewport() const {
+        return viewport;
+    }
+
+    // Clips command in place. For lines the visible steps go to steps when
+    // it is given; the endpoints are kept so the pixels do not move.
+    ClipOutcome clip(CommandData& command, LineSteps* steps = nullptr) const {
+        if (viewport.empty()) {
+            return isFrameMarker(command.opcode) ? CLIP_INSIDE : CLIP_CULLED;
+        }
+        switch (command.opcode) {
+        case DRAW_LINE_OPCODE: {
+            const DrawLineData& c = command.drawLine;
+            LineSteps visible;
+            if (!clipLineSteps(c.x0, c.y0, c.x1, c.y1, viewport, visible)) {
+                return CLIP_CULLED;
+            }
+            if (steps) {
+                *steps = visible;
+            }
+            int length = std::max(std::abs(c.x1 - c.x0), std::abs(c.y1 - c.y0));
+            return visible.first == 0 && visible.last == length ? CLIP_INSIDE : CLIP_CLIPPED;
+        }
+        case FILL_RECTANGLE_OPCODE: {
+            FillRectangleData& c = command.fillRectangle;
+            Rect bounds = commandBounds(command, viewport);
+            Rect visible = bounds.intersect(viewport);
+            if (visible.empty()) {
+                return CLIP_CULLED;
+            }
+            if (viewport.contains(bounds)) {
+                return CLIP_INSIDE;
+            }
+            c.x = static_cast<int16_t>(visible.left);
+            c.y = static_cast<int16_t>(visible.top);
+            c.width = static_cast<int16_t>(visible.right - visible.left);
+            c.height = static_cast<int16_t>(visible.bottom - visible.top);
+            return CLIP_CLIPPED;
+        }
+        case BEGIN_FRAME_OPCODE:
+        case END_FRAME_OPCODE:
+        case CLEAR_DISPLAY_OPCODE:
+            return CLIP_INSIDE;
+        default: {
+            Rect bounds = commandBounds(command, viewport);
+            if (!bounds.intersects(viewport)) {
+                return CLIP_CULLED;
+            }
+            return viewport.contains(bounds) ? CLIP_INSIDE : CLIP_CLIPPED;
+        }
+        }
+    }
+
+private:
+    Rect viewport;
+};
+
+#endif // COMMAND_CLIPPER_H
@@ -0,0 +1,153 @@
+#pragma once
+#ifndef COMMAND_CODEC_H
+#define COMMAND_CODEC_H
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include "command.h"
+
+// How a 16-bit field is laid out on the wire: coordinates are little-endian
+// int16, colors are big-endian RGB565.
+enum FieldEncoding {
+    INT16_FIELD,
+    COLOR_FIELD
+};
+
+const size_t MAX_COMMAND_FIELDS = 5;
+
+struct CommandDescriptor {
+    CommandOpcode opcode;
+    size_t fieldCount;
+    FieldEncoding fields[MAX_COMMAND_FIELDS];
+    const char* error;
+    const char* name;
+};
+
+// The wire format, one row per opcode in opcode order. Fields follow the
+// opcode byte back to back, so a command is 1 + 2 * fieldCount bytes. The
+// decoder, the encoder and commandSize are all generated from this table.
+constexpr CommandDescriptor COMMAND_DESCRIPTORS[] = {
+    { CLEAR_DISPLAY_OPCODE, 1, { COLOR_FIELD }, "Invalid parameters for clear display", "clear_display" },
+    { DRAW_PIXEL_OPCODE, 3, { INT16_FIELD, INT16_FIELD, COLOR_FIELD }, "Invalid parameters for draw pixel", "draw_pixel" },
+    { DRAW_LINE_OPCODE, 5, { INT16_FIELD, INT16_FIELD, INT16_FIELD, INT16_FIELD, COLOR_FIELD }, "Invalid parameters for draw line", "draw_line" },
+    { DRAW_RECTANGLE_OPCODE, 5, { INT16_FIELD, INT16_FIELD, INT16_FIELD, INT16_FIELD, COLOR_FIELD }, "Invalid parameters for draw rectangle", "draw_rectangle" },
+    { FILL_RECTANGLE_OPCODE, 5, { INT16_FIELD, INT16_FIELD, INT16_FIELD, INT16_FIELD, COLOR_FIELD }, "Invalid parameters for fill rectangle", "fill_rectangle" },
+    { DRAW_ELLIPSE_OPCODE, 5, { INT16_FIELD, INT16_FIELD, INT16_FIELD, INT16_FIELD, COLOR_FIELD }, "Invalid parameters for draw ellipse", "draw_ellipse" },
+    { FILL_ELLIPSE_OPCODE, 5, { INT16_FIELD, INT16_FIELD, INT16_FIELD, INT16_FIELD, COLOR_FIELD }, "Invalid parameters for fill ellipse", "fill_ellipse" },
+    { BEGIN_FRAME_OPCODE, 1, { INT16_FIELD }, "Invalid parameters for begin frame", "begin_frame" },
+    { END_FRAME_OPCODE, 1, { INT16_FIELD }, "Invalid parameters for end frame", "end_frame" },
+};
+
+constexpr size_t COMMAND_OPCODE_COUNT = sizeof(COMMAND_DESCRIPTORS) / sizeof(COMMAND_DESCRIPTORS[0]);
+
+constexpr bool descriptorsInOpcodeOrder() {
+    for (size_t i = 0; i < COMMAND_OPCODE_COUNT; ++i) {
+        if (static_cast<size_t>(COMMAND_DESCRIPTORS[i].opcode) != i) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(descriptorsInOpcodeOrder(), "COMMAND_DESCRIPTORS must be indexed by opcode");
+
+static_assert(sizeof(ClearDisplayData) == 2 * COMMAND_DESCRIPTORS[CLEAR_DISPLAY_OPCODE].fieldCount, "ClearDisplayData does not match its descriptor");
+static_assert(sizeof(DrawPixelData) == 2 * COMMAND_DESCRIPTORS[DRAW_PIXEL_OPCODE].fieldCount, "DrawPixelData does not match its descriptor");
+static_assert(sizeof(DrawLineData) == 2 * COMMAND_DESCRIPTORS[DRAW_LINE_OPCODE].fieldCount, "DrawLineData does not match its descriptor");
+static_assert(sizeof(DrawRectangleData) == 2 * COMMAND_DESCRIPTORS[DRAW_RECTANGLE_OPCODE].fieldCount, "DrawRectangleData does not match its descriptor");
+static_assert(sizeof(FillRectangleData) == 2 * COMMAND_DESCRIPTORS[FILL_RECTANGLE_OPCODE].fieldCount, "FillRectangleData does not match its descriptor");
+static_assert(sizeof(DrawEllipseData) == 2 * COMMAND_DESCRIPTORS[DRAW_ELLIPSE_OPCODE].fieldCount, "DrawEllipseData does not match its descriptor");
+static_assert(sizeof(FillEllipseData) == 2 * COMMAND_DESCRIPTORS[FILL_ELLIPSE_OPCODE].fieldCount, "FillEllipseData does not match its descriptor");
+static_assert(sizeof(BeginFrameData) == 2 * COMMAND_DESCRIPTORS[BEGIN_FRAME_OPCODE].fieldCount, "BeginFrameData does not match its descriptor");
+static_assert(sizeof(EndFrameData) == 2 * COMMAND_DESCRIPTORS[END_FRAME_OPCODE].fieldCount, "EndFrameData does not match its descriptor");
+
+constexpr size_t commandWireSize(const CommandDescriptor& descriptor) {
+    return 1 + 2 * descriptor.fieldCount;
+}
+
+// Wire size of a single command including its opcode byte, 0 if unknown.
+inline size_t commandSize(uint8_t opcode) {
+    return opcode < COMMAND_OPCODE_COUNT ? commandWireSize(COMMAND_DESCRIPTORS[opcode]) : 0;
+}
+
+// Payload fields of a command in wire order. Every payload struct is a run of
+// 16-bit members, so the union in CommandData is read and written as this.
+inline void loadFields(const CommandData& command, uint16_t* fields, size_t count) {
+    std::memcpy(fields, &command.clearDisplay, 2 * count);
+}
+
+inline void storeFields(CommandData& command, const uint16_t* fields, size_t count) {
+    std::memcpy(&command.clearDisplay, fields, 2 * count);
+}
+
+template <FieldEncoding Encoding>
+inline uint16_t readField(const uint8_t* data) {
+    return Encoding == COLOR_FIELD ? static_cast<uint16_t>((data[0] << 8) | data[1])
+                                   : static_cast<uint16_t>((data[1] << 8) | data[0]);
+}
+
+template <FieldEncoding Encoding>
+inline void writeField(uint16_t value, uint8_t* data) {
+    uint8_t low = static_cast<uint8_t>(value);
+    uint8_t high = static_cast<uint8_t>(value >> 8);
+    data[0] = Encoding == COLOR_FIELD ? high : low;
+    data[1] = Encoding == COLOR_FIELD ? low : high;
+}
+
+template <uint8_t Opcode, size_t... Field>
+inline void decodeFields(const uint8_t* data, CommandData& command, std::index_sequence<Field...>) {
+    constexpr const CommandDescriptor& descriptor = COMMAND_DESCRIPTORS[Opcode];
+    uint16_t fields[MAX_COMMAND_FIELDS];
+    ((fields[Field] = readField<descriptor.fields[Field]>(data + 1 + 2 * Field)), ...);
+    command.opcode = descriptor.opcode;
+    storeFields(command, fields, descriptor.fieldCount);
+}
+
+template <uint8_t Opcode, size_t... Field>
+inline void encodeFields(const CommandData& command, uint8_t* data, std::index_sequence<Field...>) {
+    constexpr const CommandDescriptor& descriptor = COMMAND_DESCRIPTORS[Opcode];
+    uint16_t fields[MAX_COMMAND_FIELDS];
+    loadFields(command, fields, descriptor.fieldCount);
+    data[0] = Opcode;
+    (writeField<descriptor.fields[Field]>(fields[Field], data + 1 + 2 * Field), ...);
+}
+
+// Calls handler with std::integral_constant<uint8_t, opcode>, so the handler
+// body is instantiated and inlined once per table row. Returns false for an
+// unknown opcode.
+template <typename Handler, size_t... Opcode>
+inline bool dispatchOpcode(uint8_t opcode, Handler&& handler, std::index_sequence<Opcode...>) {
+    return ((opcode == Opcode && (handler(std::integral_constant<uint8_t, Opcode>()), true)) || ...);
+}
+
+template <typename Handler>
+inline bool dispatchOpcode(uint8_t opcode, Handler&& handler) {
+    return dispatchOpcode(opcode, handler, std::make_index_sequence<COMMAND_OPCODE_COUNT>());
+}
+
+// Decodes a command whose opcode and size have already been validated.
+inline void decodeCommand(const uint8_t* data, CommandData& command) {
+    dispatchOpcode(data[0], [&](auto opcode) {
+        constexpr size_t count = COMMAND_DESCRIPTORS[decltype(opcode)::value].fieldCount;
+        decodeFields<decltype(opcode)::value>(data, command, std::make_index_sequence<count>());
+    });
+}
+
+// Writes the wire encoding of command to data, which must have room for
+// commandSize(command.opcode) bytes. Returns the number of bytes written.
+inline size_t encodeCommand(const CommandData& command, uint8_t* data) {
+    dispatchOpcode(static_cast<uint8_t>(command.opcode), [&](auto opcode) {
+        constexpr size_t count = COMMAND_DESCRIPTORS[decltype(opcode)::value].fieldCount;
+        encodeFields<decltype(opcode)::value>(command, data, std::make_index_sequence<count>());
+    });
+    return commandSize(static_cast<uint8_t>(command.opcode));
+}
+
+inline void appendCommand(const CommandData& command, std::vector<uint8_t>& byteArray) {
+    size_t offset = byteArray.size();
+    byteArray.resize(offset + commandSize(static_cast<uint8_t>(command.opcode)));
+    encodeCommand(command, byteArray.data() + offset);
+}
+
+#endif // COMMAND_CODEC_H
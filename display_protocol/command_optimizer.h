@@ -0,0 +1,173 @@
+#pragma once
+#ifndef COMMAND_OPTIMIZER_H
+#define COMMAND_OPTIMIZER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include "command.h"
+#include "command_bounds.h"
+
+struct OptimizerStats {
+    size_t commandsIn = 0;
+    size_t commandsOut = 0;
+    // Commands removed because later opaque fills cover them or because they
+    // lie entirely off the surface.
+    size_t commandsDropped = 0;
+    // Commands folded into a neighbour: DrawPixel runs merged into one fill.
+    size_t commandsMerged = 0;
+    // DrawLine commands turned into FillRectangle.
+    size_t linesConverted = 0;
+    // On-surface bounding-box area of the dropped commands, an upper bound on
+    // the pixel writes saved.
+    long long pixelsEliminated = 0;
+};
+
+// Rewrites a decoded frame into a cheaper one with identical final pixels:
+//  - horizontal and vertical DrawLine become one-pixel-thick FillRectangle;
+//  - consecutive same-colored DrawPixel commands on one row (or column) with
+//    increasing, adjacent coordinates become one FillRectangle;
+//  - commands whose on-surface bounds are empty, or fully inside the area of
+//    a later ClearDisplay or FillRectangle of the same frame, are dropped.
+//    Frame markers are always kept.
+// Every rewrite only changes commands that are adjacent in the stream or
+// fully overwritten later, so the drawing order of the rest is untouched.
+class CommandOptimizer {
+public:
+    explicit CommandOptimizer(const Rect& surface, size_t maxOccluders = 16) :
+        surface(surface), maxOccluders(maxOccluders) {}
+
+    const OptimizerStats& optimize(std::vector<CommandData>& commands) {
+        stats = OptimizerStats();
+        stats.commandsIn = commands.size();
+        convertLines(commands);
+        mergePixelRuns(commands);
+        dropOverdrawn(commands);
+        stats.commandsOut = commands.size();
+        return stats;
+    }
+
+    const OptimizerStats& lastStats() const {
+        return stats;
+    }
+
+private:
+    static bool fitsExtent(int extent) {
+        return extent > 0 && extent <= INT16_MAX;
+    }
+
+    static CommandData fill(int x, int y, int width, int height, uint16_t color) {
+        CommandData command;
+        command.opcode = FILL_RECTANGLE_OPCODE;
+        command.fillRectangle = { static_cast<int16_t>(x), static_cast<int16_t>(y),
+            static_cast<int16_t>(width), static_cast<int16_t>(height), color };
+        return command;
+    }
+
+    void convertLines(std::vector<CommandData>& commands) {
+        for (CommandData& command : commands) {
+            if (command.opcode != DRAW_LINE_OPCODE) {
+                continue;
+            }
+            const DrawLineData line = command.drawLine;
+            int width = std::abs(line.x1 - line.x0) + 1;
+            int height = std::abs(line.y1 - line.y0) + 1;
+            if ((line.y0 == line.y1 || line.x0 == line.x1) && fitsExtent(width) && fitsExtent(height)) {
+                command = fill(std::min(line.x0, line.x1), std::min(line.y0, line.y1), width, height, line.color);
+                ++stats.linesConverted;
+            }
+        }
+    }
+
+    void mergePixelRuns(std::vector<CommandData>& commands) {
+        size_t out = 0;
+        for (size_t i = 0; i < commands.size();) {
+            if (commands[i].opcode != DRAW_PIXEL_OPCODE) {
+                commands[out++] = commands[i++];
+                continue;
+            }
+            const DrawPixelData first = commands[i].drawPixel;
+            size_t end = i + 1;
+            int dx = 0;
+            int dy = 0;
+            if (end < commands.size() && commands[end].opcode == DRAW_PIXEL_OPCODE && commands[end].drawPixel.color == first.color) {
+                dx = commands[end].drawPixel.x0 - first.x0;
+                dy = commands[end].drawPixel.y0 - first.y0;
+            }
+            if ((dx == 1 && dy == 0) || (dx == 0 && dy == 1)) {
+                int run = 1;
+                while (end < commands.size() && run < INT16_MAX && commands[end].opcode == DRAW_PIXEL_OPCODE) {
+                    const DrawPixelData& next = commands[end].drawPixel;
+                    if (next.color != first.color || next.x0 != first.x0 + dx * run || next.y0 != first.y0 + dy * run) {
+                        break;
+                    }
+                    ++run;
+                    ++end;
+                }
+                commands[out++] = fill(first.x0, first.y0, dx ? run : 1, dy ? run : 1, first.color);
+                stats.commandsMerged += run - 1;
+                i = end;
+            }
+            else {
+                commands[out++] = commands[i++];
+            }
+        }
+        commands.resize(out);
+    }
+
+    // Walks the frame backwards collecting the areas that later opaque fills
+    // overwrite. Only a bounded number of the largest is kept, which can
+    // only make the pass keep more commands, never drop a visible one.
+    void dropOverdrawn(std::vector<CommandData>& commands) {
+        occluders.clear();
+        keep.assign(commands.size(), true);
+        for (size_t i = commands.size(); i-- > 0;) {
+            if (isFrameMarker(commands[i].opcode)) {
+                occluders.clear();
+                continue;
+            }
+            Rect bounds = commandBounds(commands[i], surface).intersect(surface);
+            bool hidden = bounds.empty();
+            for (size_t o = 0; o < occluders.size() && !hidden; ++o) {
+                hidden = occluders[o].contains(bounds);
+            }
+            if (hidden) {
+                keep[i] = false;
+                ++stats.commandsDropped;
+                stats.pixelsEliminated += bounds.area();
+                continue;
+            }
+            if (commands[i].opcode == CLEAR_DISPLAY_OPCODE || commands[i].opcode == FILL_RECTANGLE_OPCODE) {
+                addOccluder(bounds);
+            }
+        }
+        size_t out = 0;
+        for (size_t i = 0; i < commands.size(); ++i) {
+            if (keep[i]) {
+                commands[out++] = commands[i];
+            }
+        }
+        commands.resize(out);
+    }
+
+    void addOccluder(const Rect& area) {
+        if (occluders.size() < maxOccluders) {
+            occluders.push_back(area);
+            return;
+        }
+        auto smallest = std::min_element(occluders.begin(), occluders.end(),
+            [](const Rect& a, const Rect& b) { return a.area() < b.area(); });
+        if (smallest->area() < area.area()) {
+            *smallest = area;
+        }
+    }
+
+    Rect surface;
+    size_t maxOccluders;
+    OptimizerStats stats;
+    std::vector<Rect> occluders;
+    std::vector<bool> keep;
+};
+
+#endif // COMMAND_OPTIMIZER_H
@@ -0,0 +1,177 @@
+#pragma once
+#ifndef COMPACT_CODEC_H
+#define COMPACT_CODEC_H
+
+#include <vector>
+#include <cstdint>
+#include "command_codec.h"
+
+// Compact (v2) batch encoding, accepted next to the v1 formats. A datagram
+// is COMPACT_BATCH_MARKER, a varint sequence number, a varint command count
+// and the commands. Each command starts with a header byte: the opcode in
+// the low four bits and COMPACT_COLOR_FLAG when a new color follows.
+// Without the flag the command reuses the current color. The position of a
+// shape is a pair of zig-zag varint deltas from the previous shape's
+// position; a line's end point is relative to its own start and every
+// other field (extents, frame numbers) is a plain zig-zag varint. A new color is two bytes, big-endian as in
+// v1. Origin and color start at zero in every batch, so a lost datagram
+// never corrupts the next one; the sequence number exposes the loss.
+const uint8_t COMPACT_BATCH_MARKER = 0x81;
+const uint8_t COMPACT_OPCODE_MASK = 0x0F;
+const uint8_t COMPACT_COLOR_FLAG = 0x10;
+
+static_assert(COMMAND_OPCODE_COUNT <= COMPACT_OPCODE_MASK + 1, "Opcodes must fit the compact header nibble");
+
+// Encoder and decoder state carried from one command to the next.
+// Only commands with a position move the origin.
+struct CompactState {
+    int16_t x = 0;
+    int16_t y = 0;
+    uint16_t color = 0;
+};
+
+// Deltas wrap modulo 2^16, so every int16 field takes at most three bytes.
+inline uint16_t zigZagEncode(int16_t value) {
+    return static_cast<uint16_t>((static_cast<uint16_t>(value) << 1) ^ static_cast<uint16_t>(value >> 15));
+}
+
+inline int16_t zigZagDecode(uint32_t value) {
+    return static_cast<int16_t>((value >> 1) ^ (0u - (value & 1)));
+}
+
+inline void appendVarint(uint32_t value, std::vector<uint8_t>& byteArray) {
+    while (value >= 0x80) {
+        byteArray.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    byteArray.push_back(static_cast<uint8_t>(value));
+}
+
+// Reads a varint of at most maxBytes bytes at cursor and advances it.
+// Returns false on truncation, an overlong encoding, a value above
+// maxValue or a zero last byte after the first, so every value has exactly
+// one encoding and nothing is silently truncated.
+inline bool readVarint(const uint8_t*& cursor, const uint8_t* end, size_t maxBytes, uint32_t maxValue, uint32_t& value) {
+    if (cursor < end && *cursor < 0x80) {
+        value = *cursor++;
+        return value <= maxValue;
+    }
+    uint64_t wide = 0;
+    for (size_t i = 0; i < maxBytes && cursor < end; ++i) {
+        uint8_t byte = *cursor++;
+        wide |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if (byte < 0x80) {
+            value = static_cast<uint32_t>(wide);
+            return byte != 0 && wide <= maxValue;
+        }
+    }
+    return false;
+}
+
+const size_t INT16_VARINT_BYTES = 3;
+const size_t UINT32_VARINT_BYTES = 5;
+
+// Value a coordinate field is encoded relative to; coords holds the fields
+// already seen in this command.
+inline int16_t compactBase(uint8_t opcode, const CompactState& state, const int16_t* coords, size_t coord) {
+    if (COMMAND_DESCRIPTORS[opcode].fieldCount < 3) {
+        return 0;
+    }
+    if (coord < 2) {
+        return coord == 0 ? state.x : state.y;
+    }
+    return opcode == DRAW_LINE_OPCODE ? coords[coord - 2] : 0;
+}
+
+inline void appendCompactCommand(const CommandData& command, CompactState& state, std::vector<uint8_t>& byteArray) {
+    const CommandDescriptor& descriptor = COMMAND_DESCRIPTORS[command.opcode];
+    uint16_t fields[MAX_COMMAND_FIELDS];
+    loadFields(command, fields, descriptor.fieldCount);
+
+    size_t headerOffset = byteArray.size();
+    byteArray.push_back(static_cast<uint8_t>(command.opcode));
+    int16_t coords[4] = {};
+    size_t coord = 0;
+    for (size_t i = 0; i < descriptor.fieldCount; ++i) {
+        if (descriptor.fields[i] == COLOR_FIELD) {
+            if (fields[i] != state.color) {
+                byteArray[headerOffset] |= COMPACT_COLOR_FLAG;
+                byteArray.push_back(static_cast<uint8_t>(fields[i] >> 8));
+                byteArray.push_back(static_cast<uint8_t>(fields[i]));
+                state.color = fields[i];
+            }
+            continue;
+        }
+        int16_t value = static_cast<int16_t>(fields[i]);
+        int16_t base = compactBase(static_cast<uint8_t>(command.opcode), state, coords, coord);
+        coords[coord++] = value;
+        appendVarint(zigZagEncode(static_cast<int16_t>(value - base)), byteArray);
+    }
+    if (coord >= 2) {
+        state.x = coords[0];
+        state.y = coords[1];
+    }
+}
+
+// Encodes commands as one compact batch, replacing the contents of byteArray.
+inline void encodeCompactBatch(const std::vector<CommandData>& commands, uint32_t sequence, std::vector<uint8_t>& byteArray) {
+    byteArray.assign(1, COMPACT_BATCH_MARKER);
+    appendVarint(sequence, byteArray);
+    appendVarint(static_cast<uint32_t>(commands.size()), byteArray);
+    CompactState state;
+    for (const CommandData& command : commands) {
+        appendCompactCommand(command, state, byteArray);
+    }
+}
+
+// Decodes one compact command at cursor into its opcode, up to four
+// coordinates in wire order and a color, advancing cursor. Returns false
+// for an unknown opcode, a color flag on a command without a color or a
+// command that runs past end.
+inline bool decodeCompactCommand(const uint8_t*& cursor, const uint8_t* end, CompactState& state,
+    uint8_t& opcode, int16_t coords[4], uint16_t& color) {
+    if (cursor >= end) {
+        return false;
+    }
+    uint8_t header = *cursor++;
+    opcode = header & COMPACT_OPCODE_MASK;
+    if (opcode >= COMMAND_OPCODE_COUNT || (header & ~(COMPACT_OPCODE_MASK | COMPACT_COLOR_FLAG)) != 0) {
+        return false;
+    }
+    const CommandDescriptor& descriptor = COMMAND_DESCRIPTORS[opcode];
+    size_t coord = 0;
+    bool colored = false;
+    for (size_t i = 0; i < descriptor.fieldCount; ++i) {
+        if (descriptor.fields[i] == COLOR_FIELD) {
+            colored = true;
+            if (header & COMPACT_COLOR_FLAG) {
+                if (end - cursor < 2) {
+                    return false;
+                }
+                state.color = static_cast<uint16_t>((cursor[0] << 8) | cursor[1]);
+                cursor += 2;
+            }
+            continue;
+        }
+        uint32_t encoded;
+        if (!readVarint(cursor, end, INT16_VARINT_BYTES, UINT16_MAX, encoded)) {
+            return false;
+        }
+        int16_t base = compactBase(opcode, state, coords, coord);
+        coords[coord++] = static_cast<int16_t>(base + zigZagDecode(encoded));
+    }
+    if ((header & COMPACT_COLOR_FLAG) && !colored) {
+        return false;
+    }
+    for (size_t i = coord; i < 4; ++i) {
+        coords[i] = 0;
+    }
+    if (coord >= 2) {
+        state.x = coords[0];
+        state.y = coords[1];
+    }
+    color = state.color;
+    return true;
+}
+
+#endif // COMPACT_CODEC_H
@@ -0,0 +1,126 @@
+#pragma once
+#ifndef DAMAGE_REGION_H
+#define DAMAGE_REGION_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "command_bounds.h"
+#include "framebuffer.h"
+
+// Parts of a surface changed since the last flush, kept as at most maxRects
+// pairwise disjoint rectangles. Overlapping rectangles are merged into their
+// bounding box; when the list is full the pair whose merge adds the least
+// undamaged area is combined.
+class DamageRegion {
+public:
+    explicit DamageRegion(const Rect& surface, size_t maxRects = 8) : surface(surface), maxRects(maxRects) {
+        if (maxRects == 0) {
+            throw std::invalid_argument("Damage region needs at least one rectangle");
+        }
+        rects.reserve(maxRects + 1);
+    }
+
+    void add(const Rect& rectangle) {
+        Rect damage = rectangle.intersect(surface);
+        if (damage.empty()) {
+            return;
+        }
+        if (!rects.empty() && rects.front().contains(damage)) {
+            return;
+        }
+        absorb(damage);
+        while (rects.size() > maxRects) {
+            mergeCheapestPair();
+        }
+    }
+
+    void addFull() {
+        rects.assign(1, surface);
+    }
+
+    bool empty() const {
+        return rects.empty();
+    }
+
+    const std::vector<Rect>& getRects() const {
+        return rects;
+    }
+
+    long long area() const {
+        long long total = 0;
+        for (const Rect& rect : rects) {
+            total += rect.area();
+        }
+        return total;
+    }
+
+    // Moves the accumulated rectangles into out and starts a new region.
+    void take(std::vector<Rect>& out) {
+        out.assign(rects.begin(), rects.end());
+        rects.clear();
+    }
+
+    void reset() {
+        rects.clear();
+    }
+
+private:
+    // Inserts damage, first swallowing every rectangle it overlaps; growing
+    // damage can reach further ones, so rescan after each merge.
+    void absorb(Rect damage) {
+        for (size_t i = 0; i < rects.size();) {
+            if (rects[i].intersects(damage)) {
+                damage = damage.unite(rects[i]);
+                rects[i] = rects.back();
+                rects.pop_back();
+                i = 0;
+            }
+            else {
+                ++i;
+            }
+        }
+        rects.push_back(damage);
+    }
+
+    void mergeCheapestPair() {
+        size_t bestA = 0;
+        size_t bestB = 1;
+        long long bestCost = -1;
+        for (size_t a = 0; a < rects.size(); ++a) {
+            for (size_t b = a + 1; b < rects.size(); ++b) {
+                long long cost = rects[a].unite(rects[b]).area() - rects[a].area() - rects[b].area();
+                if (bestCost < 0 || cost < bestCost) {
+                    bestA = a;
+                    bestB = b;
+                    bestCost = cost;
+                }
+            }
+        }
+        Rect merged = rects[bestA].unite(rects[bestB]);
+        rects.erase(rects.begin() + bestB);
+        rects.erase(rects.begin() + bestA);
+        absorb(merged);
+    }
+
+    Rect surface;
+    size_t maxRects;
+    std::vector<Rect> rects;
+};
+
+// Copies the damaged pixels of source into the same places in destination,
+// which must be at least as large. Returns the number of bytes copied.
+inline size_t flushDamage(const Framebuffer& source, Framebuffer& destination, const std::vector<Rect>& damage) {
+    size_t bytes = 0;
+    for (const Rect& rect : damage) {
+        size_t rowBytes = static_cast<size_t>(rect.right - rect.left) * sizeof(uint16_t);
+        for (int y = rect.top; y < rect.bottom; ++y) {
+            std::memcpy(destination.row(y) + rect.left, source.row(y) + rect.left, rowBytes);
+        }
+        bytes += rowBytes * (rect.bottom - rect.top);
+    }
+    return bytes;
+}
+
+#endif // DAMAGE_REGION_H
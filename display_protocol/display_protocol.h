@@ -3,207 +3,340 @@
 #define DISPLAY_PROTOCOL_H
 
 #include <vector>
+#include <algorithm>
 #include <cstdint>
 #include <stdexcept>
+#include "command_codec.h"
+#include "command_arena.h"
+#include "bulk_commands.h"
+#include "protocol_metrics.h"
+#include "compact_codec.h"
+#include "record_decoder.h"
 
+// First byte of a batch datagram. Chosen outside the opcode range so a batch
+// can never be mistaken for a single command.
+const uint8_t BATCH_MARKER = 0x80;
+// Marker followed by the little-endian uint16 command count.
+const size_t BATCH_HEADER_SIZE = 3;
 
+// Encodes commands as one batch datagram, replacing the contents of byteArray.
+inline void encodeBatch(const std::vector<CommandData>& commands, std::vector<uint8_t>& byteArray) {
+    byteArray.assign({ BATCH_MARKER, static_cast<uint8_t>(commands.size()), static_cast<uint8_t>(commands.size() >> 8) });
+    for (const CommandData& command : commands) {
+        appendCommand(command, byteArray);
+    }
+}
 
+// Decoded commands stored as a structure of arrays. Geometry goes into the
+// four coordinate columns in wire order: x/y/width/height for rectangles,
+// x/y/rx/ry for ellipses; fields an opcode does not have are zero.
+// clear() keeps the capacity, so a buffer reused across datagrams stops
+// allocating once it has grown to the largest batch seen.
+struct CommandBuffer {
+    std::vector<uint8_t> opcode;
+    std::vector<int16_t> x0;
+    std::vector<int16_t> y0;
+    std::vector<int16_t> x1;
+    std::vector<int16_t> y1;
+    std::vector<uint16_t> color;
 
-enum CommandOpcode {
-    CLEAR_DISPLAY_OPCODE,
-    DRAW_PIXEL_OPCODE,
-    DRAW_LINE_OPCODE,
-    DRAW_RECTANGLE_OPCODE,
-    FILL_RECTANGLE_OPCODE,
-    DRAW_ELLIPSE_OPCODE,
-    FILL_ELLIPSE_OPCODE
-};
+    size_t size() const { return opcode.size(); }
+    bool empty() const { return opcode.empty(); }
 
+    void reserve(size_t capacity) {
+        opcode.reserve(capacity);
+        x0.reserve(capacity);
+        y0.reserve(capacity);
+        x1.reserve(capacity);
+        y1.reserve(capacity);
+        color.reserve(capacity);
+    }
 
-struct Command {
-    const CommandOpcode opcode;
+    void clear() { truncate(0); }
 
-    Command(const CommandOpcode opcode) : opcode(opcode) {};
-    virtual ~Command() {}
-};
-struct ClearDisplay : Command {
-    const uint16_t color;
+    void truncate(size_t count) {
+        opcode.resize(count);
+        x0.resize(count);
+        y0.resize(count);
+        x1.resize(count);
+        y1.resize(count);
+        color.resize(count);
+    }
 
-    ClearDisplay(const uint16_t color) : Command(CLEAR_DISPLAY_OPCODE), color(color) {};
-};
+    void push(CommandOpcode op, int16_t a, int16_t b, int16_t c, int16_t d, uint16_t rgb) {
+        opcode.push_back(static_cast<uint8_t>(op));
+        x0.push_back(a);
+        y0.push_back(b);
+        x1.push_back(c);
+        y1.push_back(d);
+        color.push_back(rgb);
+    }
 
-struct DrawPixel : Command {
-    const int16_t x0;
-    const int16_t y0;
-    const uint16_t color;
+    // Coordinate fields land in x0, y0, x1, y1 in wire order, the color field
+    // in color; the layout comes from COMMAND_DESCRIPTORS.
+    void push(const CommandData& command) {
+        const CommandDescriptor& descriptor = COMMAND_DESCRIPTORS[command.opcode];
+        uint16_t fields[MAX_COMMAND_FIELDS];
+        loadFields(command, fields, descriptor.fieldCount);
+        int16_t coords[4] = {};
+        uint16_t rgb = 0;
+        size_t coord = 0;
+        for (size_t i = 0; i < descriptor.fieldCount; ++i) {
+            if (descriptor.fields[i] == COLOR_FIELD) {
+                rgb = fields[i];
+            }
+            else {
+                coords[coord++] = static_cast<int16_t>(fields[i]);
+            }
+        }
+        push(command.opcode, coords[0], coords[1], coords[2], coords[3], rgb);
+    }
 
-    DrawPixel(const int16_t x0, const int16_t y0, const uint16_t color) :
-        Command(DRAW_PIXEL_OPCODE), x0(x0), y0(y0), color(color) {};
-};
+    // Appends count back-to-back geometry records of one opcode (see
+    // record_decoder.h), unpacked by the vector kernels.
+    void appendRecords(const uint8_t* records, size_t count) {
+        size_t start = size();
+        truncate(start + count);
+        std::fill(opcode.begin() + start, opcode.end(), records[0]);
+        decodeRecords(records, count, { x0.data() + start, y0.data() + start, x1.data() + start, y1.data() + start, color.data() + start });
+    }
 
-struct DrawLine : Command {
-    const int16_t x0;
-    const int16_t y0;
-    const int16_t x1;
-    const int16_t y1;
-    const uint16_t color;
+    // Rebuilds the tagged value for one row.
+    CommandData at(size_t index) const {
+        CommandData command;
+        command.opcode = static_cast<CommandOpcode>(opcode[index]);
+        const CommandDescriptor& descriptor = COMMAND_DESCRIPTORS[command.opcode];
+        const int16_t coords[4] = { x0[index], y0[index], x1[index], y1[index] };
+        uint16_t fields[MAX_COMMAND_FIELDS];
+        size_t coord = 0;
+        for (size_t i = 0; i < descriptor.fieldCount; ++i) {
+            fields[i] = descriptor.fields[i] == COLOR_FIELD ? color[index] : static_cast<uint16_t>(coords[coord++]);
+        }
+        storeFields(command, fields, descriptor.fieldCount);
+        return command;
+    }
+};
 
-    DrawLine(const int16_t x0, const int16_t y0, const int16_t x1, const int16_t y1, const uint16_t color) :
-        Command(DRAW_LINE_OPCODE), x0(x0), y0(y0), x1(x1), y1(y1), color(color) {};
+// Outcome of the non-throwing parse entry points. Every failure has the
+// ErrorReason it is counted under in the protocol metrics.
+enum ParseStatus : uint8_t {
+    PARSE_OK,
+    PARSE_EMPTY_INPUT,
+    PARSE_UNKNOWN_OPCODE,
+    PARSE_INVALID_LENGTH,
+    PARSE_MALFORMED_BATCH
 };
+static_assert(PARSE_MALFORMED_BATCH == MALFORMED_BATCH_ERROR + 1, "ParseStatus must follow ErrorReason");
 
-struct DrawRectangle : Command {
-    const int16_t x;
-    const int16_t y;
-    const int16_t width;
-    const int16_t height;
-    const uint16_t color;
+inline ParseStatus parseStatus(ErrorReason reason) {
+    return static_cast<ParseStatus>(reason + 1);
+}
 
-    DrawRectangle(const int16_t x, const int16_t y, const int16_t width, const int16_t height, const uint16_t color) :
-        Command(DRAW_RECTANGLE_OPCODE), x(x), y(y), width(width), height(height), color(color) {};
-};
+// The ErrorReason of a failed status.
+inline ErrorReason parseErrorReason(ParseStatus status) {
+    return static_cast<ErrorReason>(status - 1);
+}
 
-struct FillRectangle : Command {
-    const int16_t x;
-    const int16_t y;
-    const int16_t width;
-    const int16_t height;
-    const uint16_t color;
+class DisplayProtocol {
+public:
+    // Decodes one datagram by value without touching the heap or throwing.
+    // On PARSE_INVALID_LENGTH command.opcode is the opcode whose length did
+    // not match; otherwise command is only meaningful for PARSE_OK. When
+    // message is given it receives the description the throwing overload
+    // uses.
+    ParseStatus tryParseCommand(const uint8_t* data, size_t size, CommandData& command, const char** message = nullptr) noexcept {
+        LatencySample sample;
+        sample.start(PARSE_LATENCY);
+        if (size == 0) {
+            return reject(EMPTY_INPUT_ERROR, "Empty byte array", message);
+        }
+        //    
+        uint8_t opcode = data[0];
+        if (opcode >= COMMAND_OPCODE_COUNT) {
+            return reject(UNKNOWN_OPCODE_ERROR, "Unknown command opcode", message);
+        }
+        const CommandDescriptor& descriptor = COMMAND_DESCRIPTORS[opcode];
+        if (size != commandWireSize(descriptor)) {
+            command.opcode = static_cast<CommandOpcode>(opcode);
+            return reject(INVALID_LENGTH_ERROR, descriptor.error, message);
+        }
+        countOpcode(opcode);
+        decodeCommand(data, command);
+        sample.stop();
+        return PARSE_OK;
+    }
 
-    FillRectangle(const int16_t x, const int16_t y, const int16_t width, const int16_t height, const uint16_t color) :
-        Command(FILL_RECTANGLE_OPCODE), x(x), y(y), width(width), height(height), color(color) {};
-};
+    CommandData parseCommand(const uint8_t* data, size_t size) {
+        CommandData command;
+        const char* message;
+        if (tryParseCommand(data, size, command, &message) != PARSE_OK) {
+            throw std::invalid_argument(message);
+        }
+        return command;
+    }
 
-struct DrawEllipse : Command {
-    const int16_t x;
-    const int16_t y;
-    const int16_t rx;
-    const int16_t ry;
-    const uint16_t color;
+    CommandData parseCommand(const std::vector<uint8_t>& byteArray) {
+        return parseCommand(byteArray.data(), byteArray.size());
+    }
 
-    DrawEllipse(const int16_t x, const int16_t y, const int16_t rx, const int16_t ry, const uint16_t color) :
-        Command(DRAW_ELLIPSE_OPCODE), x(x), y(y), rx(rx), ry(ry), color(color) {};
-};
+    // Old interface: the command is allocated with new and owned by the caller.
+    void parseCommand(const std::vector<uint8_t>& byteArray, Command*& command) {
+        command = makeCommand(parseCommand(byteArray));
+    }
 
-struct FillEllipse : Command {
-    const int16_t x;
-    const int16_t y;
-    const int16_t rx;
-    const int16_t ry;
-    const uint16_t color;
+    // Old interface with the command made in arena instead of on the heap;
+    // it stays valid until arena.reset() and must not be deleted.
+    void parseCommand(const std::vector<uint8_t>& byteArray, Command*& command, CommandArena& arena) {
+        command = makeCommand(parseCommand(byteArray), arena);
+    }
 
-    FillEllipse(const int16_t x, const int16_t y, const int16_t rx, const int16_t ry, const uint16_t color) :
-        Command(FILL_ELLIPSE_OPCODE), x(x), y(y), rx(rx), ry(ry), color(color) {};
-};
+    // Decodes a bulk command datagram (see bulk_commands.h) without
+    // throwing. The views point into data and are valid only as long as it
+    // is.
+    ParseStatus tryParseBulkCommand(const uint8_t* data, size_t size, BulkCommandView& view, const char** message = nullptr) noexcept {
+        if (size == 0) {
+            return reject(EMPTY_INPUT_ERROR, "Empty byte array", message);
+        }
+        if (!isBulkOpcode(data[0])) {
+            return reject(UNKNOWN_OPCODE_ERROR, "Unknown command opcode", message);
+        }
+        if (!decodeBulkCommand(data, size, view)) {
+            return reject(INVALID_LENGTH_ERROR, bulkLayout(data[0]).error, message);
+        }
+        countOpcode(data[0]);
+        return PARSE_OK;
+    }
 
-class DisplayProtocol {
-public:
-    void parseCommand(const std::vector<uint8_t>& byteArray, Command*& command) {
-        if (byteArray.empty()) {
-            throw std::invalid_argument("Empty byte array");
+    BulkCommandView parseBulkCommand(const uint8_t* data, size_t size) {
+        BulkCommandView view;
+        const char* message;
+        if (tryParseBulkCommand(data, size, view, &message) != PARSE_OK) {
+            throw std::invalid_argument(message);
         }
-        //    
-        uint8_t opcode = byteArray[0];
-        switch (opcode) {
-        case CLEAR_DISPLAY_OPCODE: {
-            if (byteArray.size() != 3) {
-                throw std::invalid_argument("Invalid parameters for clear display");
-            }
-            uint16_t color = parseColor(byteArray, 1);
-            command = new ClearDisplay(color);
-            break;
+        return view;
+    }
+
+    // Decodes a batch datagram (BATCH_MARKER, uint16 count, then count
+    // commands back to back in their single-datagram encoding) and appends
+    // the commands to buffer, storing their number in count. On a malformed
+    // batch nothing is appended and PARSE_MALFORMED_BATCH is returned. Only
+    // throws if buffer has to grow and allocation fails.
+    ParseStatus tryParseBatch(const uint8_t* data, size_t size, CommandBuffer& buffer, size_t& count, const char** message = nullptr) {
+        if (size < BATCH_HEADER_SIZE || data[0] != BATCH_MARKER) {
+            return reject(MALFORMED_BATCH_ERROR, "Invalid batch header", message);
         }
-        case DRAW_PIXEL_OPCODE: {
-            if (byteArray.size() != 7) {
-                throw std::invalid_argument("Invalid parameters for draw pixel");
-            }
-            int16_t x0 = parseInt16(byteArray, 1);
-            int16_t y0 = parseInt16(byteArray, 3);
-            uint16_t color = parseColor(byteArray, 5);
-            command = new DrawPixel(x0, y0, color);
-            break;
-        }
-        case DRAW_LINE_OPCODE: {
-            if (byteArray.size() != 11) {
-                throw std::invalid_argument("Invalid parameters for draw line");
-            }
-            int16_t x0 = parseInt16(byteArray, 1);
-            int16_t y0 = parseInt16(byteArray, 3);
-            int16_t x1 = parseInt16(byteArray, 5);
-            int16_t y1 = parseInt16(byteArray, 7);
-            uint16_t color = parseColor(byteArray, 9);
-            command = new DrawLine(x0, y0, x1, y1, color);
-            break;
-        }
-        case DRAW_RECTANGLE_OPCODE: {
-            if (byteArray.size() != 11) {
-                throw std::invalid_argument("Invalid parameters for draw rectangle");
+        count = static_cast<uint16_t>(parseInt16(data, 1));
+        size_t start = buffer.size();
+        size_t offset = BATCH_HEADER_SIZE;
+        for (size_t i = 0; i < count; ++i) {
+            // Runs of one geometry opcode, the bulk of most traffic, are
+            // decoded many records at a time.
+            size_t run = offset < size ? geometryRunLength(data + offset, size - offset, count - i) : 0;
+            if (run > 1) {
+                buffer.appendRecords(data + offset, run);
+                countOpcode(data[offset], run);
+                offset += run * GEOMETRY_RECORD_SIZE;
+                i += run - 1;
+                continue;
             }
-            int16_t x = parseInt16(byteArray, 1);
-            int16_t y = parseInt16(byteArray, 3);
-            int16_t width = parseInt16(byteArray, 5);
-            int16_t height = parseInt16(byteArray, 7);
-            uint16_t color = parseColor(byteArray, 9);
-            command = new DrawRectangle(x, y, width, height, color);
-            break;
-        }
-        case FILL_RECTANGLE_OPCODE: {
-            if (byteArray.size() != 11) {
-                throw std::invalid_argument("Invalid parameters for fill rectangle");
+            size_t length = offset < size ? commandSize(data[offset]) : 0;
+            CommandData command;
+            if (length == 0 || length > size - offset || tryParseCommand(data + offset, length, command) != PARSE_OK) {
+                buffer.truncate(start);
+                return reject(MALFORMED_BATCH_ERROR, "Truncated or unknown command in batch", message);
             }
-            int16_t x = parseInt16(byteArray, 1);
-            int16_t y = parseInt16(byteArray, 3);
-            int16_t width = parseInt16(byteArray, 5);
-            int16_t height = parseInt16(byteArray, 7);
-            uint16_t color = parseColor(byteArray, 9);
-            command = new FillRectangle(x, y, width, height, color);
-            break;
-        }
-        case DRAW_ELLIPSE_OPCODE: {
-            if (byteArray.size() != 11) {
-                throw std::invalid_argument("Invalid parameters for draw ellipse");
-            }
-            int16_t x = parseInt16(byteArray, 1);
-            int16_t y = parseInt16(byteArray, 3);
-            int16_t rx = parseInt16(byteArray, 5);
-            int16_t ry = parseInt16(byteArray, 7);
-            uint16_t color = parseColor(byteArray, 9);
-            command = new DrawEllipse(x, y, rx, ry, color);
-            break;
-        }
-        case FILL_ELLIPSE_OPCODE: {
-            if (byteArray.size() != 11) {
-                throw std::invalid_argument("Invalid parameters for fill ellipse");
-            }
-            int16_t x = parseInt16(byteArray, 1);
-            int16_t y = parseInt16(byteArray, 3);
-            int16_t rx = parseInt16(byteArray, 5);
-            int16_t ry = parseInt16(byteArray, 7);
-            uint16_t color = parseColor(byteArray, 9);
-            command = new FillEllipse(x, y, rx, ry, color);
-            break;
+            buffer.push(command);
+            offset += length;
         }
-        default:
-            throw std::invalid_argument("Unknown command opcode");
+        if (offset != size) {
+            buffer.truncate(start);
+            return reject(MALFORMED_BATCH_ERROR, "Trailing bytes after batch", message);
         }
+        return PARSE_OK;
     }
 
+    // As tryParseBatch, but returns the number of commands appended and
+    // throws invalid_argument on a malformed batch.
+    size_t parseBatch(const uint8_t* data, size_t size, CommandBuffer& buffer) {
+        size_t count;
+        const char* message;
+        if (tryParseBatch(data, size, buffer, count, &message) != PARSE_OK) {
+            throw std::invalid_argument(message);
+        }
+        return count;
+    }
 
-private:
-    //  
-    int16_t parseInt16(const std::vector<uint8_t>& data, size_t offset) {
-        return (data[offset + 1] << 8) | data[offset];
+    size_t parseBatch(const std::vector<uint8_t>& byteArray, CommandBuffer& buffer) {
+        return parseBatch(byteArray.data(), byteArray.size(), buffer);
+    }
+
+    // Decodes a compact batch (see compact_codec.h) and appends its commands
+    // to buffer, storing their number in count and the batch sequence number
+    // in sequence when given. Malformed batches are handled as by
+    // tryParseBatch.
+    ParseStatus tryParseCompactBatch(const uint8_t* data, size_t size, CommandBuffer& buffer, size_t& count, uint32_t* sequence = nullptr, const char** message = nullptr) {
+        const uint8_t* cursor = data + 1;
+        const uint8_t* end = data + size;
+        uint32_t batchSequence;
+        uint32_t batchCount;
+        if (size == 0 || data[0] != COMPACT_BATCH_MARKER
+            || !readVarint(cursor, end, UINT32_VARINT_BYTES, UINT32_MAX, batchSequence)
+            || !readVarint(cursor, end, UINT32_VARINT_BYTES, UINT32_MAX, batchCount)) {
+            return reject(MALFORMED_BATCH_ERROR, "Invalid compact batch header", message);
+        }
+        size_t start = buffer.size();
+        CompactState state;
+        for (uint32_t i = 0; i < batchCount; ++i) {
+            uint8_t opcode;
+            int16_t coords[4];
+            uint16_t color;
+            if (!decodeCompactCommand(cursor, end, state, opcode, coords, color)) {
+                buffer.truncate(start);
+                return reject(MALFORMED_BATCH_ERROR, "Truncated or unknown command in compact batch", message);
+            }
+            countOpcode(opcode);
+            buffer.push(static_cast<CommandOpcode>(opcode), coords[0], coords[1], coords[2], coords[3], color);
+        }
+        if (cursor != end) {
+            buffer.truncate(start);
+            return reject(MALFORMED_BATCH_ERROR, "Trailing bytes after compact batch", message);
+        }
+        count = batchCount;
+        if (sequence) {
+            *sequence = batchSequence;
+        }
+        return PARSE_OK;
     }
 
-    uint16_t parseColor(const std::vector<uint8_t>& data, size_t offset) {
-        if (offset + 1 >= data.size()) {
-            return 0;
+    // As tryParseCompactBatch, but returns the number of commands appended
+    // and throws invalid_argument on a malformed batch.
+    size_t parseCompactBatch(const uint8_t* data, size_t size, CommandBuffer& buffer, uint32_t* sequence = nullptr) {
+        size_t count;
+        const char* message;
+        if (tryParseCompactBatch(data, size, buffer, count, sequence, &message) != PARSE_OK) {
+            throw std::invalid_argument(message);
         }
+        return count;
+    }
+
+    size_t parseCompactBatch(const std::vector<uint8_t>& byteArray, CommandBuffer& buffer, uint32_t* sequence = nullptr) {
+        return parseCompactBatch(byteArray.data(), byteArray.size(), buffer, sequence);
+    }
 
 
-        uint16_t color = (data[offset] << 8) | data[offset + 1];
+private:
+    // Counts a rejected datagram and reports why.
+    static ParseStatus reject(ErrorReason reason, const char* description, const char** message) noexcept {
+        countError(reason);
+        if (message) {
+            *message = description;
+        }
+        return parseStatus(reason);
+    }
 
-        return color;
+    //  
+    static int16_t parseInt16(const uint8_t* data, size_t offset) {
+        return static_cast<int16_t>((data[offset + 1] << 8) | data[offset]);
     }
 };
 
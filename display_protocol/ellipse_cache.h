@@ -0,0 +1,155 @@
+#pragma once
+#ifndef ELLIPSE_CACHE_H
+#define ELLIPSE_CACHE_H
+
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+// Per-row half widths of an axis-aligned ellipse, computed with the integer
+// midpoint algorithm: halfWidths[dy] is the largest dx of a boundary pixel
+// on row cy +/- dy. Outlines and fills are both drawn from this table.
+inline void computeEllipseHalfWidths(int rx, int ry, std::vector<int>& halfWidths) {
+    halfWidths.assign(static_cast<size_t>(ry) + 1, 0);
+    if (ry == 0) {
+        halfWidths[0] = rx;
+        return;
+    }
+    const int64_t rx2 = static_cast<int64_t>(rx) * rx;
+    const int64_t ry2 = static_cast<int64_t>(ry) * ry;
+    int64_t x = 0;
+    int64_t y = ry;
+    int64_t px = 0;
+    int64_t py = 2 * rx2 * y;
+
+    // Region 1: slope above -1, step x every iteration. Decision values are
+    // scaled by 4 to stay in integers.
+    int64_t d = 4 * ry2 - 4 * rx2 * ry + rx2;
+    while (px < py) {
+        halfWidths[y] = static_cast<int>(x);
+        ++x;
+        px += 2 * ry2;
+        if (d < 0) {
+            d += 4 * (ry2 + px);
+        }
+        else {
+            --y;
+            py -= 2 * rx2;
+            d += 4 * (ry2 + px - py);
+        }
+    }
+
+    // Region 2: slope below -1, step y every iteration.
+    d = ry2 * (2 * x + 1) * (2 * x + 1) + 4 * rx2 * (y - 1) * (y - 1) - 4 * rx2 * ry2;
+    while (y >= 0) {
+        halfWidths[y] = std::max(halfWidths[y], static_cast<int>(x));
+        --y;
+        py -= 2 * rx2;
+        if (d > 0) {
+            d += 4 * (rx2 - py);
+        }
+        else {
+            ++x;
+            px += 2 * ry2;
+            d += 4 * (rx2 - py + px);
+        }
+    }
+}
+
+// Half-width tables of the most recently drawn radii, so UIs that keep
+// redrawing the same dots and gauges run the midpoint algorithm once per
+// radius pair. Bounded both ways: at most capacity tables, least recently
+// used evicted first, and ellipses taller than MAX_CACHED_RADIUS rows are
+// computed into a scratch table instead, since their fill dwarfs the
+// table anyway. A new table reuses the storage of the one it evicts. Not
+// thread-safe; each rasterizer has its own unless given a shared one.
+class EllipseSpanCache {
+public:
+    static const size_t DEFAULT_CAPACITY = 64;
+    static const int MAX_CACHED_RADIUS = 1024;
+
+    explicit EllipseSpanCache(size_t capacity = DEFAULT_CAPACITY) : capacity(capacity) {
+        index.reserve(capacity);
+    }
+
+    // The table for (rx, ry), valid until the next call. Radii must not be
+    // negative.
+    const std::vector<int>& halfWidths(int rx, int ry) {
+        if (capacity == 0 || ry > MAX_CACHED_RADIUS) {
+            ++missCount;
+            computeEllipseHalfWidths(rx, ry, scratch);
+            return scratch;
+        }
+        uint32_t key = (static_cast<uint32_t>(rx) << 16) | static_cast<uint32_t>(ry);
+        auto found = index.find(key);
+        if (found != index.end()) {
+            ++hitCount;
+            entries.splice(entries.begin(), entries, found->second);
+            return found->second->halfWidths;
+        }
+        ++missCount;
+        if (entries.size() < capacity) {
+            entries.emplace_front();
+        }
+        else {
+            index.erase(entries.back().key);
+            entries.splice(entries.begin(), entries, std::prev(entries.end()));
+            ++evictionCount;
+        }
+        Entry& entry = entries.front();
+        entry.key = key;
+        computeEllipseHalfWidths(rx, ry, entry.halfWidths);
+        index[key] = entries.begin();
+        return entry.halfWidths;
+    }
+
+    uint64_t hits() const {
+        return hitCount;
+    }
+
+    uint64_t misses() const {
+        return missCount;
+    }
+
+    uint64_t evictions() const {
+        return evictionCount;
+    }
+
+    // Fraction of lookups served from the cache; 0 before the first one.
+    double hitRate() const {
+        uint64_t total = hitCount + missCount;
+        return total ? static_cast<double>(hitCount) / total : 0.0;
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+    void clear() {
+        entries.clear();
+        index.clear();
+        hitCount = 0;
+        missCount = 0;
+        evictionCount = 0;
+    }
+
+private:
+    struct Entry {
+        uint32_t key = 0;
+        std::vector<int> halfWidths;
+    };
+
+    size_t capacity;
+    // Most recently used first.
+    std::list<Entry> entries;
+    std::unordered_map<uint32_t, std::list<Entry>::iterator> index;
+    std::vector<int> scratch;
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+    uint64_t evictionCount = 0;
+};
+
+#endif // ELLIPSE_CACHE_H
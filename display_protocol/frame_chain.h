@@ -0,0 +1,289 @@
+#pragma once
+#ifndef FRAME_CHAIN_H
+#define FRAME_CHAIN_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "framebuffer.h"
+#include "damage_region.h"
+#include "rasterizer.h"
+#include "spsc_ring.h"
+#include "frame_export.h"
+
+// Three framebuffers rotated between one rendering and one viewing thread,
+// so a viewer only ever sees completed frames. The renderer draws into the
+// back buffer; present() publishes it by swapping buffer indices through
+// one atomic word, so a frame appears all at once and no pixels are copied
+// to show it. The viewer takes the newest published frame with acquire()
+// and keeps reading it until its next acquire(); frames published in the
+// meantime replace each other, so neither side ever waits for the other.
+//
+// Commands draw on top of what is already on screen, so a recycled back
+// buffer is first brought up to date from the newest frame. Only the areas
+// damaged since that buffer was last drawn are copied, and a frame that
+// starts with ClearDisplay skips the copy altogether.
+//
+// Given a FrameExportWriter, the three buffers live in its memory and every
+// present is published there too, so other processes can read frames in
+// place (see frame_export.h). The viewers are then those processes, not a
+// thread calling acquire(): present() cycles through all three buffers, so
+// a presented buffer is drawn into again only two presents later.
+class FrameChain {
+public:
+    static const size_t BUFFER_COUNT = 3;
+    static_assert(BUFFER_COUNT == FRAME_EXPORT_BUFFERS, "Exported frames are FrameChain buffers");
+
+    FrameChain(int width, int height, FrameExportWriter* exported = nullptr)
+        : surface{ 0, 0, width, height }, exported(exported) {
+        if (exported && (exported->getWidth() != width || exported->getHeight() != height)) {
+            throw std::invalid_argument("Invalid framebuffer size");
+        }
+        for (size_t i = 0; i < BUFFER_COUNT; ++i) {
+            uint16_t* pixels = exported ? exported->buffer(i) : nullptr;
+            slots[i].reset(new Slot(width, height, exported ? exported->getStride() : width, pixels));
+            slots[i]->rasterizer.setEllipseCache(&ellipses);
+        }
+    }
+
+    FrameChain(const FrameChain&) = delete;
+    FrameChain& operator=(const FrameChain&) = delete;
+
+    // Renderer side. BeginFrame opens a frame and EndFrame presents it;
+    // everything else draws into the back buffer.
+    void execute(const CommandData& command) {
+        if (command.opcode == BEGIN_FRAME_OPCODE) {
+            open = true;
+            return;
+        }
+        if (command.opcode == END_FRAME_OPCODE) {
+            open = false;
+            present();
+            return;
+        }
+        prepareBack(command.opcode == CLEAR_DISPLAY_OPCODE);
+        addDamage(commandBounds(command, surface));
+        slots[back]->rasterizer.execute(command);
+    }
+
+    void execute(const BulkCommandView& command) {
+        prepareBack(false);
+        if (command.opcode == FILL_RECTANGLES_OPCODE) {
+            for (size_t i = 0; i < command.boxes.size() && !frameCovered; ++i) {
+                addDamage(boxBounds(command.boxes[i]));
+            }
+        }
+        else {
+            addDamage(bulkCommandBounds(command));
+        }
+        slots[back]->rasterizer.execute(command);
+    }
+
+    void execute(const CommandBuffer& commands) {
+        for (size_t i = 0; i < commands.size(); ++i) {
+            execute(commands.at(i));
+        }
+    }
+
+    // True between BeginFrame and EndFrame. Senders that never mark frames
+    // are presented by the caller instead, e.g. after every datagram.
+    bool inFrame() const {
+        return open;
+    }
+
+    // True when the back buffer has been drawn on since the last present.
+    bool dirty() const {
+        return !frameDamage.empty();
+    }
+
+    // Publishes the back buffer as the newest frame and recycles whichever
+    // buffer the viewer is not holding as the next back buffer; when
+    // exporting, the oldest presented buffer.
+    void present() {
+        prepareBack(false);
+        Rect changed = { 0, 0, 0, 0 };
+        for (const Rect& rect : frameDamage) {
+            changed = changed.unite(rect);
+        }
+        for (size_t i = 0; i < BUFFER_COUNT; ++i) {
+            if (i != back) {
+                slots[i]->miss(frameDamage, surface);
+            }
+        }
+        frameDamage.clear();
+        frameArea = 0;
+        frameCovered = false;
+        slots[back]->frame = ++presented;
+        if (exported) {
+            exported->publish(back, presented, changed);
+            writing = false;
+        }
+        newest = back;
+        stale = true;
+        if (exported) {
+            back = (back + 1) % BUFFER_COUNT;
+            return;
+        }
+        back = shared.exchange(back | FRESH_FRAME, std::memory_order_acq_rel) & INDEX_MASK;
+        frameReady.notify();
+    }
+
+    // Shared by the three back buffers' rasterizers.
+    const EllipseSpanCache& ellipseCache() const {
+        return ellipses;
+    }
+
+    // Number of frames presented so far.
+    uint64_t presentedFrames() const {
+        return presented;
+    }
+
+    // The newest presented frame. Renderer side only: the viewer may be
+    // reading it, so it must not be modified.
+    const Framebuffer& latest() const {
+        return slots[newest]->framebuffer;
+    }
+
+    // Viewer side. Switches frontBuffer() to the newest presented frame if one
+    // arrived since the last call; returns whether it did.
+    bool acquire() {
+        if ((shared.load(std::memory_order_relaxed) & FRESH_FRAME) == 0) {
+            return false;
+        }
+        front = shared.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // Blocks until a new frame has been acquired or stop is set; returns
+    // whether a frame was acquired.
+    bool waitForFrame(const std::atomic<bool>& stop) {
+        for (;;) {
+            if (acquire()) {
+                return true;
+            }
+            if (stop.load()) {
+                return false;
+            }
+            uint32_t seen = frameReady.prepareWait();
+            if ((shared.load() & FRESH_FRAME) == 0 && !stop.load()) {
+                frameReady.wait(seen);
+            }
+            frameReady.cancelWait();
+        }
+    }
+
+    // Wakes a viewer blocked in waitForFrame so it can observe its stop flag.
+    void wake() {
+        frameReady.notify();
+    }
+
+    // The frame the viewer holds; all zero until the first acquire().
+    const Framebuffer& frontBuffer() const {
+        return slots[front]->framebuffer;
+    }
+
+    // Number of the frame in frontBuffer(), counting presents from 1; 0
+    // before the first acquire().
+    uint64_t frontFrame() const {
+        return slots[front]->frame;
+    }
+
+private:
+    // Longest damage list kept before falling back to a full-surface copy.
+    static const size_t MAX_DAMAGE_RECTS = 1024;
+    static const uint32_t INDEX_MASK = 3;
+    static const uint32_t FRESH_FRAME = 4;
+
+    struct Slot {
+        Slot(int width, int height, int stride, uint16_t* pixels)
+            : framebuffer(width, height, stride, pixels), rasterizer(framebuffer) {}
+
+        // Adds the damage of a frame presented from another buffer. The list
+        // is exact, since merging scattered rectangles into a few bounding
+        // boxes would copy far more; once it grows too long or covers as
+        // much area as the surface it collapses into the surface.
+        void miss(const std::vector<Rect>& damage, const Rect& surface) {
+            for (const Rect& rect : damage) {
+                if (missedArea >= surface.area()) {
+                    break;
+                }
+                missed.push_back(rect);
+                missedArea += rect.area();
+                if (missed.size() >= MAX_DAMAGE_RECTS) {
+                    missedArea = surface.area();
+                }
+            }
+            if (missedArea >= surface.area()) {
+                missed.assign(1, surface);
+            }
+        }
+
+        Framebuffer framebuffer;
+        Rasterizer rasterizer;
+        // Damage of frames presented since this buffer was last drawn.
+        std::vector<Rect> missed;
+        long long missedArea = 0;
+        uint64_t frame = 0;
+    };
+
+    void addDamage(const Rect& rectangle) {
+        Rect bounds = rectangle.intersect(surface);
+        if (bounds.empty() || frameCovered) {
+            return;
+        }
+        frameDamage.push_back(bounds);
+        frameArea += bounds.area();
+        if (frameArea >= surface.area() || frameDamage.size() >= MAX_DAMAGE_RECTS) {
+            frameDamage.assign(1, surface);
+            frameCovered = true;
+        }
+    }
+
+    // Readies the back buffer for drawing: announces the write to exported
+    // readers, then catches up if it was recycled.
+    void prepareBack(bool clearing) {
+        if (exported && !writing) {
+            exported->beginWrite(back);
+            writing = true;
+        }
+        if (stale) {
+            catchUp(clearing);
+        }
+    }
+
+    // Copies what the back buffer missed from the newest frame, unless the
+    // first command overwrites the whole surface anyway.
+    void catchUp(bool clearing) {
+        Slot& slot = *slots[back];
+        if (!clearing) {
+            flushDamage(slots[newest]->framebuffer, slot.framebuffer, slot.missed);
+        }
+        slot.missed.clear();
+        slot.missedArea = 0;
+        stale = false;
+    }
+
+    std::unique_ptr<Slot> slots[BUFFER_COUNT];
+    // Renderer-owned state.
+    size_t back = 0;
+    size_t newest = 1;
+    bool open = false;
+    bool stale = false;
+    uint64_t presented = 0;
+    Rect surface;
+    std::vector<Rect> frameDamage;
+    long long frameArea = 0;
+    bool frameCovered = false;
+    EllipseSpanCache ellipses;
+    FrameExportWriter* exported;
+    bool writing = false;
+    // Index of the buffer between the two sides, plus FRESH_FRAME while the
+    // viewer has not taken it yet.
+    std::atomic<uint32_t> shared{ 1 };
+    // Viewer-owned state.
+    size_t front = 2;
+    WaitEvent frameReady;
+};
+
+#endif // FRAME_CHAIN_H
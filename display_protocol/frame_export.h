@@ -0,0 +1,209 @@
+#pragma once
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include "framebuffer.h"
+#include "command_bounds.h"
+
+// Layout of a block of memory, normally a shared memory segment, that holds
+// FrameChain's buffers so other processes can read presented frames in
+// place. The header comes first, then FRAME_EXPORT_BUFFERS framebuffers,
+// each starting on a FRAME_EXPORT_ALIGNMENT boundary. Every buffer has its
+// own sequence counter, a seqlock: odd while the renderer draws into the
+// buffer, bumped to even when the buffer is presented. A reader takes the
+// newest buffer, reads it where it lies and then checks that the counter
+// has not moved. FrameChain cycles through the three buffers, so the
+// renderer only comes back to a buffer two presents later, and a reader
+// that keeps up never has to retry.
+// Readers never write, so they can map the memory read-only, and neither
+// side makes a system call per frame.
+const uint32_t FRAME_EXPORT_MAGIC = 0x42465044; // "DPFB"
+const uint32_t FRAME_EXPORT_VERSION = 1;
+const size_t FRAME_EXPORT_BUFFERS = 3;
+const size_t FRAME_EXPORT_ALIGNMENT = 4096;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+    "Shared frame headers need address-free atomics");
+
+struct FrameExportSlot {
+    std::atomic<uint32_t> sequence{ 0 };
+    // Number of the frame in the buffer, counting presents from 1; 0 until
+    // the buffer is first presented.
+    std::atomic<uint64_t> frame{ 0 };
+    // Bounding box of the pixels that changed since the previous frame.
+    std::atomic<int32_t> damage[4] = {};
+};
+
+struct FrameExportHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    // Row pitch in pixels.
+    int32_t stride;
+    uint32_t bufferCount;
+    // Byte offset of each buffer from the start of the header.
+    uint64_t bufferOffset[FRAME_EXPORT_BUFFERS];
+    // Index of the newest presented buffer.
+    std::atomic<uint32_t> newest{ 0 };
+    FrameExportSlot slots[FRAME_EXPORT_BUFFERS];
+};
+
+inline size_t frameExportBufferOffset(size_t index, int width, int height) {
+    size_t header = (sizeof(FrameExportHeader) + FRAME_EXPORT_ALIGNMENT - 1) / FRAME_EXPORT_ALIGNMENT * FRAME_EXPORT_ALIGNMENT;
+    size_t buffer = (static_cast<size_t>(width) * height * sizeof(uint16_t) + FRAME_EXPORT_ALIGNMENT - 1) / FRAME_EXPORT_ALIGNMENT * FRAME_EXPORT_ALIGNMENT;
+    return header + index * buffer;
+}
+
+// Bytes needed to export a width x height surface.
+inline size_t frameExportSize(int width, int height) {
+    return frameExportBufferOffset(FRAME_EXPORT_BUFFERS, width, height);
+}
+
+// Renderer side; FrameChain drives it. Lays out a fresh header in memory,
+// which must be at least frameExportSize bytes, aligned for uint64_t and
+// outlive the writer.
+class FrameExportWriter {
+public:
+    FrameExportWriter(void* memory, size_t size, int width, int height) {
+        if (width <= 0 || height <= 0 || size < frameExportSize(width, height)) {
+            throw std::invalid_argument("Invalid frame export size");
+        }
+        header = new (memory) FrameExportHeader();
+        header->width = width;
+        header->height = height;
+        header->stride = width;
+        header->bufferCount = FRAME_EXPORT_BUFFERS;
+        for (size_t i = 0; i < FRAME_EXPORT_BUFFERS; ++i) {
+            header->bufferOffset[i] = frameExportBufferOffset(i, width, height);
+        }
+        header->version = FRAME_EXPORT_VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = FRAME_EXPORT_MAGIC;
+    }
+
+    int getWidth() const { return header->width; }
+    int getHeight() const { return header->height; }
+    int getStride() const { return header->stride; }
+
+    uint16_t* buffer(size_t index) {
+        return reinterpret_cast<uint16_t*>(reinterpret_cast<uint8_t*>(header) + header->bufferOffset[index]);
+    }
+
+    // Marks buffer index as being drawn into; call before touching it.
+    void beginWrite(size_t index) {
+        std::atomic<uint32_t>& sequence = header->slots[index].sequence;
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // Publishes buffer index, drawn since beginWrite, as the newest frame.
+    void publish(size_t index, uint64_t frame, const Rect& damage) {
+        FrameExportSlot& slot = header->slots[index];
+        slot.frame.store(frame, std::memory_order_relaxed);
+        slot.damage[0].store(damage.left, std::memory_order_relaxed);
+        slot.damage[1].store(damage.top, std::memory_order_relaxed);
+        slot.damage[2].store(damage.right, std::memory_order_relaxed);
+        slot.damage[3].store(damage.bottom, std::memory_order_relaxed);
+        slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        header->newest.store(static_cast<uint32_t>(index), std::memory_order_release);
+    }
+
+private:
+    FrameExportHeader* header;
+};
+
+// Consumer side, usually in another process. Validates the header once and
+// keeps the geometry it saw; the memory is shared with a writer it cannot
+// trust, so every read still checks the buffer index and offset against
+// the mapped size before touching pixels. Otherwise reading a frame is a
+// few atomic loads around the consumer's own pass over the pixels.
+class FrameExportReader {
+public:
+    FrameExportReader(const void* memory, size_t size) : header(static_cast<const FrameExportHeader*>(memory)), size(size) {
+        if (size < sizeof(FrameExportHeader) || header->magic != FRAME_EXPORT_MAGIC) {
+            throw std::invalid_argument("Not a frame export");
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->version != FRAME_EXPORT_VERSION || header->bufferCount != FRAME_EXPORT_BUFFERS ||
+            header->width <= 0 || header->height <= 0 || header->stride < header->width ||
+            size < frameExportSize(header->stride, header->height)) {
+            throw std::invalid_argument("Unsupported frame export");
+        }
+        width = header->width;
+        height = header->height;
+        stride = header->stride;
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // Calls consume(const Framebuffer& frame, const Rect& damage) on the
+    // newest presented frame, in place. If the renderer recycled the buffer
+    // meanwhile, consume runs again on the then newest frame, up to attempts
+    // times in all; only its last run saw consistent pixels. Returns the
+    // frame number consumed, or 0 if there is no frame yet, every attempt
+    // was overtaken or the header points outside the mapping.
+    template <typename Consumer>
+    uint64_t read(Consumer&& consume, int attempts = 4) const {
+        for (int attempt = 0; attempt < attempts; ++attempt) {
+            uint32_t index = header->newest.load(std::memory_order_acquire);
+            if (index >= FRAME_EXPORT_BUFFERS) {
+                return 0;
+            }
+            const FrameExportSlot& slot = header->slots[index];
+            uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+            uint64_t frame = slot.frame.load(std::memory_order_relaxed);
+            if (sequence & 1) {
+                continue;
+            }
+            if (frame == 0) {
+                return 0;
+            }
+            Rect damage = { slot.damage[0].load(std::memory_order_relaxed), slot.damage[1].load(std::memory_order_relaxed),
+                slot.damage[2].load(std::memory_order_relaxed), slot.damage[3].load(std::memory_order_relaxed) };
+            uint64_t offset = header->bufferOffset[index];
+            size_t bytes = static_cast<size_t>(stride) * height * sizeof(uint16_t);
+            if (offset > size || size - offset < bytes || offset % alignof(uint16_t) != 0) {
+                return 0;
+            }
+            // The view is const; the pixels are never written through it.
+            uint16_t* pixels = reinterpret_cast<uint16_t*>(const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(header) + offset));
+            const Framebuffer view(width, height, stride, pixels);
+            consume(view, damage);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+                return frame;
+            }
+        }
+        return 0;
+    }
+
+    // Copies the newest frame into out, which must have the same size, for
+    // consumers that keep it. Returns its number, 0 as for read().
+    uint64_t copyLatest(Framebuffer& out) const {
+        if (out.getWidth() != width || out.getHeight() != height) {
+            throw std::invalid_argument("Invalid framebuffer size");
+        }
+        return read([&](const Framebuffer& frame, const Rect&) {
+            for (int y = 0; y < frame.getHeight(); ++y) {
+                std::copy(frame.row(y), frame.row(y) + frame.getWidth(), out.row(y));
+            }
+        });
+    }
+
+private:
+    const FrameExportHeader* header;
+    size_t size;
+    int width;
+    int height;
+    int stride;
+};
+
+#endif // FRAME_EXPORT_H
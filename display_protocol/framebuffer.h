@@ -0,0 +1,58 @@
+#pragma once
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+// Headless RGB565 surface. Pixels are stored row by row, stride pixels apart;
+// either owned by the framebuffer or borrowed from the caller.
+class Framebuffer {
+public:
+    Framebuffer(int width, int height) : Framebuffer(width, height, width, nullptr) {}
+
+    // Wraps external memory of at least stride * height pixels, which must
+    // outlive the framebuffer. A null pointer allocates zeroed storage.
+    Framebuffer(int width, int height, int stride, uint16_t* pixels) :
+        width(width), height(height), stride(stride), pixels(pixels) {
+        if (width <= 0 || height <= 0 || stride < width) {
+            throw std::invalid_argument("Invalid framebuffer size");
+        }
+        if (!pixels) {
+            storage.assign(static_cast<size_t>(stride) * height, 0);
+            this->pixels = storage.data();
+        }
+    }
+
+    Framebuffer(const Framebuffer&) = delete;
+    Framebuffer& operator=(const Framebuffer&) = delete;
+    Framebuffer(Framebuffer&&) = default;
+    Framebuffer& operator=(Framebuffer&&) = default;
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getStride() const { return stride; }
+
+    uint16_t* data() { return pixels; }
+    const uint16_t* data() const { return pixels; }
+
+    uint16_t* row(int y) { return pixels + static_cast<size_t>(y) * stride; }
+    const uint16_t* row(int y) const { return pixels + static_cast<size_t>(y) * stride; }
+
+    uint16_t pixel(int x, int y) const { return row(y)[x]; }
+
+    bool contains(int x, int y) const {
+        return x >= 0 && y >= 0 && x < width && y < height;
+    }
+
+private:
+    int width;
+    int height;
+    int stride;
+    uint16_t* pixels;
+    std::vector<uint16_t> storage;
+};
+
+#endif // FRAMEBUFFER_H
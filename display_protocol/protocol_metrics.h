@@ -0,0 +1,347 @@
+#pragma once
+#ifndef PROTOCOL_METRICS_H
+#define PROTOCOL_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "bulk_commands.h"
+
+// Build with DISPLAY_PROTOCOL_METRICS=0 to compile every hook below to
+// nothing.
+#ifndef DISPLAY_PROTOCOL_METRICS
+#define DISPLAY_PROTOCOL_METRICS 1
+#endif
+
+// Why a datagram was rejected.
+enum ErrorReason {
+    EMPTY_INPUT_ERROR,
+    UNKNOWN_OPCODE_ERROR,
+    INVALID_LENGTH_ERROR,
+    MALFORMED_BATCH_ERROR,
+    ERROR_REASON_COUNT
+};
+
+// What the clip stage did with a command before drawing it.
+enum ClipOutcome {
+    CLIP_INSIDE,
+    CLIP_CLIPPED,
+    CLIP_CULLED,
+    CLIP_OUTCOME_COUNT
+};
+
+enum LatencyKind {
+    PARSE_LATENCY,
+    EXECUTE_LATENCY,
+    LATENCY_KIND_COUNT
+};
+
+inline const char* errorReasonName(ErrorReason reason) {
+    static const char* const NAMES[ERROR_REASON_COUNT] = { "empty_input", "unknown_opcode", "invalid_length", "malformed_batch" };
+    return NAMES[reason];
+}
+
+inline const char* clipOutcomeName(ClipOutcome outcome) {
+    static const char* const NAMES[CLIP_OUTCOME_COUNT] = { "inside", "clipped", "culled" };
+    return NAMES[outcome];
+}
+
+inline const char* latencyKindName(LatencyKind kind) {
+    static const char* const NAMES[LATENCY_KIND_COUNT] = { "parse", "execute" };
+    return NAMES[kind];
+}
+
+// Log-linear buckets in the style of HdrHistogram: values below 16 ns are
+// exact, above that every power of two is split into 16 buckets, so any
+// recorded value is off by at most 1/16 (about 6%). Values saturate at
+// 2^48 ns.
+const size_t LATENCY_SUB_BUCKETS = 16;
+const size_t LATENCY_BUCKET_COUNT = (48 - 3) * LATENCY_SUB_BUCKETS;
+
+inline size_t latencyBucket(uint64_t nanoseconds) {
+    if (nanoseconds < LATENCY_SUB_BUCKETS) {
+        return static_cast<size_t>(nanoseconds);
+    }
+    if (nanoseconds >= (1ull << 48)) {
+        return LATENCY_BUCKET_COUNT - 1;
+    }
+    int exponent = 63;
+    while ((nanoseconds >> exponent) == 0) {
+        --exponent;
+    }
+    size_t sub = static_cast<size_t>(nanoseconds >> (exponent - 4)) & (LATENCY_SUB_BUCKETS - 1);
+    return (exponent - 3) * LATENCY_SUB_BUCKETS + sub;
+}
+
+// Largest value that lands in bucket.
+inline uint64_t latencyBucketLimit(size_t bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return bucket;
+    }
+    int exponent = static_cast<int>(bucket / LATENCY_SUB_BUCKETS) + 3;
+    uint64_t sub = bucket % LATENCY_SUB_BUCKETS;
+    return ((LATENCY_SUB_BUCKETS + sub + 1) << (exponent - 4)) - 1;
+}
+
+struct LatencyHistogram {
+    uint64_t counts[LATENCY_BUCKET_COUNT] = {};
+
+    void record(uint64_t nanoseconds) {
+        ++counts[latencyBucket(nanoseconds)];
+    }
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (uint64_t value : counts) {
+            total += value;
+        }
+        return total;
+    }
+
+    // Upper bound of the bucket holding the given quantile (0..1); 0 when
+    // nothing was recorded.
+    uint64_t percentile(double quantile) const {
+        uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(quantile * (total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return latencyBucketLimit(i);
+            }
+        }
+        return latencyBucketLimit(LATENCY_BUCKET_COUNT - 1);
+    }
+};
+
+// Counters owned by one thread. Only that thread writes them, so an
+// increment is a relaxed load and store rather than a locked instruction;
+// the atomics only make concurrent snapshots well defined.
+struct ThreadMetrics {
+    std::atomic<uint64_t> opcodes[WIRE_OPCODE_COUNT];
+    std::atomic<uint64_t> errors[ERROR_REASON_COUNT];
+    std::atomic<uint64_t> clips[CLIP_OUTCOME_COUNT];
+    std::atomic<uint64_t> latency[LATENCY_KIND_COUNT][LATENCY_BUCKET_COUNT];
+
+    ThreadMetrics() {
+        reset();
+    }
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void reset() {
+        for (auto& counter : opcodes) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        for (auto& counter : errors) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        for (auto& counter : clips) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        for (auto& histogram : latency) {
+            for (auto& counter : histogram) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// Totals over every thread that has recorded anything.
+struct MetricsSnapshot {
+    uint64_t opcodes[WIRE_OPCODE_COUNT] = {};
+    uint64_t errors[ERROR_REASON_COUNT] = {};
+    uint64_t clips[CLIP_OUTCOME_COUNT] = {};
+    LatencyHistogram latency[LATENCY_KIND_COUNT];
+
+    std::string toText() const {
+        std::ostringstream out;
+        for (size_t i = 0; i < WIRE_OPCODE_COUNT; ++i) {
+            out << opcodeName(i) << ": " << opcodes[i] << "\n";
+        }
+        for (size_t i = 0; i < ERROR_REASON_COUNT; ++i) {
+            out << "error " << errorReasonName(static_cast<ErrorReason>(i)) << ": " << errors[i] << "\n";
+        }
+        for (size_t i = 0; i < CLIP_OUTCOME_COUNT; ++i) {
+            out << "clip " << clipOutcomeName(static_cast<ClipOutcome>(i)) << ": " << clips[i] << "\n";
+        }
+        for (size_t i = 0; i < LATENCY_KIND_COUNT; ++i) {
+            const LatencyHistogram& histogram = latency[i];
+            out << latencyKindName(static_cast<LatencyKind>(i)) << " ns: samples " << histogram.count()
+                << ", p50 " << histogram.percentile(0.5) << ", p99 " << histogram.percentile(0.99)
+                << ", p999 " << histogram.percentile(0.999) << ", max " << histogram.percentile(1.0) << "\n";
+        }
+        return out.str();
+    }
+
+    std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"opcodes\":{";
+        for (size_t i = 0; i < WIRE_OPCODE_COUNT; ++i) {
+            out << (i ? "," : "") << "\"" << opcodeName(i) << "\":" << opcodes[i];
+        }
+        out << "},\"errors\":{";
+        for (size_t i = 0; i < ERROR_REASON_COUNT; ++i) {
+            out << (i ? "," : "") << "\"" << errorReasonName(static_cast<ErrorReason>(i)) << "\":" << errors[i];
+        }
+        out << "},\"clip\":{";
+        for (size_t i = 0; i < CLIP_OUTCOME_COUNT; ++i) {
+            out << (i ? "," : "") << "\"" << clipOutcomeName(static_cast<ClipOutcome>(i)) << "\":" << clips[i];
+        }
+        out << "},\"latency_ns\":{";
+        for (size_t i = 0; i < LATENCY_KIND_COUNT; ++i) {
+            const LatencyHistogram& histogram = latency[i];
+            out << (i ? "," : "") << "\"" << latencyKindName(static_cast<LatencyKind>(i)) << "\":{"
+                << "\"samples\":" << histogram.count()
+                << ",\"p50\":" << histogram.percentile(0.5)
+                << ",\"p99\":" << histogram.percentile(0.99)
+                << ",\"p999\":" << histogram.percentile(0.999)
+                << ",\"max\":" << histogram.percentile(1.0) << "}";
+        }
+        out << "}}";
+        return out.str();
+    }
+};
+
+// Owns every thread's counters. Blocks outlive their threads so nothing
+// recorded is lost when a worker exits.
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    ThreadMetrics& local() {
+        thread_local ThreadMetrics* metrics = nullptr;
+        if (!metrics) {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.emplace_back(new ThreadMetrics());
+            metrics = threads.back().get();
+        }
+        return *metrics;
+    }
+
+    MetricsSnapshot snapshot() {
+        MetricsSnapshot total;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& metrics : threads) {
+            for (size_t i = 0; i < WIRE_OPCODE_COUNT; ++i) {
+                total.opcodes[i] += metrics->opcodes[i].load(std::memory_order_relaxed);
+            }
+            for (size_t i = 0; i < ERROR_REASON_COUNT; ++i) {
+                total.errors[i] += metrics->errors[i].load(std::memory_order_relaxed);
+            }
+            for (size_t i = 0; i < CLIP_OUTCOME_COUNT; ++i) {
+                total.clips[i] += metrics->clips[i].load(std::memory_order_relaxed);
+            }
+            for (size_t kind = 0; kind < LATENCY_KIND_COUNT; ++kind) {
+                for (size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+                    total.latency[kind].counts[i] += metrics->latency[kind][i].load(std::memory_order_relaxed);
+                }
+            }
+        }
+        return total;
+    }
+
+    // Zeroes all counters. Increments racing with the reset may survive it.
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& metrics : threads) {
+            metrics->reset();
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadMetrics>> threads;
+};
+
+// Timing every call would cost more than decoding a command, so only one
+// call in LATENCY_SAMPLE_INTERVAL per thread is timed.
+const uint32_t LATENCY_SAMPLE_INTERVAL = 256;
+
+#if DISPLAY_PROTOCOL_METRICS
+
+inline void countOpcode(uint8_t opcode, uint64_t count = 1) {
+    ThreadMetrics::bump(MetricsRegistry::instance().local().opcodes[opcode], count);
+}
+
+inline void countError(ErrorReason reason) {
+    ThreadMetrics::bump(MetricsRegistry::instance().local().errors[reason]);
+}
+
+inline void countClip(ClipOutcome outcome) {
+    ThreadMetrics::bump(MetricsRegistry::instance().local().clips[outcome]);
+}
+
+#if defined(_MSC_VER)
+#define METRICS_COLD __declspec(noinline)
+#else
+#define METRICS_COLD __attribute__((noinline, cold))
+#endif
+
+inline thread_local uint32_t latencySampleCountdown[LATENCY_KIND_COUNT] = {};
+
+// Times a region into the histogram for its kind on one call in
+// LATENCY_SAMPLE_INTERVAL per kind; otherwise start() is a thread-local decrement
+// and stop() a predictable branch. Regions left by an exception are not
+// recorded.
+class LatencySample {
+public:
+    void start(LatencyKind kind) {
+        sampled = latencySampleCountdown[kind]-- == 0;
+        if (sampled) {
+            begin(kind);
+        }
+    }
+
+    void stop() {
+        if (sampled) {
+            record();
+        }
+    }
+
+private:
+    METRICS_COLD void begin(LatencyKind sampleKind) {
+        latencySampleCountdown[sampleKind] = LATENCY_SAMPLE_INTERVAL - 1;
+        kind = sampleKind;
+        startTime = std::chrono::steady_clock::now();
+    }
+
+    METRICS_COLD void record() {
+        auto elapsed = std::chrono::steady_clock::now() - startTime;
+        uint64_t nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        ThreadMetrics::bump(MetricsRegistry::instance().local().latency[kind][latencyBucket(nanoseconds)]);
+    }
+
+    bool sampled;
+    LatencyKind kind;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+#else
+
+inline void countOpcode(uint8_t, uint64_t = 1) {}
+inline void countError(ErrorReason) {}
+inline void countClip(ClipOutcome) {}
+
+class LatencySample {
+public:
+    void start(LatencyKind) {}
+    void stop() {}
+};
+
+#endif
+
+#endif // PROTOCOL_METRICS_H
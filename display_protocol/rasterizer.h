@@ -0,0 +1,380 @@
+#pragma once
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include "display_protocol.h"
+#include "framebuffer.h"
+#include "command_bounds.h"
+#include "damage_region.h"
+#include "span_fill.h"
+#include "ellipse_cache.h"
+#include "command_clipper.h"
+
+// Executes decoded commands on a framebuffer. Integer-only: Bresenham lines,
+// midpoint ellipses (half-width tables cached per radius pair, see
+// EllipseSpanCache) and row-span fills, everything clipped to the clip
+// rectangle (the whole surface by default). Clipping only discards pixels,
+// never moves them, so drawing a scene tile by tile with setClip gives the
+// same pixels as drawing it once. Rectangles cover [x, x + width) x
+// [y, y + height); shapes with a negative extent draw nothing. Frame
+// markers are ignored here; FrameChain acts on them.
+class Rasterizer {
+public:
+    explicit Rasterizer(Framebuffer& target) : target(target), clip(surface()), clipper(clip) {}
+
+    Rect surface() const {
+        return { 0, 0, target.getWidth(), target.getHeight() };
+    }
+
+    // Restricts drawing to rectangle, intersected with the surface.
+    void setClip(const Rect& rectangle) {
+        clip = rectangle.intersect(surface());
+        clipper.setViewport(clip);
+    }
+
+    const Rect& getClip() const {
+        return clip;
+    }
+
+    // When set, execute() adds the clipped bounds of every command to region.
+    // The direct drawing calls below do not record damage.
+    void setDamageRegion(DamageRegion* region) {
+        damage = region;
+    }
+
+    // Ellipses look up their half-width tables in cache instead of this
+    // rasterizer's own one, so rasterizers that take turns drawing on one
+    // thread share their radii. nullptr goes back to the own cache.
+    void setEllipseCache(EllipseSpanCache* cache) {
+        sharedEllipses = cache;
+    }
+
+    const EllipseSpanCache& ellipseCache() const {
+        return sharedEllipses ? *sharedEllipses : ownEllipses;
+    }
+
+    // Whether execute() counts each command's clip outcome in the protocol
+    // metrics. Renderers that pass one command through a rasterizer per
+    // tile turn this off and count the command once themselves.
+    void setClipMetrics(bool enabled) {
+        clipMetrics = enabled;
+    }
+
+    // Runs command through the clip stage first (see CommandClipper), so
+    // culled commands never reach the drawing code below.
+    void execute(const CommandData& original) {
+        LatencySample sample;
+        sample.start(EXECUTE_LATENCY);
+        CommandData command = original;
+        LineSteps steps;
+        ClipOutcome outcome = clipper.clip(command, &steps);
+        if (clipMetrics) {
+            countClip(outcome);
+        }
+        if (outcome == CLIP_CULLED) {
+            sample.stop();
+            return;
+        }
+        if (damage) {
+            damage->add(commandBounds(command, clip).intersect(clip));
+        }
+        switch (command.opcode) {
+        case CLEAR_DISPLAY_OPCODE: {
+            clearDisplay(command.clearDisplay.color);
+            break;
+        }
+        case DRAW_PIXEL_OPCODE: {
+            const DrawPixelData& c = command.drawPixel;
+            drawPixel(c.x0, c.y0, c.color);
+            break;
+        }
+        case DRAW_LINE_OPCODE: {
+            const DrawLineData& c = command.drawLine;
+            if (c.x0 == c.x1 || c.y0 == c.y1) {
+                drawLine(c.x0, c.y0, c.x1, c.y1, c.color);
+            }
+            else {
+                bresenham(c.x0, c.y0, c.x1, c.y1, steps, c.color);
+            }
+            break;
+        }
+        case DRAW_RECTANGLE_OPCODE: {
+            const DrawRectangleData& c = command.drawRectangle;
+            drawRectangle(c.x, c.y, c.width, c.height, c.color);
+            break;
+        }
+        case FILL_RECTANGLE_OPCODE: {
+            const FillRectangleData& c = command.fillRectangle;
+            fillRectangle(c.x, c.y, c.width, c.height, c.color);
+            break;
+        }
+        case DRAW_ELLIPSE_OPCODE: {
+            const DrawEllipseData& c = command.drawEllipse;
+            drawEllipse(c.x, c.y, c.rx, c.ry, c.color);
+            break;
+        }
+        case FILL_ELLIPSE_OPCODE: {
+            const FillEllipseData& c = command.fillEllipse;
+            fillEllipse(c.x, c.y, c.rx, c.ry, c.color);
+            break;
+        }
+        case BEGIN_FRAME_OPCODE:
+        case END_FRAME_OPCODE:
+            break;
+        }
+        sample.stop();
+    }
+
+    // Bulk commands draw exactly what the equivalent single commands would:
+    // DrawLine between consecutive polyline points, DrawPixel at (x + i, y)
+    // for a pixel span, FillRectangle for each box. Damage is recorded per
+    // box for FillRectangles and as one bounding box otherwise.
+    void execute(const BulkCommandView& command) {
+        LatencySample sample;
+        sample.start(EXECUTE_LATENCY);
+        if (damage) {
+            if (command.opcode == FILL_RECTANGLES_OPCODE) {
+                for (size_t i = 0; i < command.boxes.size(); ++i) {
+                    damage->add(boxBounds(command.boxes[i]).intersect(clip));
+                }
+            }
+            else {
+                damage->add(bulkCommandBounds(command).intersect(clip));
+            }
+        }
+        switch (command.opcode) {
+        case DRAW_POLYLINE_OPCODE:
+            drawPolyline(command.points, command.color);
+            break;
+        case DRAW_PIXEL_SPAN_OPCODE:
+            drawPixelSpan(command.x, command.y, command.colors);
+            break;
+        case FILL_RECTANGLES_OPCODE:
+            fillRectangles(command.boxes, command.color);
+            break;
+        }
+        sample.stop();
+    }
+
+    void execute(const CommandBuffer& commands) {
+        for (size_t i = 0; i < commands.size(); ++i) {
+            execute(commands.at(i));
+        }
+    }
+
+    void clearDisplay(uint16_t color) {
+        if (clip.empty()) {
+            return;
+        }
+        if (clip.left == 0 && clip.right == target.getWidth() && target.getStride() == target.getWidth()) {
+            fillSpan(target.row(clip.top), static_cast<size_t>(target.getWidth()) * (clip.bottom - clip.top), color);
+            return;
+        }
+        fillRectangle(clip.left, clip.top, clip.right - clip.left, clip.bottom - clip.top, color);
+    }
+
+    void drawPixel(int x, int y, uint16_t color) {
+        if (clip.contains(x, y)) {
+            target.row(y)[x] = color;
+        }
+    }
+
+    void drawLine(int x0, int y0, int x1, int y1, uint16_t color) {
+        if (y0 == y1) {
+            horizontalLine(std::min(x0, x1), std::max(x0, x1), y0, color);
+            return;
+        }
+        if (x0 == x1) {
+            verticalLine(x0, std::min(y0, y1), std::max(y0, y1), color);
+            return;
+        }
+        LineSteps steps;
+        if (clipLineSteps(x0, y0, x1, y1, clip, steps)) {
+            bresenham(x0, y0, x1, y1, steps, color);
+        }
+    }
+
+    // A single point draws one pixel.
+    void drawPolyline(const PointView& points, uint16_t color) {
+        if (points.size() == 0) {
+            return;
+        }
+        Point from = points[0];
+        if (points.size() == 1) {
+            drawPixel(from.x, from.y, color);
+        }
+        for (size_t i = 1; i < points.size(); ++i) {
+            Point to = points[i];
+            drawLine(from.x, from.y, to.x, to.y, color);
+            from = to;
+        }
+    }
+
+    // colors[i] goes to (x + i, y).
+    void drawPixelSpan(int x, int y, const ColorView& colors) {
+        if (y < clip.top || y >= clip.bottom) {
+            return;
+        }
+        int left = std::max(x, clip.left);
+        int right = std::min(x + static_cast<int>(colors.size()), clip.right);
+        uint16_t* row = target.row(y);
+        for (int column = left; column < right; ++column) {
+            row[column] = colors[static_cast<size_t>(column - x)];
+        }
+    }
+
+    void fillRectangles(const BoxView& boxes, uint16_t color) {
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            Box box = boxes[i];
+            fillRectangle(box.x, box.y, box.width, box.height, color);
+        }
+    }
+
+    void drawRectangle(int x, int y, int width, int height, uint16_t color) {
+        if (width <= 0 || height <= 0) {
+            return;
+        }
+        int right = x + width - 1;
+        int bottom = y + height - 1;
+        horizontalLine(x, right, y, color);
+        horizontalLine(x, right, bottom, color);
+        verticalLine(x, y + 1, bottom - 1, color);
+        verticalLine(right, y + 1, bottom - 1, color);
+    }
+
+    void fillRectangle(int x, int y, int width, int height, uint16_t color) {
+        if (width <= 0 || height <= 0) {
+            return;
+        }
+        int left = std::max(x, clip.left);
+        int right = std::min(x + width, clip.right);
+        int top = std::max(y, clip.top);
+        int bottom = std::min(y + height, clip.bottom);
+        for (int row = top; row < bottom; ++row) {
+            if (left < right) {
+                fillSpan(target.row(row) + left, static_cast<size_t>(right - left), color);
+            }
+        }
+    }
+
+    void drawEllipse(int cx, int cy, int rx, int ry, uint16_t color) {
+        if (rx < 0 || ry < 0 || !ellipseVisible(cx, cy, rx, ry)) {
+            return;
+        }
+        const std::vector<int>& halfWidths = ellipses().halfWidths(rx, ry);
+        int last;
+        for (int dy = visibleRows(cy, ry, last); dy <= last; ++dy) {
+            int outer = halfWidths[dy];
+            // Cover the gap to the next row out so the outline stays connected.
+            int inner = dy < ry ? std::min(outer, halfWidths[dy + 1] + 1) : 0;
+            horizontalLine(cx - outer, cx - inner, cy - dy, color);
+            horizontalLine(cx + inner, cx + outer, cy - dy, color);
+            if (dy != 0) {
+                horizontalLine(cx - outer, cx - inner, cy + dy, color);
+                horizontalLine(cx + inner, cx + outer, cy + dy, color);
+            }
+        }
+    }
+
+    void fillEllipse(int cx, int cy, int rx, int ry, uint16_t color) {
+        if (rx < 0 || ry < 0 || !ellipseVisible(cx, cy, rx, ry)) {
+            return;
+        }
+        const std::vector<int>& halfWidths = ellipses().halfWidths(rx, ry);
+        int last;
+        for (int dy = visibleRows(cy, ry, last); dy <= last; ++dy) {
+            horizontalLine(cx - halfWidths[dy], cx + halfWidths[dy], cy - dy, color);
+            if (dy != 0) {
+                horizontalLine(cx - halfWidths[dy], cx + halfWidths[dy], cy + dy, color);
+            }
+        }
+    }
+
+    // Inclusive span [x0, x1] on row y, clipped.
+    void horizontalLine(int x0, int x1, int y, uint16_t color) {
+        if (y < clip.top || y >= clip.bottom) {
+            return;
+        }
+        x0 = std::max(x0, clip.left);
+        x1 = std::min(x1, clip.right - 1);
+        if (x0 <= x1) {
+            fillSpan(target.row(y) + x0, static_cast<size_t>(x1 - x0 + 1), color);
+        }
+    }
+
+    // Inclusive column [y0, y1] at x, clipped.
+    void verticalLine(int x, int y0, int y1, uint16_t color) {
+        if (x < clip.left || x >= clip.right) {
+            return;
+        }
+        y0 = std::max(y0, clip.top);
+        y1 = std::min(y1, clip.bottom - 1);
+        for (int y = y0; y <= y1; ++y) {
+            target.row(y)[x] = color;
+        }
+    }
+
+private:
+    // Draws steps.first through steps.last of the line, which must lie in
+    // the clip rectangle. The state at the first step is computed directly
+    // (see clipLineSteps), so pixels outside are skipped rather than walked.
+    void bresenham(int x0, int y0, int x1, int y1, const LineSteps& steps, uint16_t color) {
+        int dx = std::abs(x1 - x0);
+        int dy = -std::abs(y1 - y0);
+        int sx = x0 < x1 ? 1 : -1;
+        int sy = y0 < y1 ? 1 : -1;
+        int64_t major = std::max(dx, -dy);
+        int64_t minorSteps = major == 0 ? 0 : (2 * steps.first * static_cast<int64_t>(std::min(dx, -dy)) + major) / (2 * major);
+        // A clipped full-range line skips up to 65535 steps, so the start
+        // state (up to 65535 * 65535) needs 64 bits.
+        int64_t xSteps = dx >= -dy ? steps.first : minorSteps;
+        int64_t ySteps = dx >= -dy ? minorSteps : steps.first;
+        x0 += static_cast<int>(sx * xSteps);
+        y0 += static_cast<int>(sy * ySteps);
+        int64_t error = dx + dy + xSteps * dy + ySteps * dx;
+        for (int step = steps.first;; ++step) {
+            target.row(y0)[x0] = color;
+            if (step == steps.last) {
+                break;
+            }
+            int64_t error2 = 2 * error;
+            if (error2 >= dy) {
+                error += dy;
+                x0 += sx;
+            }
+            if (error2 <= dx) {
+                error += dx;
+                y0 += sy;
+            }
+        }
+    }
+
+    EllipseSpanCache& ellipses() {
+        return sharedEllipses ? *sharedEllipses : ownEllipses;
+    }
+
+    // Range [first, last] of row offsets dy of an ellipse at cy for which
+    // row cy - dy or cy + dy is inside the clip rectangle; returns first.
+    int visibleRows(int cy, int ry, int& last) const {
+        last = std::min(ry, std::max(clip.bottom - 1 - cy, cy - clip.top));
+        return std::max(0, std::min(clip.top - cy, cy - clip.bottom + 1));
+    }
+
+    bool ellipseVisible(int cx, int cy, int rx, int ry) const {
+        return cx + rx >= clip.left && cy + ry >= clip.top && cx - rx < clip.right && cy - ry < clip.bottom;
+    }
+
+    Framebuffer& target;
+    Rect clip;
+    CommandClipper clipper;
+    DamageRegion* damage = nullptr;
+    EllipseSpanCache ownEllipses;
+    EllipseSpanCache* sharedEllipses = nullptr;
+    bool clipMetrics = true;
+};
+
+#endif // RASTERIZER_H
@@ -0,0 +1,248 @@
+#pragma once
+#ifndef RECORD_DECODER_H
+#define RECORD_DECODER_H
+
+#include <cstdint>
+#include <cstddef>
+#include "command_codec.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RECORD_DECODE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// As in span_fill.h, GCC and Clang compile each kernel for its own
+// instruction set.
+#if defined(RECORD_DECODE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define RECORD_DECODE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RECORD_DECODE_TARGET(isa)
+#endif
+
+// Lines, rectangles and ellipses share one 11-byte record: the opcode, four
+// little-endian int16 coordinates and a big-endian color. Senders emit them
+// in long runs of one opcode, which the kernels below unpack into separate
+// coordinate and color columns several records at a time.
+const size_t GEOMETRY_RECORD_SIZE = 11;
+
+inline bool isGeometryOpcode(uint8_t opcode) {
+    return opcode >= DRAW_LINE_OPCODE && opcode <= FILL_ELLIPSE_OPCODE;
+}
+
+static_assert(commandWireSize(COMMAND_DESCRIPTORS[DRAW_LINE_OPCODE]) == GEOMETRY_RECORD_SIZE
+    && commandWireSize(COMMAND_DESCRIPTORS[FILL_ELLIPSE_OPCODE]) == GEOMETRY_RECORD_SIZE, "Geometry records are 11 bytes");
+
+// Number of records, at most limit, at the start of data that are complete
+// and carry the same geometry opcode as the first; 0 if data does not
+// start with a geometry record.
+inline size_t geometryRunLength(const uint8_t* data, size_t size, size_t limit) {
+    if (size == 0 || !isGeometryOpcode(data[0])) {
+        return 0;
+    }
+    size_t count = 0;
+    size_t end = size / GEOMETRY_RECORD_SIZE < limit ? size / GEOMETRY_RECORD_SIZE : limit;
+    while (count < end && data[count * GEOMETRY_RECORD_SIZE] == data[0]) {
+        ++count;
+    }
+    return count;
+}
+
+// Destination columns, each with room for the records decoded.
+struct RecordColumns {
+    int16_t* x0;
+    int16_t* y0;
+    int16_t* x1;
+    int16_t* y1;
+    uint16_t* color;
+};
+
+enum RecordDecodeLevel {
+    SCALAR_RECORD_DECODE,
+    SSSE3_RECORD_DECODE,
+    AVX2_RECORD_DECODE
+};
+
+// Decodes count back-to-back geometry records into columns, skipping the
+// opcode bytes; the caller has checked them.
+typedef void (*RecordDecodeFunction)(const uint8_t* records, size_t count, RecordColumns columns);
+
+inline void decodeRecordsScalar(const uint8_t* records, size_t count, RecordColumns columns) {
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* record = records + i * GEOMETRY_RECORD_SIZE;
+        columns.x0[i] = static_cast<int16_t>((record[2] << 8) | record[1]);
+        columns.y0[i] = static_cast<int16_t>((record[4] << 8) | record[3]);
+        columns.x1[i] = static_cast<int16_t>((record[6] << 8) | record[5]);
+        columns.y1[i] = static_cast<int16_t>((record[8] << 8) | record[7]);
+        columns.color[i] = static_cast<uint16_t>((record[9] << 8) | record[10]);
+    }
+}
+
+#ifdef RECORD_DECODE_X86
+// Each record is loaded as 16 bytes from its opcode byte, so a vector step
+// over n records reads 5 bytes past the last of them; the vector loops stop
+// while that stays inside the run and leave the rest to the scalar loop.
+// A byte shuffle moves the four coordinates to 16-bit lanes 0-3 and the
+// color, byte-swapped, to lane 4; an 8x8 transpose of 16-bit lanes then
+// turns eight such rows into one vector per column.
+const size_t RECORD_LOAD_OVERRUN = 16 - GEOMETRY_RECORD_SIZE;
+
+// The transpose for lanes 0-4 of rows r[0..7].
+#define RECORD_DECODE_TRANSPOSE(unpacklo16, unpackhi16, unpacklo32, unpackhi32, unpacklo64, unpackhi64, r, x0, y0, x1, y1, color) \
+    do { \
+        auto t0 = unpacklo16(r[0], r[1]); \
+        auto t1 = unpackhi16(r[0], r[1]); \
+        auto t2 = unpacklo16(r[2], r[3]); \
+        auto t3 = unpackhi16(r[2], r[3]); \
+        auto t4 = unpacklo16(r[4], r[5]); \
+        auto t5 = unpackhi16(r[4], r[5]); \
+        auto t6 = unpacklo16(r[6], r[7]); \
+        auto t7 = unpackhi16(r[6], r[7]); \
+        auto u0 = unpacklo32(t0, t2); \
+        auto u1 = unpackhi32(t0, t2); \
+        auto u2 = unpacklo32(t4, t6); \
+        auto u3 = unpackhi32(t4, t6); \
+        auto u4 = unpacklo32(t1, t3); \
+        auto u5 = unpacklo32(t5, t7); \
+        x0 = unpacklo64(u0, u2); \
+        y0 = unpackhi64(u0, u2); \
+        x1 = unpacklo64(u1, u3); \
+        y1 = unpackhi64(u1, u3); \
+        color = unpacklo64(u4, u5); \
+    } while (0)
+
+RECORD_DECODE_TARGET("ssse3")
+inline void decodeRecordsSsse3(const uint8_t* records, size_t count, RecordColumns columns) {
+    const size_t lanes = 8;
+    const __m128i shuffle = _mm_setr_epi8(1, 2, 3, 4, 5, 6, 7, 8, 10, 9, -1, -1, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; (i + lanes) * GEOMETRY_RECORD_SIZE + RECORD_LOAD_OVERRUN <= count * GEOMETRY_RECORD_SIZE; i += lanes) {
+        __m128i rows[lanes];
+        for (size_t r = 0; r < lanes; ++r) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(records + (i + r) * GEOMETRY_RECORD_SIZE));
+            rows[r] = _mm_shuffle_epi8(bytes, shuffle);
+        }
+        __m128i x0, y0, x1, y1, color;
+        RECORD_DECODE_TRANSPOSE(_mm_unpacklo_epi16, _mm_unpackhi_epi16, _mm_unpacklo_epi32, _mm_unpackhi_epi32,
+            _mm_unpacklo_epi64, _mm_unpackhi_epi64, rows, x0, y0, x1, y1, color);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(columns.x0 + i), x0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(columns.y0 + i), y0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(columns.x1 + i), x1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(columns.y1 + i), y1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(columns.color + i), color);
+    }
+    decodeRecordsScalar(records + i * GEOMETRY_RECORD_SIZE, count - i,
+        { columns.x0 + i, columns.y0 + i, columns.x1 + i, columns.y1 + i, columns.color + i });
+}
+
+// Sixteen records per step: row r holds record r in its low 128-bit lane
+// and record r + 8 in its high lane. The unpacks work within lanes, so the
+// transpose yields records 0-7 low and 8-15 high, already in column order.
+RECORD_DECODE_TARGET("avx2")
+inline void decodeRecordsAvx2(const uint8_t* records, size_t count, RecordColumns columns) {
+    const size_t lanes = 16;
+    const __m256i shuffle = _mm256_setr_epi8(1, 2, 3, 4, 5, 6, 7, 8, 10, 9, -1, -1, -1, -1, -1, -1,
+        1, 2, 3, 4, 5, 6, 7, 8, 10, 9, -1, -1, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; (i + lanes) * GEOMETRY_RECORD_SIZE + RECORD_LOAD_OVERRUN <= count * GEOMETRY_RECORD_SIZE; i += lanes) {
+        __m256i rows[8];
+        for (size_t r = 0; r < 8; ++r) {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(records + (i + r) * GEOMETRY_RECORD_SIZE));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(records + (i + r + 8) * GEOMETRY_RECORD_SIZE));
+            rows[r] = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1), shuffle);
+        }
+        __m256i x0, y0, x1, y1, color;
+        RECORD_DECODE_TRANSPOSE(_mm256_unpacklo_epi16, _mm256_unpackhi_epi16, _mm256_unpacklo_epi32, _mm256_unpackhi_epi32,
+            _mm256_unpacklo_epi64, _mm256_unpackhi_epi64, rows, x0, y0, x1, y1, color);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(columns.x0 + i), x0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(columns.y0 + i), y0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(columns.x1 + i), x1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(columns.y1 + i), y1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(columns.color + i), color);
+    }
+    decodeRecordsSsse3(records + i * GEOMETRY_RECORD_SIZE, count - i,
+        { columns.x0 + i, columns.y0 + i, columns.x1 + i, columns.y1 + i, columns.color + i });
+}
+
+#undef RECORD_DECODE_TRANSPOSE
+#endif
+
+// Best kernel the CPU supports, detected as in detectSpanFillLevel.
+inline RecordDecodeLevel detectRecordDecodeLevel() {
+#if !defined(RECORD_DECODE_X86)
+    return SCALAR_RECORD_DECODE;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, 1, 0);
+    bool ssse3 = (info[2] & (1 << 9)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    if (avx && avx2 && (xcr0 & 0x6) == 0x6) {
+        return AVX2_RECORD_DECODE;
+    }
+    return ssse3 ? SSSE3_RECORD_DECODE : SCALAR_RECORD_DECODE;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return AVX2_RECORD_DECODE;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return SSSE3_RECORD_DECODE;
+    }
+    return SCALAR_RECORD_DECODE;
+#endif
+}
+
+inline RecordDecodeFunction recordDecodeKernel(RecordDecodeLevel level) {
+    switch (level) {
+#ifdef RECORD_DECODE_X86
+    case SSSE3_RECORD_DECODE:
+        return decodeRecordsSsse3;
+    case AVX2_RECORD_DECODE:
+        return decodeRecordsAvx2;
+#endif
+    default:
+        return decodeRecordsScalar;
+    }
+}
+
+inline const char* recordDecodeLevelName(RecordDecodeLevel level) {
+    switch (level) {
+    case SSSE3_RECORD_DECODE: return "SSSE3";
+    case AVX2_RECORD_DECODE: return "AVX2";
+    default: return "scalar";
+    }
+}
+
+// The kernel decodeRecords dispatches to, picked once on first use.
+inline RecordDecodeLevel& activeRecordDecodeLevel() {
+    static RecordDecodeLevel level = detectRecordDecodeLevel();
+    return level;
+}
+
+inline RecordDecodeFunction& activeRecordDecode() {
+    static RecordDecodeFunction function = recordDecodeKernel(activeRecordDecodeLevel());
+    return function;
+}
+
+// Forces a kernel, e.g. for benchmarks. Levels above what the CPU supports
+// are refused; returns whether the level is now active.
+inline bool setRecordDecodeLevel(RecordDecodeLevel level) {
+    if (level > detectRecordDecodeLevel()) {
+        return false;
+    }
+    activeRecordDecodeLevel() = level;
+    activeRecordDecode() = recordDecodeKernel(level);
+    return true;
+}
+
+inline void decodeRecords(const uint8_t* records, size_t count, RecordColumns columns) {
+    activeRecordDecode()(records, count, columns);
+}
+
+#endif // RECORD_DECODER_H
@@ -0,0 +1,238 @@
+#pragma once
+#ifndef SCENE_ENCODER_H
+#define SCENE_ENCODER_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include "command_codec.h"
+#include "command_bounds.h"
+#include "compact_codec.h"
+#include "damage_region.h"
+
+// Client side of a display: turns whole scenes into the smallest update
+// that brings the server's image from the previous scene to the new one.
+//
+// A scene is the list of drawing commands for a full image in painter's
+// order, optionally led by ClearDisplay with the background color. The
+// encoder remembers the last scene it sent and lines the new one up
+// against it: the common head and tail are skipped, and in between
+// commands are compared slot by slot when both middles have the same
+// length (a needle or a bar moved) and all counted as changed otherwise.
+// The bounds of every changed command, old and new, are damaged; then
+// every command of the new scene that overlaps the damage is damaged too,
+// until nothing more overlaps. The update fills the damage with the
+// background and redraws, in order, the commands that overlap it. Pixels
+// outside the damage are only ever touched by commands that did not
+// change, so they are already right.
+//
+// Use one encoder per display. Updates rely on the server still showing
+// the previous scene, so a sender that may have lost a datagram calls
+// reset() to send the next scene in full. Each update is wrapped in
+// BeginFrame/EndFrame so it appears at once.
+class SceneEncoder {
+public:
+    // maxRects bounds the damage rectangles, each of which costs one fill.
+    SceneEncoder(int width, int height, uint16_t background = 0, size_t maxRects = 8)
+        : surface{ 0, 0, width, height }, background(background), maxRects(maxRects) {
+        if (width <= 0 || height <= 0 || width > INT16_MAX || height > INT16_MAX) {
+            throw std::invalid_argument("Invalid scene size");
+        }
+    }
+
+    // Commands that turn the previous scene into scene, between frame
+    // markers; the full scene after construction or reset().
+    const std::vector<CommandData>& update(const std::vector<CommandData>& scene) {
+        for (const CommandData& command : scene) {
+            if (isFrameMarker(command.opcode)) {
+                throw std::invalid_argument("Scenes must not contain frame markers");
+            }
+        }
+        size_t first = leadingClear(scene);
+        uint16_t color = first ? scene[0].clearDisplay.color : background;
+        commands.clear();
+        commands.push_back(frameMarker(BEGIN_FRAME_OPCODE));
+        if (!synchronized || color != previousBackground || !diff(scene, first, color)) {
+            commands.resize(1);
+            pushClear(color);
+            commands.insert(commands.end(), scene.begin() + first, scene.end());
+            ++fullUpdates;
+        }
+        commands.push_back(frameMarker(END_FRAME_OPCODE));
+        previous.assign(scene.begin() + first, scene.end());
+        previousBackground = color;
+        synchronized = true;
+        ++frame;
+        return commands;
+    }
+
+    // Forgets what the server shows; the next update is a full scene.
+    void reset() {
+        synchronized = false;
+    }
+
+    uint64_t getFullUpdates() const {
+        return fullUpdates;
+    }
+
+private:
+    static size_t leadingClear(const std::vector<CommandData>& scene) {
+        return !scene.empty() && scene[0].opcode == CLEAR_DISPLAY_OPCODE ? 1 : 0;
+    }
+
+    static bool sameCommand(const CommandData& a, const CommandData& b) {
+        if (a.opcode != b.opcode) {
+            return false;
+        }
+        size_t count = COMMAND_DESCRIPTORS[a.opcode].fieldCount;
+        uint16_t left[MAX_COMMAND_FIELDS];
+        uint16_t right[MAX_COMMAND_FIELDS];
+        loadFields(a, left, count);
+        loadFields(b, right, count);
+        return std::equal(left, left + count, right);
+    }
+
+    CommandData frameMarker(CommandOpcode opcode) const {
+        CommandData command;
+        command.opcode = opcode;
+        if (opcode == BEGIN_FRAME_OPCODE) {
+            command.beginFrame = { frame };
+        }
+        else {
+            command.endFrame = { frame };
+        }
+        return command;
+    }
+
+    void pushClear(uint16_t color) {
+        CommandData command;
+        command.opcode = CLEAR_DISPLAY_OPCODE;
+        command.clearDisplay = { color };
+        commands.push_back(command);
+    }
+
+    // Appends the incremental update for scene, whose drawing starts at
+    // first; returns false if it would not be smaller than the full scene.
+    bool diff(const std::vector<CommandData>& scene, size_t first, uint16_t color) {
+        const CommandData* next = scene.data() + first;
+        size_t nextSize = scene.size() - first;
+        size_t head = 0;
+        while (head < previous.size() && head < nextSize && sameCommand(previous[head], next[head])) {
+            ++head;
+        }
+        size_t tail = 0;
+        while (tail < previous.size() - head && tail < nextSize - head
+            && sameCommand(previous[previous.size() - 1 - tail], next[nextSize - 1 - tail])) {
+            ++tail;
+        }
+        size_t oldMiddle = previous.size() - head - tail;
+        size_t newMiddle = nextSize - head - tail;
+
+        DamageRegion damage(surface, maxRects);
+        redraw.assign(nextSize, false);
+        bool paired = oldMiddle == newMiddle;
+        for (size_t i = 0; i < std::max(oldMiddle, newMiddle); ++i) {
+            if (paired && sameCommand(previous[head + i], next[head + i])) {
+                continue;
+            }
+            if (i < oldMiddle) {
+                damage.add(commandBounds(previous[head + i], surface));
+            }
+            if (i < newMiddle) {
+                damage.add(commandBounds(next[head + i], surface));
+                redraw[head + i] = true;
+            }
+        }
+        if (damage.empty()) {
+            return true;
+        }
+        for (bool grew = true; grew;) {
+            grew = false;
+            for (size_t i = 0; i < nextSize; ++i) {
+                if (redraw[i]) {
+                    continue;
+                }
+                Rect bounds = commandBounds(next[i], surface).intersect(surface);
+                for (const Rect& rect : damage.getRects()) {
+                    if (rect.intersects(bounds)) {
+                        redraw[i] = true;
+                        damage.add(bounds);
+                        grew = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (damage.area() >= surface.area()) {
+            return false;
+        }
+
+        for (const Rect& rect : damage.getRects()) {
+            CommandData fill;
+            fill.opcode = FILL_RECTANGLE_OPCODE;
+            fill.fillRectangle = { static_cast<int16_t>(rect.left), static_cast<int16_t>(rect.top),
+                static_cast<int16_t>(rect.right - rect.left), static_cast<int16_t>(rect.bottom - rect.top), color };
+            commands.push_back(fill);
+        }
+        size_t redrawn = 0;
+        for (size_t i = 0; i < nextSize; ++i) {
+            if (redraw[i]) {
+                commands.push_back(next[i]);
+                ++redrawn;
+            }
+        }
+        // The full scene is a clear and every command.
+        return redrawn + damage.getRects().size() < nextSize + 1;
+    }
+
+    Rect surface;
+    uint16_t background;
+    size_t maxRects;
+    std::vector<CommandData> previous;
+    uint16_t previousBackground = 0;
+    bool synchronized = false;
+    uint16_t frame = 0;
+    uint64_t fullUpdates = 0;
+    std::vector<CommandData> commands;
+    std::vector<bool> redraw;
+};
+
+// Packs commands into compact batches (see compact_codec.h) of at most
+// maxDatagram bytes each, numbered from sequence, which is advanced past
+// the last batch. Replaces the contents of datagrams.
+inline void packCompactBatches(const std::vector<CommandData>& commands, uint32_t& sequence, size_t maxDatagram,
+    std::vector<std::vector<uint8_t>>& datagrams) {
+    // Marker and two varints of at most five bytes each.
+    const size_t HEADER_BYTES = 1 + 2 * UINT32_VARINT_BYTES;
+    datagrams.clear();
+    std::vector<uint8_t> body;
+    CompactState state;
+    uint32_t count = 0;
+    auto flush = [&] {
+        datagrams.emplace_back(1, COMPACT_BATCH_MARKER);
+        appendVarint(sequence++, datagrams.back());
+        appendVarint(count, datagrams.back());
+        datagrams.back().insert(datagrams.back().end(), body.begin(), body.end());
+        body.clear();
+        state = CompactState();
+        count = 0;
+    };
+    for (const CommandData& command : commands) {
+        size_t mark = body.size();
+        CompactState saved = state;
+        appendCompactCommand(command, state, body);
+        if (count > 0 && HEADER_BYTES + body.size() > maxDatagram) {
+            body.resize(mark);
+            state = saved;
+            flush();
+            appendCompactCommand(command, state, body);
+        }
+        ++count;
+    }
+    if (count > 0) {
+        flush();
+    }
+}
+
+#endif // SCENE_ENCODER_H
@@ -0,0 +1,212 @@
+#pragma once
+#ifndef SPAN_FILL_H
+#define SPAN_FILL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SPAN_FILL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile each kernel for its own instruction set so the rest
+// of the program can stay at the baseline target; MSVC needs no annotation.
+#if defined(SPAN_FILL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SPAN_FILL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SPAN_FILL_TARGET(isa)
+#endif
+
+enum SpanFillLevel {
+    SCALAR_SPAN_FILL,
+    SSE2_SPAN_FILL,
+    AVX2_SPAN_FILL,
+    AVX512_SPAN_FILL
+};
+
+typedef void (*SpanFillFunction)(uint16_t* dst, size_t count, uint16_t color);
+
+// Spans at least this large bypass the cache with non-temporal stores; a
+// full-screen clear would otherwise evict everything else the renderer uses.
+const size_t STREAMING_FILL_BYTES = 1 << 20;
+
+inline void fillSpanScalar(uint16_t* dst, size_t count, uint16_t color) {
+    std::fill_n(dst, count, color);
+}
+
+#ifdef SPAN_FILL_X86
+// Each vector kernel writes one unaligned vector at the head, aligned vectors
+// through the body and one unaligned vector ending exactly at the tail. Head
+// and tail overlap the body, which is harmless since every lane holds the
+// same color. Spans shorter than a vector fall back to scalar stores.
+
+SPAN_FILL_TARGET("sse2")
+inline void fillSpanSse2(uint16_t* dst, size_t count, uint16_t color) {
+    const size_t lanes = 8;
+    if (count < lanes) {
+        fillSpanScalar(dst, count, color);
+        return;
+    }
+    const __m128i value = _mm_set1_epi16(static_cast<short>(color));
+    uint16_t* end = dst + count;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), value);
+    uint16_t* p = dst + ((16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15) / 2;
+    if (count * 2 >= STREAMING_FILL_BYTES) {
+        for (; p + lanes <= end; p += lanes) {
+            _mm_stream_si128(reinterpret_cast<__m128i*>(p), value);
+        }
+        _mm_sfence();
+    }
+    else {
+        for (; p + lanes <= end; p += lanes) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(p), value);
+        }
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(end - lanes), value);
+}
+
+SPAN_FILL_TARGET("avx2")
+inline void fillSpanAvx2(uint16_t* dst, size_t count, uint16_t color) {
+    const size_t lanes = 16;
+    if (count < lanes) {
+        fillSpanSse2(dst, count, color);
+        return;
+    }
+    const __m256i value = _mm256_set1_epi16(static_cast<short>(color));
+    uint16_t* end = dst + count;
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), value);
+    uint16_t* p = dst + ((32 - (reinterpret_cast<uintptr_t>(dst) & 31)) & 31) / 2;
+    if (count * 2 >= STREAMING_FILL_BYTES) {
+        for (; p + lanes <= end; p += lanes) {
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(p), value);
+        }
+        _mm_sfence();
+    }
+    else {
+        for (; p + lanes <= end; p += lanes) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(p), value);
+        }
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(end - lanes), value);
+}
+
+SPAN_FILL_TARGET("avx512f")
+inline void fillSpanAvx512(uint16_t* dst, size_t count, uint16_t color) {
+    const size_t lanes = 32;
+    if (count < lanes) {
+        fillSpanAvx2(dst, count, color);
+        return;
+    }
+    const __m512i value = _mm512_set1_epi32(static_cast<int>(color * 0x00010001u));
+    uint16_t* end = dst + count;
+    _mm512_storeu_si512(dst, value);
+    uint16_t* p = dst + ((64 - (reinterpret_cast<uintptr_t>(dst) & 63)) & 63) / 2;
+    if (count * 2 >= STREAMING_FILL_BYTES) {
+        for (; p + lanes <= end; p += lanes) {
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(p), value);
+        }
+        _mm_sfence();
+    }
+    else {
+        for (; p + lanes <= end; p += lanes) {
+            _mm512_store_si512(p, value);
+        }
+    }
+    _mm512_storeu_si512(end - lanes, value);
+}
+#endif
+
+// Best kernel the CPU and OS support, from CPUID (and XGETBV for the AVX
+// register state on MSVC; GCC and Clang check that in __builtin_cpu_supports).
+inline SpanFillLevel detectSpanFillLevel() {
+#if !defined(SPAN_FILL_X86)
+    return SCALAR_SPAN_FILL;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, 1, 0);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    bool avx512f = (info[1] & (1 << 16)) != 0;
+    if (avx512f && (xcr0 & 0xE6) == 0xE6) {
+        return AVX512_SPAN_FILL;
+    }
+    if (avx && avx2 && (xcr0 & 0x6) == 0x6) {
+        return AVX2_SPAN_FILL;
+    }
+    return sse2 ? SSE2_SPAN_FILL : SCALAR_SPAN_FILL;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return AVX512_SPAN_FILL;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return AVX2_SPAN_FILL;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SSE2_SPAN_FILL;
+    }
+    return SCALAR_SPAN_FILL;
+#endif
+}
+
+inline SpanFillFunction spanFillKernel(SpanFillLevel level) {
+    switch (level) {
+#ifdef SPAN_FILL_X86
+    case SSE2_SPAN_FILL:
+        return fillSpanSse2;
+    case AVX2_SPAN_FILL:
+        return fillSpanAvx2;
+    case AVX512_SPAN_FILL:
+        return fillSpanAvx512;
+#endif
+    default:
+        return fillSpanScalar;
+    }
+}
+
+inline const char* spanFillLevelName(SpanFillLevel level) {
+    switch (level) {
+    case SSE2_SPAN_FILL: return "SSE2";
+    case AVX2_SPAN_FILL: return "AVX2";
+    case AVX512_SPAN_FILL: return "AVX-512";
+    default: return "scalar";
+    }
+}
+
+// The kernel fillSpan dispatches to, picked once on first use.
+inline SpanFillLevel& activeSpanFillLevel() {
+    static SpanFillLevel level = detectSpanFillLevel();
+    return level;
+}
+
+inline SpanFillFunction& activeSpanFill() {
+    static SpanFillFunction function = spanFillKernel(activeSpanFillLevel());
+    return function;
+}
+
+// Forces a kernel, e.g. for benchmarks. Levels above what the CPU supports
+// are refused; returns whether the level is now active.
+inline bool setSpanFillLevel(SpanFillLevel level) {
+    if (level > detectSpanFillLevel()) {
+        return false;
+    }
+    activeSpanFillLevel() = level;
+    activeSpanFill() = spanFillKernel(level);
+    return true;
+}
+
+// Fills the first count pixels of dst with color.
+inline void fillSpan(uint16_t* dst, size_t count, uint16_t color) {
+    activeSpanFill()(dst, count, color);
+}
+
+#endif // SPAN_FILL_H
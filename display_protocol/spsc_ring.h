@@ -0,0 +1,247 @@
+#pragma once
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#pragma comment(lib, "synchronization.lib")
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define SPSC_RING_PAUSE() _mm_pause()
+#else
+#define SPSC_RING_PAUSE()
+#endif
+
+const size_t CACHE_LINE_SIZE = 64;
+
+// Counter a thread can sleep on until it changes: a futex on Linux,
+// WaitOnAddress on Windows, a condition variable elsewhere. notify() costs
+// a fence and a load unless the waiter is actually asleep, and wakes it
+// once rather than on every change. Supports a single waiting thread.
+class WaitEvent {
+public:
+    uint32_t prepareWait() {
+        sleeping.store(true);
+        return epoch.load();
+    }
+
+    void wait(uint32_t seen) {
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch), FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0);
+#elif defined(_WIN32)
+        WaitOnAddress(&epoch, &seen, sizeof(seen), INFINITE);
+#else
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return epoch.load() != seen; });
+#endif
+    }
+
+    void cancelWait() {
+        sleeping.store(false);
+    }
+
+    // Callers publish their state change first; the fence orders it before
+    // the waiter check so a thread between prepareWait() and wait() is
+    // either seen here or sees the change itself.
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!sleeping.load(std::memory_order_relaxed) || !sleeping.exchange(false)) {
+            return;
+        }
+        epoch.fetch_add(1);
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#elif defined(_WIN32)
+        WakeByAddressSingle(&epoch);
+#else
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.notify_one();
+#endif
+    }
+
+private:
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+    std::atomic<uint32_t> epoch{ 0 };
+    std::atomic<bool> sleeping{ false };
+#if !defined(__linux__) && !defined(_WIN32)
+    std::mutex mutex;
+    std::condition_variable changed;
+#endif
+};
+
+// Bounded single-producer/single-consumer queue of trivially copyable items,
+// e.g. CommandData between the receive and render threads. Head and tail
+// live on separate cache lines and each side caches the other's index, so
+// an uncontended push or pop touches no shared line. Exactly one thread may
+// push and exactly one may pop.
+template <typename T>
+class SpscRing {
+    static_assert(std::is_trivially_copyable<T>::value, "SpscRing carries items by value");
+
+public:
+    // capacity is rounded up to a power of two.
+    explicit SpscRing(size_t capacity) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Ring capacity must be positive");
+        }
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    // Pushes up to count items and returns how many fit.
+    size_t tryPush(const T* items, size_t count) {
+        size_t tail = producer.index.load(std::memory_order_relaxed);
+        if (capacity() - (tail - producer.cached) < count) {
+            producer.cached = consumer.index.load(std::memory_order_acquire);
+        }
+        size_t free = capacity() - (tail - producer.cached);
+        size_t pushed = count < free ? count : free;
+        for (size_t i = 0; i < pushed; ++i) {
+            slots[(tail + i) & mask] = items[i];
+        }
+        if (pushed > 0) {
+            producer.index.store(tail + pushed, std::memory_order_release);
+            notEmpty.notify();
+        }
+        return pushed;
+    }
+
+    bool tryPush(const T& item) {
+        return tryPush(&item, 1) == 1;
+    }
+
+    // Pops up to count items into out and returns how many were available.
+    size_t tryPop(T* out, size_t count) {
+        size_t head = consumer.index.load(std::memory_order_relaxed);
+        if (consumer.cached - head < count) {
+            consumer.cached = producer.index.load(std::memory_order_acquire);
+        }
+        size_t available = consumer.cached - head;
+        size_t popped = count < available ? count : available;
+        for (size_t i = 0; i < popped; ++i) {
+            out[i] = slots[(head + i) & mask];
+        }
+        if (popped > 0) {
+            consumer.index.store(head + popped, std::memory_order_release);
+            notFull.notify();
+        }
+        return popped;
+    }
+
+    bool tryPop(T& item) {
+        return tryPop(&item, 1) == 1;
+    }
+
+    // Blocking variants: spin briefly, then sleep until the other side moves.
+    void push(const T* items, size_t count) {
+        while (count > 0) {
+            size_t pushed = tryPush(items, count);
+            items += pushed;
+            count -= pushed;
+            if (count > 0 && pushed == 0) {
+                waitUntil(notFull, [&] { return tryPushPossible(); });
+            }
+        }
+    }
+
+    void push(const T& item) {
+        push(&item, 1);
+    }
+
+    // Waits for at least one item and pops up to count.
+    size_t pop(T* out, size_t count) {
+        for (;;) {
+            size_t popped = tryPop(out, count);
+            if (popped > 0) {
+                return popped;
+            }
+            waitUntil(notEmpty, [&] { return producer.index.load(std::memory_order_acquire) != consumer.index.load(std::memory_order_relaxed); });
+        }
+    }
+
+    // Like pop(), but gives up once wake() is called with the ring empty.
+    // Returns 0 in that case.
+    size_t popUntilWoken(T* out, size_t count, const std::atomic<bool>& stop) {
+        for (;;) {
+            size_t popped = tryPop(out, count);
+            if (popped > 0 || stop.load()) {
+                return popped;
+            }
+            waitUntil(notEmpty, [&] { return stop.load() || producer.index.load(std::memory_order_acquire) != consumer.index.load(std::memory_order_relaxed); });
+        }
+    }
+
+    // Wakes a consumer blocked in popUntilWoken so it can observe its stop flag.
+    void wake() {
+        notEmpty.notify();
+    }
+
+private:
+    bool tryPushPossible() {
+        return producer.index.load(std::memory_order_relaxed) - consumer.index.load(std::memory_order_acquire) < capacity();
+    }
+
+    // Spinning only pays off when the other side runs on another core.
+    static int spinLimit() {
+        static const int limit = std::thread::hardware_concurrency() > 1 ? 128 : 0;
+        return limit;
+    }
+
+    template <typename Ready>
+    static void waitUntil(WaitEvent& event, Ready ready) {
+        for (int spin = 0; spin < spinLimit(); ++spin) {
+            if (ready()) {
+                return;
+            }
+            SPSC_RING_PAUSE();
+        }
+        uint32_t seen = event.prepareWait();
+        if (!ready()) {
+            event.wait(seen);
+        }
+        event.cancelWait();
+    }
+
+    // One side's position plus its cached copy of the other side's.
+    struct alignas(CACHE_LINE_SIZE) Cursor {
+        std::atomic<size_t> index{ 0 };
+        size_t cached = 0;
+    };
+
+    Cursor producer;
+    Cursor consumer;
+    alignas(CACHE_LINE_SIZE) WaitEvent notEmpty;
+    alignas(CACHE_LINE_SIZE) WaitEvent notFull;
+    std::vector<T> slots;
+    size_t mask = 0;
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,114 @@
+#pragma once
+#ifndef TILE_RENDERER_H
+#define TILE_RENDERER_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "rasterizer.h"
+#include "work_stealing_pool.h"
+
+// Renders a command stream in parallel by splitting the surface into square
+// tiles. Every command is binned into the tiles its bounding box overlaps,
+// then tiles are rasterized on a work-stealing pool, each with its own
+// Rasterizer clipped to the tile. A tile replays its bin in stream order and
+// no two tiles share a pixel, so the result is bit-identical to executing
+// the stream serially. The bounds computed for binning also feed an optional
+// damage region, and clip outcomes are counted here against the whole
+// surface rather than once per tile.
+class TileRenderer {
+public:
+    TileRenderer(Framebuffer& target, size_t threads, int tileSize = 128) :
+        target(target), pool(threads), tileSize(checkTileSize(tileSize)),
+        tilesX((target.getWidth() + tileSize - 1) / tileSize),
+        tilesY((target.getHeight() + tileSize - 1) / tileSize),
+        bins(static_cast<size_t>(tilesX) * tilesY), clipper(target.getWidth(), target.getHeight()) {
+        for (size_t worker = 0; worker < pool.size(); ++worker) {
+            rasterizers.emplace_back(new Rasterizer(target));
+            rasterizers.back()->setClipMetrics(false);
+        }
+    }
+
+    size_t threadCount() const {
+        return pool.size();
+    }
+
+    void setDamageRegion(DamageRegion* region) {
+        damage = region;
+    }
+
+    void execute(const CommandBuffer& buffer) {
+        commands.clear();
+        for (size_t i = 0; i < buffer.size(); ++i) {
+            commands.push_back(buffer.at(i));
+        }
+        render();
+    }
+
+    void execute(const std::vector<CommandData>& stream) {
+        commands.assign(stream.begin(), stream.end());
+        render();
+    }
+
+private:
+    static int checkTileSize(int tileSize) {
+        if (tileSize <= 0) {
+            throw std::invalid_argument("Invalid tile size");
+        }
+        return tileSize;
+    }
+
+    void render() {
+        for (std::vector<uint32_t>& bin : bins) {
+            bin.clear();
+        }
+        const Rect surface = { 0, 0, target.getWidth(), target.getHeight() };
+        for (size_t i = 0; i < commands.size(); ++i) {
+            CommandData clipped = commands[i];
+            countClip(clipper.clip(clipped));
+            Rect bounds = commandBounds(commands[i], surface).intersect(surface);
+            if (bounds.empty()) {
+                continue;
+            }
+            if (damage) {
+                damage->add(bounds);
+            }
+            int firstX = bounds.left / tileSize;
+            int lastX = (bounds.right - 1) / tileSize;
+            int firstY = bounds.top / tileSize;
+            int lastY = (bounds.bottom - 1) / tileSize;
+            for (int tileY = firstY; tileY <= lastY; ++tileY) {
+                for (int tileX = firstX; tileX <= lastX; ++tileX) {
+                    bins[static_cast<size_t>(tileY) * tilesX + tileX].push_back(static_cast<uint32_t>(i));
+                }
+            }
+        }
+
+        pool.parallelFor(bins.size(), [this](size_t tile, size_t worker) {
+            const std::vector<uint32_t>& bin = bins[tile];
+            if (bin.empty()) {
+                return;
+            }
+            int tileX = static_cast<int>(tile % tilesX) * tileSize;
+            int tileY = static_cast<int>(tile / tilesX) * tileSize;
+            Rasterizer& rasterizer = *rasterizers[worker];
+            rasterizer.setClip({ tileX, tileY, tileX + tileSize, tileY + tileSize });
+            for (uint32_t index : bin) {
+                rasterizer.execute(commands[index]);
+            }
+        });
+    }
+
+    Framebuffer& target;
+    WorkStealingPool pool;
+    int tileSize;
+    int tilesX;
+    int tilesY;
+    std::vector<std::vector<uint32_t>> bins;
+    std::vector<std::unique_ptr<Rasterizer>> rasterizers;
+    std::vector<CommandData> commands;
+    CommandClipper clipper;
+    DamageRegion* damage = nullptr;
+};
+
+#endif // TILE_RENDERER_H
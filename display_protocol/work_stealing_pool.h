@@ -0,0 +1,157 @@
+#pragma once
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <vector>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+// Fixed set of worker threads running parallelFor jobs. Each job's indices
+// are dealt out in contiguous chunks to per-worker deques; a worker pops
+// from the back of its own deque and, once empty, steals from the front of
+// the others, so uneven tiles still balance across cores. The calling
+// thread takes part as worker 0.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t threads) : queues(threads > 0 ? threads : 1) {
+        for (size_t worker = 1; worker < queues.size(); ++worker) {
+            workers.emplace_back([this, worker] { workerLoop(worker); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : workers) {
+            thread.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t size() const {
+        return queues.size();
+    }
+
+    // Runs task(index, worker) for every index in [0, count) and returns when
+    // all of them are done. worker identifies the thread, in [0, size()).
+    void parallelFor(size_t count, const std::function<void(size_t, size_t)>& task) {
+        if (count == 0) {
+            return;
+        }
+        size_t chunk = (count + queues.size() - 1) / queues.size();
+        for (size_t worker = 0; worker < queues.size(); ++worker) {
+            std::lock_guard<std::mutex> lock(queues[worker].mutex);
+            for (size_t index = worker * chunk; index < count && index < (worker + 1) * chunk; ++index) {
+                queues[worker].indices.push_back(index);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &task;
+            remaining = count;
+            ++generation;
+        }
+        wake.notify_all();
+
+        runTasks(0);
+
+        // Waiting for active workers too guarantees nobody still holds task
+        // when it goes out of scope.
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return remaining == 0 && active == 0; });
+        job = nullptr;
+    }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> indices;
+    };
+
+    bool popOwn(size_t worker, size_t& index) {
+        WorkQueue& queue = queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.indices.empty()) {
+            return false;
+        }
+        index = queue.indices.back();
+        queue.indices.pop_back();
+        return true;
+    }
+
+    bool steal(size_t worker, size_t& index) {
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            WorkQueue& queue = queues[(worker + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.indices.empty()) {
+                index = queue.indices.front();
+                queue.indices.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void runTasks(size_t worker) {
+        const std::function<void(size_t, size_t)>* task;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (job == nullptr) {
+                return;
+            }
+            task = job;
+            ++active;
+        }
+        size_t index;
+        size_t completed = 0;
+        while (popOwn(worker, index) || steal(worker, index)) {
+            (*task)(index, worker);
+            ++completed;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining -= completed;
+        --active;
+        if (remaining == 0 && active == 0) {
+            done.notify_all();
+        }
+    }
+
+    void workerLoop(size_t worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || (generation != seen && job != nullptr); });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            runTasks(worker);
+        }
+    }
+
+    std::vector<WorkQueue> queues;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t, size_t)>* job = nullptr;
+    size_t remaining = 0;
+    size_t active = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
+
+#endif // WORK_STEALING_POOL_H